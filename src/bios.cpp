@@ -0,0 +1,406 @@
+#include "bios.h"
+#include "cpu.h"
+#include <algorithm>
+#include <climits>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Estimates of the BIOS timing: the cost of the SWI entry and return plus the work the BIOS loops do, so code
+// timed around these calls sees about the same number of cycles as with the real BIOS
+const uint32_t CallCycles = 40;
+
+// Interrupt flags the interrupt handler of the game sets for IntrWait, at the end of IWRAM
+const uint32_t InterruptCheckAddress = 0x03007FF8;
+
+uint32_t halt(GBA::CPU& cpu, bool stop) {
+    cpu.getMemory().write8(GBA::Memory::HALTCNTAddress, stop ? 0x80 : 0x00);
+    return CallCycles;
+}
+
+// Returns to the swi itself while waiting, so the flags are checked again after the interrupt handler ran.
+// waiting is set until then, the flags set before the call are only discarded the first time.
+uint32_t intrWait(GBA::CPU& cpu, bool discard, uint16_t interrupts, bool& waiting) {
+    GBA::Memory& memory = cpu.getMemory();
+    memory.write16(GBA::Memory::IMEAddress, 1);
+    uint16_t flags = memory.read16(InterruptCheckAddress);
+    if (discard && !waiting)
+        flags &= ~interrupts;
+    if (flags & interrupts) {
+        memory.write16(InterruptCheckAddress, flags & ~interrupts);
+        waiting = false;
+        return CallCycles;
+    }
+    memory.write16(InterruptCheckAddress, flags);
+    waiting = true;
+    cpu.PC() -= cpu.inThumb() ? 2 : 4;
+    return halt(cpu, false);
+}
+
+uint32_t significantBits(uint32_t value) {
+    uint32_t bits = 0;
+    while (value != 0) {
+        bits++;
+        value >>= 1;
+    }
+    return bits;
+}
+
+uint32_t div(GBA::CPU& cpu, int32_t numerator, int32_t denominator) {
+    if (denominator == 0) {
+        // the BIOS never returns from this, behave like the common emulator convention instead of hanging
+        cpu.R(0) = numerator < 0 ? -1 : 1;
+        cpu.R(1) = numerator;
+        cpu.R(3) = 1;
+        return CallCycles;
+    }
+    int32_t quotient;
+    int32_t remainder;
+    if (numerator == INT_MIN && denominator == -1) {
+        quotient = INT_MIN;
+        remainder = 0;
+    }
+    else {
+        quotient = numerator / denominator;
+        remainder = numerator % denominator;
+    }
+    cpu.R(0) = quotient;
+    cpu.R(1) = remainder;
+    cpu.R(3) = quotient < 0 ? -static_cast<uint32_t>(quotient) : quotient;
+    // the BIOS divides bit by bit
+    return CallCycles + 4 * significantBits(numerator < 0 ? -static_cast<uint32_t>(numerator) : numerator);
+}
+
+uint32_t sqrt(GBA::CPU& cpu, uint32_t value) {
+    uint32_t root = 0;
+    for (uint32_t bit = 1u << 15; bit != 0; bit >>= 1) {
+        uint32_t candidate = root | bit;
+        if (candidate * candidate <= value)
+            root = candidate;
+    }
+    cpu.R(0) = root;
+    return CallCycles + 8 * (significantBits(value) + 1) / 2;
+}
+
+// Polynomial the BIOS evaluates for ArcTan, tangent and angle in 1.14 fixed point. Also returns the intermediate
+// values the BIOS leaves in R1 and R3.
+int32_t arcTan(int32_t tangent, int32_t& r1, int32_t& r3) {
+    int32_t a = -((tangent * tangent) >> 14);
+    int32_t b = ((0xA9 * a) >> 14) + 0x390;
+    b = ((b * a) >> 14) + 0x91C;
+    b = ((b * a) >> 14) + 0xFB6;
+    b = ((b * a) >> 14) + 0x16AA;
+    b = ((b * a) >> 14) + 0x2081;
+    b = ((b * a) >> 14) + 0x3651;
+    b = ((b * a) >> 14) + 0xA2F9;
+    r1 = a;
+    r3 = b;
+    return (tangent * b) >> 16;
+}
+
+// Angle of (x, y) in the full circle, 0x10000 per turn
+int32_t arcTan2(int32_t x, int32_t y, int32_t& r1, int32_t& r3) {
+    // the axes are answered without the polynomial, which leaves nothing in R1 and R3
+    r1 = 0;
+    r3 = 0;
+    if (y == 0)
+        return x >= 0 ? 0 : 0x8000;
+    if (x == 0)
+        return y >= 0 ? 0x4000 : 0xC000;
+    // the octant picks which of x and y is divided by the other so the tangent stays below 1
+    if (y >= 0) {
+        if (x >= 0 && x >= y)
+            return arcTan((y << 14) / x, r1, r3);
+        if (x < 0 && -x >= y)
+            return arcTan((y << 14) / x, r1, r3) + 0x8000;
+        return 0x4000 - arcTan((x << 14) / y, r1, r3);
+    }
+    if (x <= 0 && -x > -y)
+        return arcTan((y << 14) / x, r1, r3) + 0x8000;
+    if (x > 0 && x >= -y)
+        return arcTan((y << 14) / x, r1, r3) + 0x10000;
+    return 0xC000 - arcTan((x << 14) / y, r1, r3);
+}
+
+// R0 source, R1 destination, R2 unit count in bits 20-0, fill in bit 24 and words instead of halfwords in bit 26
+uint32_t cpuSet(GBA::CPU& cpu) {
+    GBA::Memory& memory = cpu.getMemory();
+    uint32_t source = cpu.R(0);
+    uint32_t destination = cpu.R(1);
+    uint32_t count = cpu.R(2) & 0x1FFFFF;
+    bool fill = (cpu.R(2) >> 24) & 0x1;
+    bool words = (cpu.R(2) >> 26) & 0x1;
+    // the BIOS refuses to read itself
+    if (GBA::Memory::getRegion(source) == GBA::Memory::Region::BIOS)
+        return CallCycles;
+
+    uint32_t unit_cycles;
+    if (words) {
+        unit_cycles = memory.getAccessCycles<uint32_t>(destination, true) + 2;
+        if (fill)
+            memory.fill<uint32_t>(destination, memory.read32(source), count);
+        else
+            memory.copy<uint32_t>(destination, source, count);
+        unit_cycles += fill ? 0 : memory.getAccessCycles<uint32_t>(source, true);
+    }
+    else {
+        unit_cycles = memory.getAccessCycles<uint16_t>(destination, true) + 2;
+        if (fill)
+            memory.fill<uint16_t>(destination, memory.read16(source), count);
+        else
+            memory.copy<uint16_t>(destination, source, count);
+        unit_cycles += fill ? 0 : memory.getAccessCycles<uint16_t>(source, true);
+    }
+    return CallCycles + count * unit_cycles;
+}
+
+// Same as CpuSet in words only, the count is rounded up to a multiple of 8 words copied with LDM/STM
+uint32_t cpuFastSet(GBA::CPU& cpu) {
+    GBA::Memory& memory = cpu.getMemory();
+    uint32_t source = cpu.R(0);
+    uint32_t destination = cpu.R(1);
+    uint32_t count = ((cpu.R(2) & 0x1FFFFF) + 7) & ~0x7u;
+    bool fill = (cpu.R(2) >> 24) & 0x1;
+    if (GBA::Memory::getRegion(source) == GBA::Memory::Region::BIOS)
+        return CallCycles;
+
+    uint32_t word_cycles = memory.getAccessCycles<uint32_t>(destination, true);
+    if (fill) {
+        memory.fill<uint32_t>(destination, memory.read32(source), count);
+    }
+    else {
+        memory.copy<uint32_t>(destination, source, count);
+        word_cycles += memory.getAccessCycles<uint32_t>(source, true);
+    }
+    // a non-sequential access and an internal cycle for every LDM/STM pair
+    return CallCycles + count * word_cycles + count / 8 * 4;
+}
+
+// Rough per-byte costs of the BIOS decompression loops, without the destination writes
+const uint32_t LZ77ByteCycles = 12;
+const uint32_t HuffmanByteCycles = 40;
+const uint32_t RLByteCycles = 8;
+const uint32_t DiffByteCycles = 6;
+
+// Decompressed data goes to a host buffer first, only the finished output is written to the destination. The
+// buffer is a multiple of 4 bytes so the output can be written in any unit size.
+std::vector<uint8_t> makeOutput(uint32_t header) {
+    return std::vector<uint8_t>(((header >> 8) + 3) & ~0x3u);
+}
+
+// Blocks of 8 flagged (MSB first) entries, a clear flag is a literal byte and a set one copies 3-18 bytes from
+// 1-4096 bytes back
+std::vector<uint8_t> uncompressLZ77(const GBA::Memory& memory, uint32_t source) {
+    uint32_t size = memory.read32(source) >> 8;
+    std::vector<uint8_t> output = makeOutput(memory.read32(source));
+    source += 4;
+    uint32_t position = 0;
+    while (position < size) {
+        uint8_t flags = memory.read8(source++);
+        for (int i = 0; i < 8 && position < size; i++, flags <<= 1) {
+            if (!(flags & 0x80)) {
+                output[position++] = memory.read8(source++);
+                continue;
+            }
+            uint8_t first = memory.read8(source++);
+            uint8_t second = memory.read8(source++);
+            uint32_t length = (first >> 4) + 3;
+            uint32_t distance = ((first & 0xF) << 8 | second) + 1;
+            for (uint32_t j = 0; j < length && position < size; j++, position++)
+                output[position] = position >= distance ? output[position - distance] : 0;
+        }
+    }
+    return output;
+}
+
+// A tree has at most 512 nodes, a longer walk that never reaches a leaf has to be going in circles
+const uint32_t MaxHuffmanDepth = 512;
+
+// A tree of 8-bit nodes (child offset in bits 5-0, bits 7 and 6 set when the left or right child is a leaf)
+// followed by the bitstream in words read MSB first, the 4 or 8-bit leaf values are packed into words LSB first
+std::vector<uint8_t> uncompressHuffman(const GBA::Memory& memory, uint32_t source) {
+    uint32_t header = memory.read32(source);
+    uint32_t size = header >> 8;
+    uint32_t bits = header & 0xF;
+    std::vector<uint8_t> output = makeOutput(header);
+    if (bits != 4 && bits != 8)
+        return output;
+    uint32_t root = source + 5;
+    uint32_t stream = source + 4 + (memory.read8(source + 4) + 1) * 2;
+    uint32_t node = root;
+    // steps since the last leaf
+    uint32_t depth = 0;
+    uint32_t word = 0;
+    uint32_t shift = 0;
+    uint32_t position = 0;
+    while (position < size) {
+        uint32_t code = memory.read32(stream);
+        stream += 4;
+        for (int bit = 31; bit >= 0 && position < size; bit--) {
+            uint8_t value = memory.read8(node);
+            bool right = (code >> bit) & 0x1;
+            uint32_t child = (node & ~0x1u) + (value & 0x3F) * 2 + 2 + right;
+            if (!(value & (right ? 0x40 : 0x80))) {
+                if (++depth > MaxHuffmanDepth)
+                    return output;
+                node = child;
+                continue;
+            }
+            depth = 0;
+            word |= (memory.read8(child) & ((1 << bits) - 1)) << shift;
+            shift += bits;
+            node = root;
+            if (shift == 32) {
+                GBA::storeLittleEndian<uint32_t>(output.data() + position, word);
+                position += 4;
+                word = 0;
+                shift = 0;
+            }
+        }
+    }
+    return output;
+}
+
+// Runs of 3-130 copies of a byte (flag bit 7 set) and of 1-128 literal bytes
+std::vector<uint8_t> uncompressRL(const GBA::Memory& memory, uint32_t source) {
+    uint32_t size = memory.read32(source) >> 8;
+    std::vector<uint8_t> output = makeOutput(memory.read32(source));
+    source += 4;
+    uint32_t position = 0;
+    while (position < size) {
+        uint8_t flag = memory.read8(source++);
+        if (flag & 0x80) {
+            uint32_t length = std::min((flag & 0x7Fu) + 3, size - position);
+            std::fill_n(output.begin() + position, length, memory.read8(source++));
+            position += length;
+        }
+        else {
+            for (uint32_t length = flag + 1; length > 0 && position < size; length--)
+                output[position++] = memory.read8(source++);
+        }
+    }
+    return output;
+}
+
+// Each unit is the sum of all units so far
+template <class T>
+std::vector<uint8_t> unfilterDiff(const GBA::Memory& memory, uint32_t source) {
+    uint32_t size = memory.read32(source) >> 8;
+    std::vector<uint8_t> output = makeOutput(memory.read32(source));
+    source += 4;
+    T sum = 0;
+    for (uint32_t position = 0; position + sizeof(T) <= size; position += sizeof(T)) {
+        sum += sizeof(T) == 1 ? memory.read8(source + position) : memory.read16(source + position);
+        GBA::storeLittleEndian<T>(output.data() + position, sum);
+    }
+    return output;
+}
+
+// Decompresses the data at R0 and writes it to R1 in units of T
+template <class T>
+uint32_t uncompress(GBA::CPU& cpu, std::vector<uint8_t> (*decompress)(const GBA::Memory&, uint32_t),
+                    uint32_t byte_cycles) {
+    GBA::Memory& memory = cpu.getMemory();
+    uint32_t source = cpu.R(0);
+    uint32_t destination = cpu.R(1);
+    if (GBA::Memory::getRegion(source) == GBA::Memory::Region::BIOS)
+        return CallCycles;
+    uint32_t size = memory.read32(source) >> 8;
+    std::vector<uint8_t> output = decompress(memory, source);
+    uint32_t count = (size + sizeof(T) - 1) / sizeof(T);
+    memory.writeBuffer<T>(destination, output.data(), count);
+    return CallCycles + size * byte_cycles + count * memory.getAccessCycles<T>(destination, true);
+}
+
+}
+
+std::vector<uint8_t> GBA::BIOS::makeHLEImage() {
+    std::vector<uint8_t> image(Memory::BIOSSize);
+    const std::pair<uint32_t, uint32_t> code[] = {
+        {0x00, 0xE3A0F302},   // mov pc, #0x08000000
+        {0x08, 0xE1B0F00E},   // movs pc, lr
+        {0x18, 0xEA000042},   // b 0x128
+        {0x128, 0xE92D500F},  // stmfd sp!, {r0-r3, r12, lr}
+        {0x12C, 0xE3A00301},  // mov r0, #0x04000000
+        {0x130, 0xE28FE000},  // add lr, pc, #0
+        {0x134, 0xE510F004},  // ldr pc, [r0, #-4]
+        {0x138, 0xE8BD500F},  // ldmfd sp!, {r0-r3, r12, lr}
+        {0x13C, 0xE25EF004},  // subs pc, lr, #4
+    };
+    for (const auto& [address, instruction_code] : code)
+        storeLittleEndian<uint32_t>(image.data() + address, instruction_code);
+    return image;
+}
+
+bool GBA::BIOS::call(CPU& cpu, uint32_t function, uint32_t& cycles) {
+    int32_t r1;
+    int32_t r3;
+    switch (static_cast<Function>(function)) {
+    case Function::Halt:
+        cycles = halt(cpu, false);
+        return true;
+    case Function::Stop:
+        cycles = halt(cpu, true);
+        return true;
+    case Function::IntrWait:
+        cycles = intrWait(cpu, cpu.R(0) == 1, cpu.R(1), cpu.hle_intr_wait);
+        return true;
+    case Function::VBlankIntrWait:
+        cycles = intrWait(cpu, true, GBA::Memory::VBlankInterrupt, cpu.hle_intr_wait);
+        return true;
+    case Function::Div:
+        cycles = div(cpu, cpu.R(0), cpu.R(1));
+        return true;
+    case Function::DivArm:
+        cycles = div(cpu, cpu.R(1), cpu.R(0));
+        return true;
+    case Function::Sqrt:
+        cycles = sqrt(cpu, cpu.R(0));
+        return true;
+    case Function::ArcTan:
+        cpu.R(0) = arcTan(static_cast<int32_t>(cpu.R(0)), r1, r3);
+        cpu.R(1) = r1;
+        cpu.R(3) = r3;
+        cycles = CallCycles + 60;
+        return true;
+    case Function::ArcTan2:
+        cpu.R(0) = static_cast<uint32_t>(arcTan2(cpu.R(0), cpu.R(1), r1, r3)) & 0xFFFF;
+        cpu.R(1) = r1;
+        cpu.R(3) = r3;
+        cycles = CallCycles + 100;
+        return true;
+    case Function::CpuSet:
+        cycles = cpuSet(cpu);
+        return true;
+    case Function::CpuFastSet:
+        cycles = cpuFastSet(cpu);
+        return true;
+    case Function::LZ77UnCompWram:
+        cycles = uncompress<uint8_t>(cpu, uncompressLZ77, LZ77ByteCycles);
+        return true;
+    case Function::LZ77UnCompVram:
+        cycles = uncompress<uint16_t>(cpu, uncompressLZ77, LZ77ByteCycles);
+        return true;
+    case Function::HuffUnComp:
+        cycles = uncompress<uint32_t>(cpu, uncompressHuffman, HuffmanByteCycles);
+        return true;
+    case Function::RLUnCompWram:
+        cycles = uncompress<uint8_t>(cpu, uncompressRL, RLByteCycles);
+        return true;
+    case Function::RLUnCompVram:
+        cycles = uncompress<uint16_t>(cpu, uncompressRL, RLByteCycles);
+        return true;
+    case Function::Diff8bitUnFilterWram:
+        cycles = uncompress<uint8_t>(cpu, unfilterDiff<uint8_t>, DiffByteCycles);
+        return true;
+    case Function::Diff8bitUnFilterVram:
+        cycles = uncompress<uint16_t>(cpu, unfilterDiff<uint8_t>, DiffByteCycles);
+        return true;
+    case Function::Diff16bitUnFilter:
+        cycles = uncompress<uint16_t>(cpu, unfilterDiff<uint16_t>, DiffByteCycles);
+        return true;
+    default:
+        return false;
+    }
+}
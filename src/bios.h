@@ -0,0 +1,56 @@
+#ifndef GBA_BIOS_H
+#define GBA_BIOS_H
+
+#include "common.h"
+#include <cstdint>
+#include <vector>
+
+namespace GBA {
+
+class CPU;
+
+// High-level emulation of BIOS functions: instead of vectoring a SWI to the BIOS image the CPU can run the
+// function natively on its registers and memory, which leaves the CPU in the state the BIOS would return with.
+namespace BIOS {
+
+// SWI numbers, the comment field of a Thumb SWI and bits 23-16 of an ARM SWI
+enum class Function : uint32_t {
+    Halt = 0x02,
+    Stop = 0x03,
+    // Wait until one of the interrupts in R1 is flagged in the BIOS interrupt flags by the interrupt handler,
+    // discarding flags set before the call if R0 is 1. VBlankIntrWait waits for VBlank with R0 = R1 = 1.
+    IntrWait = 0x04,
+    VBlankIntrWait = 0x05,
+    Div = 0x06,
+    DivArm = 0x07,
+    Sqrt = 0x08,
+    ArcTan = 0x09,
+    ArcTan2 = 0x0A,
+    CpuSet = 0x0B,
+    CpuFastSet = 0x0C,
+    // Decompressors, R0 points to a header word (type in bits 7-4, decompressed size in bits 31-8) followed by the
+    // compressed data, R1 to the destination. The Wram variants write bytes, the Vram ones halfwords.
+    LZ77UnCompWram = 0x11,
+    LZ77UnCompVram = 0x12,
+    HuffUnComp = 0x13,
+    RLUnCompWram = 0x14,
+    RLUnCompVram = 0x15,
+    Diff8bitUnFilterWram = 0x16,
+    Diff8bitUnFilterVram = 0x17,
+    Diff16bitUnFilter = 0x18,
+};
+
+// Stand-in BIOS image for running without a BIOS dump, meant to be used together with HLE. Reset jumps to the
+// cartridge, SWIs that are not emulated return right away and IRQs go through the same handler as in the real
+// BIOS, which calls the game's handler at 0x03FFFFFC.
+std::vector<uint8_t> makeHLEImage();
+
+// Runs a BIOS function natively. Returns false for functions that are not emulated, which have to go through the
+// BIOS image, otherwise cycles is set to an estimate of what the BIOS takes for the call.
+bool call(CPU& cpu, uint32_t function, uint32_t& cycles);
+
+}
+
+}
+
+#endif
@@ -0,0 +1,59 @@
+#include "block_cache.h"
+#include <algorithm>
+
+GBA::BlockCache::BlockCache() : blocks{}, code_page_blocks(Memory::CodePageCount), hits{0}, misses{0} {
+}
+
+const GBA::BlockCache::Block* GBA::BlockCache::find(uint32_t address, bool thumb) {
+    auto it = blocks.find(getKey(address, thumb));
+    if (it == blocks.end()) {
+        misses++;
+        return nullptr;
+    }
+    hits++;
+    return &it->second;
+}
+
+const GBA::BlockCache::Block* GBA::BlockCache::insert(Block&& block) {
+    uint32_t key = getKey(block.address, block.thumb);
+    erase(key);
+    if (block.code_page != Memory::NoCodePage)
+        code_page_blocks[block.code_page].push_back(key);
+    return &blocks.emplace(key, std::move(block)).first->second;
+}
+
+void GBA::BlockCache::invalidateCodePage(uint32_t code_page) {
+    for (uint32_t key : code_page_blocks[code_page])
+        blocks.erase(key);
+    code_page_blocks[code_page].clear();
+}
+
+void GBA::BlockCache::clear() {
+    blocks.clear();
+    for (auto& keys : code_page_blocks)
+        keys.clear();
+}
+
+GBA::BlockCache::Stats GBA::BlockCache::getStats() const {
+    size_t memory_used = blocks.bucket_count() * sizeof(void*);
+    for (const auto& [key, block] : blocks) {
+        // a node holds the key, the block and the next pointer
+        memory_used += sizeof(std::pair<const uint32_t, Block>) + sizeof(void*);
+        memory_used += block.arm_ops.capacity() * sizeof(ArmOp) + block.thumb_ops.capacity() * sizeof(ThumbOp);
+    }
+    for (const auto& keys : code_page_blocks)
+        memory_used += sizeof(keys) + keys.capacity() * sizeof(uint32_t);
+    return Stats{hits, misses, blocks.size(), memory_used};
+}
+
+void GBA::BlockCache::erase(uint32_t key) {
+    auto it = blocks.find(key);
+    if (it == blocks.end())
+        return;
+    uint32_t code_page = it->second.code_page;
+    if (code_page != Memory::NoCodePage) {
+        auto& keys = code_page_blocks[code_page];
+        keys.erase(std::remove(keys.begin(), keys.end(), key), keys.end());
+    }
+    blocks.erase(it);
+}
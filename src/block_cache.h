@@ -0,0 +1,86 @@
+#ifndef GBA_BLOCK_CACHE_H
+#define GBA_BLOCK_CACHE_H
+
+#include "common.h"
+#include "memory.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace GBA {
+
+class CPU;
+
+// Basic blocks of instructions already fetched and looked up in the dispatch tables, keyed by the guest address
+// of their first instruction and the instruction set. Blocks in RAM are registered with the code pages they
+// cover and dropped when one of them is written.
+class BlockCache
+{
+  public:
+    using ArmHandler = void (CPU::*)(uint32_t instruction_code, uint32_t pc);
+    using ThumbHandler = void (CPU::*)(uint16_t instruction_code);
+
+    struct ArmOp
+    {
+        ArmHandler handler;
+        uint32_t instruction_code;
+    };
+    struct ThumbOp
+    {
+        ThumbHandler handler;
+        uint16_t instruction_code;
+    };
+    struct Block
+    {
+        uint32_t address;
+        bool thumb;
+        // Blocks never cross a code page boundary, NoCodePage for blocks in read-only memory
+        uint32_t code_page;
+        // Only the ops of the block's instruction set are used
+        std::vector<ArmOp> arm_ops;
+        std::vector<ThumbOp> thumb_ops;
+        // The block branches back to its start and only polls memory, see CPU::skipIdleLoop
+        bool idle;
+    };
+
+    struct Stats
+    {
+        uint64_t hits;
+        uint64_t misses;
+        size_t block_count;
+        // Approximate host memory held by the blocks and the code page lists
+        size_t memory_used;
+
+        double getHitRate() const { return hits + misses == 0 ? 0.0 : static_cast<double>(hits) / (hits + misses); }
+    };
+
+    // Blocks end at the first instruction that usually branches, at the end of a code page or after this many
+    // instructions
+    static const uint32_t MaxBlockLength = 64;
+
+    BlockCache();
+
+    // Block starting at address, null on a miss
+    const Block* find(uint32_t address, bool thumb);
+    // Adds a block built after a miss, replacing any block at the same address
+    const Block* insert(Block&& block);
+    // Drops every block covering the code page
+    void invalidateCodePage(uint32_t code_page);
+    void clear();
+
+    Stats getStats() const;
+
+  private:
+    static uint32_t getKey(uint32_t address, bool thumb) { return address | thumb; }
+    void erase(uint32_t key);
+
+    std::unordered_map<uint32_t, Block> blocks;
+    // Keys of the blocks in every code page
+    std::vector<std::vector<uint32_t>> code_page_blocks;
+    uint64_t hits;
+    uint64_t misses;
+};
+
+}
+
+#endif
@@ -1,97 +1,499 @@
 #include "cpu.h"
 #include "instruction_types_arguments.h"
 #include "opcode.h"
-#include <iomanip>
+#include "shifter.h"
+#include "trace.h"
+#include <algorithm>
+
+// Labels as values are a GCC and Clang extension, other compilers use the dispatch loop
+#if !defined(GBA_THREADED_DISPATCH) || !defined(__GNUC__)
+#undef GBA_THREADED_DISPATCH
+#define GBA_THREADED_DISPATCH 0
+#endif
 
 // todo: 0xff4f0fe3 is failing
 
-GBA::CPU::CPU() : registers{}, CPSR{}, SPSR_FIQ{}, SPSR_SVC{}, SPSR_ABT{}, SPSR_IRQ{}, SPSR_UND{} {
-    data_processing_instruction_type[static_cast<int>(GBA::Opcode::AND)] = &GBA::CPU::andArm;
-    data_processing_instruction_type[static_cast<int>(GBA::Opcode::XOR)] = &GBA::CPU::xorArm;
-    data_processing_instruction_type[static_cast<int>(GBA::Opcode::SUB)] = &GBA::CPU::subArm;
-    data_processing_instruction_type[static_cast<int>(GBA::Opcode::RSB)] = &GBA::CPU::rsbArm;
-    data_processing_instruction_type[static_cast<int>(GBA::Opcode::ADD)] = &GBA::CPU::addArm;
-    data_processing_instruction_type[static_cast<int>(GBA::Opcode::ADC)] = &GBA::CPU::adcArm;
-    data_processing_instruction_type[static_cast<int>(GBA::Opcode::SBC)] = &GBA::CPU::sbcArm;
-    data_processing_instruction_type[static_cast<int>(GBA::Opcode::RSC)] = &GBA::CPU::rscArm;
-    data_processing_instruction_type[static_cast<int>(GBA::Opcode::TST)] = &GBA::CPU::tstArm;
-    data_processing_instruction_type[static_cast<int>(GBA::Opcode::TEQ)] = &GBA::CPU::teqArm;
-    data_processing_instruction_type[static_cast<int>(GBA::Opcode::CMP)] = &GBA::CPU::cmpArm;
-    data_processing_instruction_type[static_cast<int>(GBA::Opcode::CMN)] = &GBA::CPU::cmnArm;
-    data_processing_instruction_type[static_cast<int>(GBA::Opcode::ORR)] = &GBA::CPU::orrArm;
-    data_processing_instruction_type[static_cast<int>(GBA::Opcode::MOV)] = &GBA::CPU::movArm;
-    data_processing_instruction_type[static_cast<int>(GBA::Opcode::BIC)] = &GBA::CPU::bicArm;
-    data_processing_instruction_type[static_cast<int>(GBA::Opcode::MVN)] = &GBA::CPU::mvnArm;
+GBA::CPU::CPU()
+    : active_registers{}, bank_mode{Mode::User}, registers{}, CPSR{}, SPSR_FIQ{}, SPSR_SVC{}, SPSR_ABT{},
+      SPSR_IRQ{}, SPSR_UND{}, flags_operation{FlagsOperation::None}, flags_result{}, flags_operand1{},
+      flags_operand2{}, flags_carry{}, spsr{}, cycles{}, total_cycles{},
+      fetch_sequential{}, data_burst{}, next_data_address{}, backend{Backend::Interpreter},
+      block_cache{}, jit{}, idle_skipped_cycles{}, sleeping_cycles{}, hle_bios{}, hle_intr_wait{} {
 }
 
 void GBA::CPU::loadBIOS(const std::vector<uint8_t>& bios) {
     this->memory.loadBIOS(bios);
+    clearBlocks();
+}
+
+void GBA::CPU::loadROM(const std::vector<uint8_t>& rom) {
+    this->memory.loadROM(rom);
+    clearBlocks();
+}
+
+void GBA::CPU::loadROM(std::shared_ptr<const ROMImage> image) {
+    this->memory.loadROM(std::move(image));
+    clearBlocks();
 }
 
 std::pair<std::vector<uint8_t>::const_iterator, std::vector<uint8_t>::const_iterator> GBA::CPU::getDisplay() const {
     return memory.getDisplayBuffer();
 }
 
-void GBA::CPU::step() {
+uint32_t GBA::CPU::step() {
+    if (memory.isIRQPending())
+        takeInterrupt();
+    uint32_t pc = PC();
     if (inArm()) {
-        uint32_t pc = PC();
-        uint32_t instruction_code = memory.memory[pc];
-        instruction_code |= memory.memory[pc + 1] << 8;
-        instruction_code |= memory.memory[pc + 2] << 16;
-        instruction_code |= memory.memory[pc + 3] << 24;
-        PC() += 4;
-        switch (decodeArm(instruction_code)) {
-        case InstructionType::DataProcessing:
-        case InstructionType::ProgramStatusRegisterTransferOut:
-        case InstructionType::ProgramStatusRegisterTransferIn:
-            callDataProcessingInstruction(instruction_code, pc);
-            break;
-        case InstructionType::Multiply:
-            callMultiplyInstruction(instruction_code, pc);
-            break;
-        case InstructionType::MultiplyLong:
-            callMultiplyLongInstruction(instruction_code, pc);
-            break;
-        case InstructionType::SingleDataSwap:
-            callSingleDataSwapInstruction(instruction_code, pc);
-            break;
-        case InstructionType::BranchAndExchange:
-            callBranchAndExchangeInstruction(instruction_code, pc);
-            break;
-        case InstructionType::HalfwordDataTransferRegister:
-        case InstructionType::HalfwordDataTransferImmediate:
-            callHalfWordAndSignedDataTransferInstruction(instruction_code, pc);
-            break;
-        case InstructionType::SingleDataTransfer:
-            callSingleDataTransferInstruction(instruction_code, pc);
-            break;
-        case InstructionType::BlockDataTransfer:
-            callBlockDataTransferInstruction(instruction_code, pc);
-            break;
-        case InstructionType::Branch:
-            callBranchInstruction(instruction_code, pc);
-            break;
-        case InstructionType::CoprocessorDataTransfer:
-            // call(instruction_code);
-            throw;
-            break;
-        case InstructionType::CoprocessorDataOperation:
-            // call(instruction_code);
-            throw;
-            break;
-        case InstructionType::CoprocessorRegisterTransfer:
-            // call(instruction_code);
-            throw;
-            break;
-        case InstructionType::SoftwareInterrupt:
-            callSoftwareInterruptInstruction(instruction_code, pc);
+        uint32_t instruction_code = memory.read32(pc);
+        executeArm(lookupArm(instruction_code), instruction_code, pc);
+        return finishInstruction(pc + 4);
+    }
+    uint16_t instruction_code = memory.read16(pc);
+    executeThumb(lookupThumb(instruction_code), instruction_code, pc);
+    return finishInstruction(pc + 2);
+}
+
+uint64_t GBA::CPU::runFor(uint64_t cycle_budget) {
+    uint64_t start = total_cycles;
+    uint64_t end = start + cycle_budget;
+    if (backend == Backend::Interpreter) {
+        while (total_cycles < end) {
+            if (memory.isSleeping() && sleep(end))
+                break;
+            step();
+        }
+        return total_cycles - start;
+    }
+    while (total_cycles < end) {
+        if (memory.isSleeping() && sleep(end))
             break;
-        case InstructionType::Undefined:
-            // call(instruction_code);
-        default:
-            throw;
+        if (memory.isIRQPending())
+            takeInterrupt();
+        invalidateWrittenCode();
+        uint32_t pc = PC();
+        if (!Memory::isCodeCacheable(pc)) {
+            step();
+            continue;
+        }
+        bool thumb = inThumb();
+        if (backend == Backend::Recompiler) {
+            const uint8_t* code = jit->find(pc, thumb);
+            if (code == nullptr) {
+                const BlockCache::Block* block = block_cache.find(pc, thumb);
+                if (block == nullptr)
+                    block = buildBlock(pc, thumb);
+                code = jit->compile(*block);
+                // the code buffer is full, start over with an empty one
+                if (code == nullptr) {
+                    jit->clear();
+                    code = jit->compile(*block);
+                }
+            }
+            jit->run(code, end);
+            // idle loops are compiled without the link to themselves, so they come back here after an iteration
+            if (jit->isIdleLoop(pc, thumb))
+                skipIdleLoop(pc, thumb, end);
+            continue;
+        }
+        if constexpr (GBA_THREADED_DISPATCH) {
+            runBlocksThreaded(end);
+            continue;
+        }
+        const BlockCache::Block* block = block_cache.find(pc, thumb);
+        if (block == nullptr)
+            block = buildBlock(pc, thumb);
+        if (block->thumb)
+            runThumbBlock(*block, end);
+        else
+            runArmBlock(*block, end);
+        skipIdleLoop(*block, end);
+    }
+    return total_cycles - start;
+}
+
+bool GBA::CPU::setBackend(Backend backend) {
+    if (backend == Backend::Recompiler && !jit) {
+        jit = JIT::create(*this);
+        if (!jit)
+            return false;
+    }
+    this->backend = backend;
+    clearBlocks();
+    return true;
+}
+
+void GBA::CPU::skipIdleLoop(const BlockCache::Block& block, uint64_t end) {
+    if (block.idle)
+        skipIdleLoop(block.address, block.thumb, end);
+}
+
+void GBA::CPU::skipIdleLoop(uint32_t address, bool thumb, uint64_t end) {
+    // the loop just ran one full iteration, the rest would repeat it until the next event
+    if (PC() == address && inThumb() == thumb && total_cycles < end) {
+        idle_skipped_cycles += end - total_cycles;
+        total_cycles = end;
+    }
+}
+
+bool GBA::CPU::sleep(uint64_t end) {
+    if (!memory.isSleeping())
+        return false;
+    uint16_t pending = memory.getPendingInterrupts();
+    if (memory.getPowerState() == Memory::PowerState::Stopped)
+        pending &= Memory::KeypadInterrupt | Memory::SerialInterrupt | Memory::GamePakInterrupt;
+    if (pending != 0) {
+        memory.wakeUp();
+        return false;
+    }
+    if (total_cycles < end) {
+        sleeping_cycles += end - total_cycles;
+        total_cycles = end;
+    }
+    return true;
+}
+
+void GBA::CPU::invalidateWrittenCode() {
+    if (!memory.hasCodeWrites())
+        return;
+    for (uint32_t code_page : memory.getCodeWrites())
+        block_cache.invalidateCodePage(code_page);
+    memory.clearCodeWrites();
+    // compiled blocks point at the ops of the cached blocks and at each other, drop all of them
+    if (jit)
+        jit->clear();
+}
+
+void GBA::CPU::clearBlocks() {
+    block_cache.clear();
+    if (jit)
+        jit->clear();
+}
+
+void GBA::CPU::executeArm(ArmInstructionHandler handler, uint32_t instruction_code, uint32_t pc) {
+    beginArm(instruction_code, pc);
+    // the condition is checked here once for all handlers, AL skips evaluating the flags
+    if ((instruction_code >> 28) == 0xE || checkCondition(instruction_code))
+        (this->*handler)(instruction_code, pc);
+}
+
+void GBA::CPU::beginArm(uint32_t instruction_code, uint32_t pc) {
+    // the fetch of the next instruction, every instruction takes at least this one access
+    cycles = memory.getFetchCycles<uint32_t>(pc, fetch_sequential);
+    fetch_sequential = true;
+    data_burst = false;
+    PC() = pc + 4;
+    Trace::instruction(pc, instruction_code, getCPSR());
+}
+
+void GBA::CPU::executeThumb(ThumbInstructionHandler handler, uint16_t instruction_code, uint32_t pc) {
+    cycles = memory.getFetchCycles<uint16_t>(pc, fetch_sequential);
+    fetch_sequential = true;
+    data_burst = false;
+    // handlers see PC as the address of the next instruction, those that read R15 as an operand add the other 2 bytes
+    // of the prefetch themselves
+    PC() = pc + 2;
+    Trace::instruction(pc, instruction_code, getCPSR());
+    (this->*handler)(instruction_code);
+}
+
+uint32_t GBA::CPU::finishInstruction(uint32_t next_pc) {
+    // any write to PC (branches, exceptions, loads and ALU results) flushes the pipeline, refilling it costs a
+    // non-sequential and a sequential fetch at the target
+    if (PC() != next_pc) {
+        if (inArm())
+            cycles += memory.getFetchCycles<uint32_t>(PC(), false) + memory.getFetchCycles<uint32_t>(PC() + 4, true);
+        else
+            cycles += memory.getFetchCycles<uint16_t>(PC(), false) + memory.getFetchCycles<uint16_t>(PC() + 2, true);
+        fetch_sequential = true;
+    }
+    total_cycles += cycles;
+    return cycles;
+}
+
+namespace {
+
+// Instructions that usually write PC or change the instruction set, a block ends after them
+bool endsArmBlock(uint32_t instruction_code) {
+    bool branch = (instruction_code & 0x0E000000) == 0x0A000000;
+    bool branch_exchange = (instruction_code & 0x0FFFFFF0) == 0x012FFF10;
+    bool software_interrupt = (instruction_code & 0x0F000000) == 0x0F000000;
+    bool load_multiple_pc = (instruction_code & 0x0E108000) == 0x08108000;
+    // Rd = 15 in data processing and single data transfers, also matches MSR which could switch to Thumb
+    bool writes_r15 = ((instruction_code >> 12) & 0xF) == 0xF;
+    return branch || branch_exchange || software_interrupt || load_multiple_pc || writes_r15;
+}
+
+bool endsThumbBlock(uint16_t instruction_code) {
+    bool conditional_branch = (instruction_code & 0xF000) == 0xD000;
+    bool branch = (instruction_code & 0xF800) == 0xE000;
+    bool long_branch_low = (instruction_code & 0xF800) == 0xF800;
+    bool pop_pc = (instruction_code & 0xFF00) == 0xBD00;
+    // hi register operations with Rd = 15 and BX
+    bool hi_register_pc = (instruction_code & 0xFC00) == 0x4400 &&
+                          ((((instruction_code >> 4) & 0x8) | (instruction_code & 0x7)) == 0xF ||
+                           (instruction_code & 0x0300) == 0x0300);
+    return conditional_branch || branch || long_branch_low || pop_pc || hi_register_pc;
+}
+
+// Registers R0-R14 an instruction reads and writes
+struct RegisterUse
+{
+    uint16_t reads;
+    uint16_t writes;
+};
+
+uint16_t registerBit(uint32_t index) {
+    return index == 15 ? 0 : 1 << index;
+}
+
+// Instructions allowed in the body of an idle loop, the ones that only load and compare: unconditional loads with
+// an immediate offset and no writeback, and unconditional data processing that neither involves R15 nor reads the
+// carry. Returns false for anything else.
+bool getIdleArmUse(uint32_t instruction_code, RegisterUse& use) {
+    if ((instruction_code >> 28) != 0xE)
+        return false;
+    uint32_t rn = (instruction_code >> 16) & 0xF;
+    uint32_t rd = (instruction_code >> 12) & 0xF;
+    uint32_t rm = instruction_code & 0xF;
+    // R15 as the base is a literal load, which reads the same word on every iteration
+    bool word_load = (instruction_code & 0x0F300000) == 0x05100000;
+    bool halfword_load = (instruction_code & 0x0F700090) == 0x01500090 && (instruction_code & 0x60) != 0;
+    if (word_load || halfword_load) {
+        use = RegisterUse{registerBit(rn), registerBit(rd)};
+        return rd != 15;
+    }
+
+    bool data_processing = (instruction_code & 0x0C000000) == 0 && (instruction_code & 0x02000090) != 0x90;
+    bool immediate = (instruction_code >> 25) & 0x1;
+    uint32_t opcode = (instruction_code >> 21) & 0xF;
+    bool set_flags = (instruction_code >> 20) & 0x1;
+    bool compare = opcode >= 0x8 && opcode <= 0xB;
+    bool uses_rn = opcode != 0xD && opcode != 0xF;
+    // shifts by an immediate only, RRX (ROR #0) reads the carry
+    bool shift_ok = immediate || ((instruction_code & 0x10) == 0 && (instruction_code & 0xFE0) != 0x060);
+    if (!data_processing || !shift_ok || (opcode >= 0x5 && opcode <= 0x7) || (compare && !set_flags))
+        return false;
+    if (rd == 15 || (uses_rn && rn == 15) || (!immediate && rm == 15))
+        return false;
+    use.reads = (uses_rn ? registerBit(rn) : 0) | (immediate ? 0 : registerBit(rm));
+    use.writes = compare ? 0 : registerBit(rd);
+    return true;
+}
+
+bool getIdleThumbUse(uint16_t instruction_code, RegisterUse& use) {
+    uint32_t low = instruction_code & 0x7;
+    uint32_t middle = (instruction_code >> 3) & 0x7;
+    uint32_t high = (instruction_code >> 8) & 0x7;
+    switch (instruction_code & 0xF800) {
+    // LSL and LSR by an immediate
+    case 0x0000:
+    case 0x0800:
+    // LDR, LDRB and LDRH with an immediate offset
+    case 0x6800:
+    case 0x7800:
+    case 0x8800:
+        use = RegisterUse{registerBit(middle), registerBit(low)};
+        return true;
+    // MOV and CMP with an immediate
+    case 0x2000:
+        use = RegisterUse{0, registerBit(high)};
+        return true;
+    case 0x2800:
+        use = RegisterUse{registerBit(high), 0};
+        return true;
+    // PC-relative LDR
+    case 0x4800:
+        use = RegisterUse{0, registerBit(high)};
+        return true;
+    default:
+        break;
+    }
+    // AND, TST and CMP of two registers
+    switch (instruction_code & 0xFFC0) {
+    case 0x4000:
+        use = RegisterUse{static_cast<uint16_t>(registerBit(low) | registerBit(middle)), registerBit(low)};
+        return true;
+    case 0x4200:
+    case 0x4280:
+        use = RegisterUse{static_cast<uint16_t>(registerBit(low) | registerBit(middle)), 0};
+        return true;
+    default:
+        return false;
+    }
+}
+
+// A block is an idle loop if it branches back to its start and every iteration computes the same registers and
+// flags from memory: no register is carried from one iteration to the next. Until some event changes the memory
+// it polls, every further iteration repeats the last one.
+bool isIdleLoop(const GBA::BlockCache::Block& block) {
+    size_t count = block.thumb ? block.thumb_ops.size() : block.arm_ops.size();
+    if (count < 2)
+        return false;
+
+    uint32_t last_pc = block.address + (count - 1) * (block.thumb ? 2 : 4);
+    uint32_t target;
+    if (block.thumb) {
+        uint16_t branch = block.thumb_ops.back().instruction_code;
+        if ((branch & 0xF000) == 0xD000 && (branch & 0x0E00) != 0x0E00)
+            target = last_pc + 4 + (static_cast<int32_t>(static_cast<int8_t>(branch & 0xFF)) << 1);
+        else if ((branch & 0xF800) == 0xE000)
+            target = last_pc + 4 + (static_cast<int32_t>(static_cast<uint32_t>(branch) << 21) >> 20);
+        else
+            return false;
+    }
+    else {
+        uint32_t branch = block.arm_ops.back().instruction_code;
+        if ((branch & 0x0F000000) != 0x0A000000 || (branch >> 28) == 0xF)
+            return false;
+        target = last_pc + 8 + (static_cast<int32_t>(branch << 8) >> 6);
+    }
+    if (target != block.address)
+        return false;
+
+    std::vector<RegisterUse> uses(count - 1);
+    uint16_t written = 0;
+    for (size_t i = 0; i + 1 < count; i++) {
+        bool allowed = block.thumb ? getIdleThumbUse(block.thumb_ops[i].instruction_code, uses[i])
+                                   : getIdleArmUse(block.arm_ops[i].instruction_code, uses[i]);
+        if (!allowed)
+            return false;
+        written |= uses[i].writes;
+    }
+    // every register written in the loop has to be written before it is read
+    uint16_t defined = 0;
+    for (const RegisterUse& use : uses) {
+        if (use.reads & written & ~defined)
+            return false;
+        defined |= use.writes;
+    }
+    return true;
+}
+
+}
+
+#if GBA_THREADED_DISPATCH
+
+// Threaded dispatch: every kind of op ends with its own indirect jump to the next op, which gives the branch
+// predictor a history per kind instead of one shared dispatch branch, and a block that ends looks up the next one
+// without returning to runFor. Leaves the blocks under the same conditions as runArmBlock and runThumbBlock.
+void GBA::CPU::runBlocksThreaded(uint64_t end) {
+    // ARM ops with a condition to check and unconditional ones, indexed by whether the op is unconditional
+    static void* const arm_labels[] = {&&arm_conditional, &&arm_always};
+    const BlockCache::Block* block = nullptr;
+    const BlockCache::ArmOp* arm_op = nullptr;
+    const BlockCache::ArmOp* arm_end = nullptr;
+    const BlockCache::ThumbOp* thumb_op = nullptr;
+    const BlockCache::ThumbOp* thumb_end = nullptr;
+    uint32_t pc;
+
+#define DISPATCH_ARM()                                                                                       \
+    finishInstruction(pc + 4);                                                                               \
+    pc += 4;                                                                                                 \
+    if (PC() != pc || inThumb() || memory.hasCodeWrites() || memory.isSleeping() || total_cycles >= end ||   \
+        ++arm_op == arm_end)                                                                                 \
+        goto next_block;                                                                                     \
+    goto* arm_labels[(arm_op->instruction_code >> 28) == 0xE]
+
+next_block:
+    if (block != nullptr)
+        skipIdleLoop(*block, end);
+    if (memory.isIRQPending())
+        takeInterrupt();
+    invalidateWrittenCode();
+    pc = PC();
+    if (total_cycles >= end || !Memory::isCodeCacheable(pc) || memory.isSleeping())
+        return;
+    block = block_cache.find(pc, inThumb());
+    if (block == nullptr)
+        block = buildBlock(pc, inThumb());
+    if (block->thumb) {
+        thumb_op = block->thumb_ops.data();
+        thumb_end = thumb_op + block->thumb_ops.size();
+        goto thumb;
+    }
+    arm_op = block->arm_ops.data();
+    arm_end = arm_op + block->arm_ops.size();
+    goto* arm_labels[(arm_op->instruction_code >> 28) == 0xE];
+
+arm_always:
+    beginArm(arm_op->instruction_code, pc);
+    (this->*arm_op->handler)(arm_op->instruction_code, pc);
+    DISPATCH_ARM();
+
+arm_conditional:
+    beginArm(arm_op->instruction_code, pc);
+    if (checkCondition(arm_op->instruction_code))
+        (this->*arm_op->handler)(arm_op->instruction_code, pc);
+    DISPATCH_ARM();
+
+thumb:
+    executeThumb(thumb_op->handler, thumb_op->instruction_code, pc);
+    finishInstruction(pc + 2);
+    pc += 2;
+    if (PC() != pc || inArm() || memory.hasCodeWrites() || memory.isSleeping() || total_cycles >= end ||
+        ++thumb_op == thumb_end)
+        goto next_block;
+    goto thumb;
+
+#undef DISPATCH_ARM
+}
+
+#else
+
+void GBA::CPU::runBlocksThreaded(uint64_t) {
+}
+
+#endif
+
+const GBA::BlockCache::Block* GBA::CPU::buildBlock(uint32_t address, bool thumb) {
+    BlockCache::Block block{address, thumb, Memory::getCodePage(address), {}, {}, false};
+    uint32_t instruction_size = thumb ? 2 : 4;
+    uint32_t page_end = (address | ((1 << Memory::CodePageShift) - 1)) + 1;
+    for (uint32_t pc = address; pc < page_end && pc - address < BlockCache::MaxBlockLength * instruction_size;
+         pc += instruction_size) {
+        if (thumb) {
+            uint16_t instruction_code = memory.read16(pc);
+            block.thumb_ops.push_back(BlockCache::ThumbOp{lookupThumb(instruction_code), instruction_code});
+            if (endsThumbBlock(instruction_code))
+                break;
+        }
+        else {
+            uint32_t instruction_code = memory.read32(pc);
+            block.arm_ops.push_back(BlockCache::ArmOp{lookupArm(instruction_code), instruction_code});
+            if (endsArmBlock(instruction_code))
+                break;
         }
     }
+    block.idle = isIdleLoop(block);
+    memory.markCode(address);
+    return block_cache.insert(std::move(block));
+}
+
+// The ops run as long as execution stays on the straight-line path the block was built from: a taken branch, a
+// switch of the instruction set, a write to cached code, a write to HALTCNT or the end of the budget leave the block
+// early.
+
+void GBA::CPU::runArmBlock(const BlockCache::Block& block, uint64_t end) {
+    uint32_t pc = block.address;
+    for (const BlockCache::ArmOp& op : block.arm_ops) {
+        executeArm(op.handler, op.instruction_code, pc);
+        finishInstruction(pc + 4);
+        pc += 4;
+        if (PC() != pc || inThumb() || memory.hasCodeWrites() || memory.isSleeping() || total_cycles >= end)
+            return;
+    }
+}
+
+void GBA::CPU::runThumbBlock(const BlockCache::Block& block, uint64_t end) {
+    uint32_t pc = block.address;
+    for (const BlockCache::ThumbOp& op : block.thumb_ops) {
+        executeThumb(op.handler, op.instruction_code, pc);
+        finishInstruction(pc + 2);
+        pc += 2;
+        if (PC() != pc || inArm() || memory.hasCodeWrites() || memory.isSleeping() || total_cycles >= end)
+            return;
+    }
 }
 
 // 16-bit Thumb instructions types
@@ -242,7 +644,7 @@ constexpr bool isCoprocessorRegisterTransfer(uint32_t instruction_code) {
     return (instruction_code & 0x0F000010) == 0x0E000010;
 }
 
-GBA::InstructionType GBA::CPU::decodeArm(uint32_t instruction_code) const {
+constexpr GBA::InstructionType decodeArmInstructionType(uint32_t instruction_code) {
     if (isBranchAndExchange(instruction_code))
         return GBA::InstructionType::BranchAndExchange;
     if (isBlockDataTransfer(instruction_code))
@@ -281,16 +683,129 @@ GBA::InstructionType GBA::CPU::decodeArm(uint32_t instruction_code) const {
         return GBA::InstructionType::Undefined;
 }
 
+GBA::InstructionType GBA::CPU::decodeArm(uint32_t instruction_code) const {
+    return decodeArmInstructionType(instruction_code);
+}
+
+namespace {
+
+// Key of a data processing specialization: bit 8 I, bits 7-4 opcode, bit 3 S, bits 2-1 shift type, bit 0 register
+// shift. Immediate operands are not shifted so those variants collapse onto one specialization.
+template <uint32_t key>
+constexpr GBA::CPU::ArmInstructionHandler dataProcessingHandler() {
+    constexpr bool I = (key >> 8) & 0x1;
+    constexpr auto opcode = static_cast<GBA::Opcode>((key >> 4) & 0xF);
+    constexpr bool S = (key >> 3) & 0x1;
+    constexpr auto shift_type = I ? GBA::ShiftType::LogicalLeft : static_cast<GBA::ShiftType>((key >> 1) & 0x3);
+    constexpr bool register_shift = I ? false : key & 0x1;
+    return &GBA::CPU::dataProcessingArm<opcode, S, I, shift_type, register_shift>;
+}
+
+template <size_t... keys>
+constexpr std::array<GBA::CPU::ArmInstructionHandler, 512> makeDataProcessingHandlers(std::index_sequence<keys...>) {
+    return {{dataProcessingHandler<keys>()...}};
+}
+
+constexpr std::array<GBA::CPU::ArmInstructionHandler, 512> data_processing_handlers =
+    makeDataProcessingHandlers(std::make_index_sequence<512>{});
+
+constexpr GBA::CPU::ArmInstructionHandler
+    armInstructionHandler(GBA::InstructionType instruction_type, uint32_t instruction_code) {
+    using GBA::CPU;
+    using GBA::InstructionType;
+    switch (instruction_type) {
+    case InstructionType::DataProcessing: {
+        uint32_t index = CPU::getArmTableIndex(instruction_code);
+        uint32_t key = (((index >> 9) & 0x1) << 8) | (((index >> 5) & 0xF) << 4) | (((index >> 4) & 0x1) << 3) |
+                       (index & 0x7);
+        return data_processing_handlers[key];
+    }
+    case InstructionType::ProgramStatusRegisterTransferOut:
+        return &CPU::callMRSInstruction;
+    case InstructionType::ProgramStatusRegisterTransferIn:
+        return &CPU::callMSRInstruction;
+    case InstructionType::Multiply:
+        return &CPU::callMultiplyInstruction;
+    case InstructionType::MultiplyLong:
+        return &CPU::callMultiplyLongInstruction;
+    case InstructionType::SingleDataSwap:
+        return &CPU::callSingleDataSwapInstruction;
+    case InstructionType::BranchAndExchange:
+        return &CPU::callBranchAndExchangeInstruction;
+    case InstructionType::HalfwordDataTransferRegister:
+    case InstructionType::HalfwordDataTransferImmediate:
+        return &CPU::callHalfWordAndSignedDataTransferInstruction;
+    case InstructionType::SingleDataTransfer:
+        return &CPU::callSingleDataTransferInstruction;
+    case InstructionType::BlockDataTransfer:
+        return &CPU::callBlockDataTransferInstruction;
+    case InstructionType::Branch:
+        return &CPU::callBranchInstruction;
+    case InstructionType::SoftwareInterrupt:
+        return &CPU::callSoftwareInterruptInstruction;
+    case InstructionType::CoprocessorDataTransfer:
+    case InstructionType::CoprocessorDataOperation:
+    case InstructionType::CoprocessorRegisterTransfer:
+    case InstructionType::Undefined:
+    default:
+        return &CPU::callUndefinedInstruction;
+    }
+}
+
+constexpr std::array<GBA::CPU::ArmInstructionHandler, 4096> makeArmInstructionTable() {
+    std::array<GBA::CPU::ArmInstructionHandler, 4096> table{};
+    for (uint32_t index = 0; index < table.size(); index++) {
+        uint32_t instruction_code = GBA::CPU::getArmTableEncoding(index);
+        table[index] = armInstructionHandler(decodeArmInstructionType(instruction_code), instruction_code);
+    }
+    return table;
+}
+
+// constexpr so the table is built by the compiler and not by a static initializer
+constexpr std::array<GBA::CPU::ArmInstructionHandler, 4096> generated_arm_instruction_table = makeArmInstructionTable();
+
+}
+
+GBA::CPU::ArmInstructionHandler
+    GBA::CPU::getArmInstructionHandler(InstructionType instruction_type, uint32_t instruction_code) {
+    return armInstructionHandler(instruction_type, instruction_code);
+}
+
+const std::array<GBA::CPU::ArmInstructionHandler, 4096> GBA::CPU::arm_instruction_table = generated_arm_instruction_table;
+
 void GBA::CPU::reset() {
     // TODO: see declaration in header file
     R_SVC(14) = PC();  // Overwrites R14_svc and SPSR_svc by copying the current values of the PC and CPSR into them
-    SPSR_SVC = CPSR;
-    CPSR = 0xD3;  // sets 4:0 bits to 0b10011 and I and F bits to 1 (IRQ and FIQ disabled) T bit to 0 (ARM mode)
-    PC() = 0;     // sets the PC to 0
+    SPSR_SVC = getCPSR();
+    writeCPSR(0xD3);  // sets 4:0 bits to 0b10011 and I and F bits to 1 (IRQ and FIQ disabled) T bit to 0 (ARM mode)
+    PC() = 0;         // sets the PC to 0
+    hle_intr_wait = false;
     // TODO
     // Reverts to ARM state if necessary and resumes execution.
 }
 
+void GBA::CPU::directBoot() {
+    // https://problemkaputt.de/gbatek.htm#biosramusage
+    reset();
+    for (uint32_t i = 0; i < 13; i++)
+        R(i) = 0;
+    R_SVC(13) = 0x03007FE0;
+    R_SVC(14) = 0;
+    SPSR_SVC = 0;
+    R_IRQ(13) = 0x03007FA0;
+    R_IRQ(14) = 0;
+    SPSR_IRQ = 0;
+    R_USRSYS(13) = 0x03007F00;
+    R_USRSYS(14) = 0;
+    // System mode with interrupts enabled in the CPSR, ARM state
+    writeCPSR(0x1F);
+    memory.write16(Memory::DISPCNTAddress, 0x0080);
+    memory.write16(Memory::SOUNDBIASAddress, 0x0200);
+    memory.write16(Memory::RCNTAddress, 0x8000);
+    memory.write8(Memory::POSTFLGAddress, 0x01);
+    PC() = 0x08000000;
+}
+
 GBA::CPU::Mode GBA::CPU::getMode() const {
     uint32_t mode = CPSR & 0x1F;
     switch (mode) {
@@ -309,8 +824,8 @@ GBA::CPU::Mode GBA::CPU::getMode() const {
     case 0b11111:
         return GBA::CPU::Mode::System;
     default:
-        // TODO: invalid mode error handling
-        throw;
+        // the reserved mode values keep the registers of the last valid mode
+        return bank_mode;
     }
 }
 
@@ -341,306 +856,168 @@ void GBA::CPU::setMode(GBA::CPU::Mode mode) {
     default:
         throw;
     }
-}
-
-GBA::DataProcessingArguments
-    GBA::CPU::decodeDataProcessingArguments(uint32_t instruction_code, Opcode opcode, uint32_t pc) {
-    GBA::DataProcessingArguments arguments;
-    if (opcode == GBA::Opcode::TEQ || opcode == GBA::Opcode::CMP || opcode == GBA::Opcode::CMN ||
-        opcode == GBA::Opcode::TST) {
-        arguments.S = 1;
-    }
-    else {
-        arguments.S = (instruction_code >> 20) & 0x1;
-    }
-
-    arguments.Rn = (instruction_code >> 16) & 0xF;
-    arguments.Rd = (instruction_code >> 12) & 0xF;
-    // I immediate bit (if 1, the operand is an immediate value)
-    bool bit_25 = (instruction_code >> 25) & 0x1;
-    uint32_t operand2 = instruction_code & 0xFFF;
-    if (bit_25) {
-        arguments.shifted_value = operand2 & 0xFF;
-        arguments.shift_type = GBA::ShiftType::RotateRight;
-        arguments.shift_value =
-            ((operand2 >> 8) & 0xF) * 2;  // "This value is zero extended to 32 bits, and then subject to a rotate right
-                                          // by *twice* the value in the rotate field."
-    }
-    else {
-        bool bit_4 = (instruction_code >> 4) & 0x1;
-        // register to shift
-        uint32_t Rm = instruction_code & 0xF;
-        arguments.shifted_value = R(Rm);
-        // shift type
-        arguments.shift_type = static_cast<GBA::ShiftType>((instruction_code >> 5) & 0x3);
-        // shift amount
-        if (bit_4)
-            arguments.shift_value = R((operand2 >> 8) & 0xF);
-        else
-            arguments.shift_value = (instruction_code >> 7) & 0x1F;
-    }
-    arguments.PC = pc;
-    return arguments;
+    switchBank(mode);
 }
 
 void GBA::CPU::dataProcessingArmLogicalOperationFlagsSetting(
     bool S, uint32_t Rd, uint32_t operation_result,
-    bool carry) {        // for example TST does not save its result in R(Rd) that's why we need it
-    if (!S || Rd == 15)  // TODO setting carry flag
+    bool carry) {  // for example TST does not save its result in R(Rd) that's why we need it
+    if (!S || Rd == 15)
         return;
-    if (operation_result & (1 << 31))  // setting negative flag
-        CPSR |= (1 << 31);
-    else
-        CPSR &= ~(1 << 31);
-
-    if (R(operation_result) == 0)  // setting zero flag
-        CPSR |= (1 << 30);
-    else
-        CPSR &= ~(1 << 30);
-
-    if (carry)  // setting carry flag
-        CPSR |= (1 << 29);
-    else
-        CPSR &= ~(1 << 29);
+    setLogicalFlags(operation_result, carry);
 }
 
 void GBA::CPU::dataProcessingArmArithmeticOperationFlagsSetting(
-    bool S, uint32_t Rd_before_operation, uint32_t Rd, uint32_t result, uint32_t operand1, uint32_t operand2,
-    bool isAdd) {
+    bool S, uint32_t Rd, uint32_t operand1, uint32_t operand2, bool carry_in) {
     if (!S || Rd == 15)
         return;
+    setAddFlags(operand1, operand2, carry_in);
+}
 
-    if (result & (1 << 31))  // setting negative flag
-        CPSR |= (1 << 31);
-    else
-        CPSR &= ~(1 << 31);
-
-    if (result == 0)  // setting zero flag
-        CPSR |= (1 << 30);
-    else
-        CPSR &= ~(1 << 30);
-
-    // setting carry flag
-    if (isAdd) {
-        if (operand1 > 0xFFFFFFFF - operand2)
-            CPSR |= (1 << 29);
-        else
-            CPSR &= ~(1 << 29);
-    }
-    else {
-        if (operand1 < operand2)
-            CPSR |= (1 << 29);
-        else
-            CPSR &= ~(1 << 29);
-    }
-
-    // setting overflow flag
-    if (((operand1 ^ operand2) & (1 << 31)) == 0 &&
-        ((Rd_before_operation ^ result) & (1 << 31)) != 0)  // + + = - or - - = + then overlow flag is set
-        CPSR |= (1 << 28);
-    else
-        CPSR &= ~(1 << 28);
-}
-
-std::pair<uint32_t, bool>
-    GBA::CPU::calculateOperand2(uint32_t shifted_value, uint32_t shift_value, ShiftType shift_type) {
-    if (shift_value == 0)
-        return {shifted_value, (CPSR >> 28) & 1};  // return current carry flag value
-
-    switch (shift_type) {
-    case GBA::ShiftType::LogicalLeft: {
-        bool carry_out = (shifted_value >> (32 - shift_value)) & 0x1;
-        return {shifted_value << shift_value, carry_out};
-    }
-    case GBA::ShiftType::LogicalRight: {
-        bool carry_out = (shifted_value >> (shift_value - 1)) & 0x1;
-        return {shifted_value >> shift_value, carry_out};
-    }
-    case GBA::ShiftType::ArithmeticRight: {
-        int32_t signed_Rm = *reinterpret_cast<int32_t*>(&shifted_value);
-        bool carry_out = (shifted_value >> (shift_value - 1)) & 0x1;
-        for (int32_t i = 0; i < shift_value; i++) {
-            if (signed_Rm < 0 && signed_Rm % 2 == 1) {
-                signed_Rm /= 2;
-                signed_Rm--;
-            }
-            else
-                signed_Rm /= 2;
-        }
-        return {*reinterpret_cast<uint32_t*>(&shifted_value), carry_out};
-    }
-    case GBA::ShiftType::RotateRight: {
-        uint32_t carry_out = (shifted_value >> (shift_value - 1)) & 0x1;
-        return {(shifted_value >> shift_value) | (shifted_value << (32 - shift_value)), carry_out};
-    }
-    default:
-        throw;  // TODO: invalid shift type error handling
-    }
+std::pair<uint32_t, bool> GBA::CPU::calculateOperand2(
+    uint32_t shifted_value, uint32_t shift_value, ShiftType shift_type, bool register_shift) {
+    if (register_shift)  // reading the shift amount from a register takes an extra internal cycle
+        addInternalCycles(1);
+    bool carry = getCarryFlag();
+    uint32_t result = shift(shift_type, shifted_value, shift_value, register_shift, carry);
+    return {result, carry};
 }
 
 void GBA::CPU::andArm(DataProcessingArguments arguments) {
-    std::cout << "# Instruction type: and\n";
-    auto operand2 = calculateOperand2(arguments.shifted_value, arguments.shift_value, arguments.shift_type);
+    auto operand2 = calculateOperand2(
+        arguments.shifted_value, arguments.shift_value, arguments.shift_type, arguments.register_shift);
     R(arguments.Rd) = R(arguments.Rn) & operand2.first;
     dataProcessingArmLogicalOperationFlagsSetting(arguments.S, arguments.Rd, R(arguments.Rd), operand2.second);
 }
 
 void GBA::CPU::xorArm(DataProcessingArguments arguments) {
-    std::cout << "# Instruction type: xor\n";
-    auto operand2 = calculateOperand2(arguments.shifted_value, arguments.shift_value, arguments.shift_type);
+    auto operand2 = calculateOperand2(
+        arguments.shifted_value, arguments.shift_value, arguments.shift_type, arguments.register_shift);
     R(arguments.Rd) = R(arguments.Rn) ^ operand2.first;
     dataProcessingArmLogicalOperationFlagsSetting(arguments.S, arguments.Rd, R(arguments.Rd), operand2.second);
 }
 
 void GBA::CPU::subArm(DataProcessingArguments arguments) {
-    std::cout << "# Instruction type: sub\n";
-    uint32_t Rd_before_operation = R(arguments.Rd);
-    auto operand2 = calculateOperand2(arguments.shifted_value, arguments.shift_value, arguments.shift_type);
-    R(arguments.Rd) = R(arguments.Rn) - operand2.first;
-    dataProcessingArmArithmeticOperationFlagsSetting(
-        arguments.S, Rd_before_operation, arguments.Rd, R(arguments.Rd), R(arguments.Rn), operand2.first, false);
+    auto operand2 = calculateOperand2(
+        arguments.shifted_value, arguments.shift_value, arguments.shift_type, arguments.register_shift);
+    uint32_t operand1 = R(arguments.Rn);
+    uint32_t operand2_value = ~operand2.first;
+    R(arguments.Rd) = operand1 + operand2_value + 1;
+    dataProcessingArmArithmeticOperationFlagsSetting(arguments.S, arguments.Rd, operand1, operand2_value, 1);
 }
 
 void GBA::CPU::rsbArm(DataProcessingArguments arguments) {
-    std::cout << "# Instruction type: rsb\n";
-    uint32_t Rd_before_operation = R(arguments.Rd);
-    auto operand2 = calculateOperand2(arguments.shifted_value, arguments.shift_value, arguments.shift_type);
-    R(arguments.Rd) = operand2.first - R(arguments.Rn);
-    dataProcessingArmArithmeticOperationFlagsSetting(
-        arguments.S, Rd_before_operation, arguments.Rd, R(arguments.Rd), operand2.first, R(arguments.Rd), false);
+    auto operand2 = calculateOperand2(
+        arguments.shifted_value, arguments.shift_value, arguments.shift_type, arguments.register_shift);
+    uint32_t operand1 = operand2.first;
+    uint32_t operand2_value = ~R(arguments.Rn);
+    R(arguments.Rd) = operand1 + operand2_value + 1;
+    dataProcessingArmArithmeticOperationFlagsSetting(arguments.S, arguments.Rd, operand1, operand2_value, 1);
 }
 
 void GBA::CPU::addArm(DataProcessingArguments arguments) {
-    std::cout << "# Instruction type: add\n";
-    uint32_t Rd_before_operation = R(arguments.Rd);
-    auto operand2 = calculateOperand2(arguments.shifted_value, arguments.shift_value, arguments.shift_type);
-    R(arguments.Rd) = R(arguments.Rn) + operand2.first;
-    dataProcessingArmArithmeticOperationFlagsSetting(
-        arguments.S, Rd_before_operation, arguments.Rd, R(arguments.Rd), R(arguments.Rn), operand2.first, true);
+    auto operand2 = calculateOperand2(
+        arguments.shifted_value, arguments.shift_value, arguments.shift_type, arguments.register_shift);
+    uint32_t operand1 = R(arguments.Rn);
+    uint32_t operand2_value = operand2.first;
+    R(arguments.Rd) = operand1 + operand2_value + 0;
+    dataProcessingArmArithmeticOperationFlagsSetting(arguments.S, arguments.Rd, operand1, operand2_value, 0);
 }
 
 void GBA::CPU::adcArm(DataProcessingArguments arguments) {
-    std::cout << "# Instruction type: adc\n";
-    uint32_t Rd_before_operation = R(arguments.Rd);
-    auto operand2 = calculateOperand2(arguments.shifted_value, arguments.shift_value, arguments.shift_type);
-    R(arguments.Rd) = R(arguments.Rn) + operand2.first + ((CPSR >> 29) & 0x1);
-    dataProcessingArmArithmeticOperationFlagsSetting(
-        arguments.S, Rd_before_operation, arguments.Rd, R(arguments.Rd), R(arguments.Rn), operand2.first, true);
+    auto operand2 = calculateOperand2(
+        arguments.shifted_value, arguments.shift_value, arguments.shift_type, arguments.register_shift);
+    uint32_t operand1 = R(arguments.Rn);
+    uint32_t operand2_value = operand2.first;
+    bool carry_in = getCarryFlag();
+    R(arguments.Rd) = operand1 + operand2_value + carry_in;
+    dataProcessingArmArithmeticOperationFlagsSetting(arguments.S, arguments.Rd, operand1, operand2_value, carry_in);
 }
 
 void GBA::CPU::sbcArm(DataProcessingArguments arguments) {
-    std::cout << "# Instruction type: sbc\n";
-    uint32_t Rd_before_operation = R(arguments.Rd);
-    auto operand2 = calculateOperand2(arguments.shifted_value, arguments.shift_value, arguments.shift_type);
-    R(arguments.Rd) = R(arguments.Rn) - operand2.first + ((CPSR >> 29) & 0x1) - 1;
-    dataProcessingArmArithmeticOperationFlagsSetting(
-        arguments.S, Rd_before_operation, arguments.Rd, R(arguments.Rd), R(arguments.Rn), operand2.first, false);
+    auto operand2 = calculateOperand2(
+        arguments.shifted_value, arguments.shift_value, arguments.shift_type, arguments.register_shift);
+    uint32_t operand1 = R(arguments.Rn);
+    uint32_t operand2_value = ~operand2.first;
+    bool carry_in = getCarryFlag();
+    R(arguments.Rd) = operand1 + operand2_value + carry_in;
+    dataProcessingArmArithmeticOperationFlagsSetting(arguments.S, arguments.Rd, operand1, operand2_value, carry_in);
 }
 
 void GBA::CPU::rscArm(DataProcessingArguments arguments) {
-    std::cout << "# Instruction type: rsc\n";
-    uint32_t Rd_before_operation = R(arguments.Rd);
-    auto operand2 = calculateOperand2(arguments.shifted_value, arguments.shift_value, arguments.shift_type);
-    R(arguments.Rd) = operand2.first - R(arguments.Rn) + ((CPSR >> 29) & 0x1) - 1;
-    dataProcessingArmArithmeticOperationFlagsSetting(
-        arguments.S, Rd_before_operation, arguments.Rd, R(arguments.Rd), operand2.first, R(arguments.Rd), false);
+    auto operand2 = calculateOperand2(
+        arguments.shifted_value, arguments.shift_value, arguments.shift_type, arguments.register_shift);
+    uint32_t operand1 = operand2.first;
+    uint32_t operand2_value = ~R(arguments.Rn);
+    bool carry_in = getCarryFlag();
+    R(arguments.Rd) = operand1 + operand2_value + carry_in;
+    dataProcessingArmArithmeticOperationFlagsSetting(arguments.S, arguments.Rd, operand1, operand2_value, carry_in);
 }
 
 void GBA::CPU::tstArm(DataProcessingArguments arguments) {
-    std::cout << "# Instruction type: tst\n";
-    auto operand2 = calculateOperand2(arguments.shifted_value, arguments.shift_value, arguments.shift_type);
+    auto operand2 = calculateOperand2(
+        arguments.shifted_value, arguments.shift_value, arguments.shift_type, arguments.register_shift);
     uint32_t result = R(arguments.Rn) & operand2.first;
     dataProcessingArmLogicalOperationFlagsSetting(arguments.S, arguments.Rd, result, operand2.second);
 }
 
 void GBA::CPU::teqArm(DataProcessingArguments arguments) {
-    std::cout << "# Instruction type: teq\n";
-    auto operand2 = calculateOperand2(arguments.shifted_value, arguments.shift_value, arguments.shift_type);
+    auto operand2 = calculateOperand2(
+        arguments.shifted_value, arguments.shift_value, arguments.shift_type, arguments.register_shift);
     uint32_t result = R(arguments.Rn) ^ operand2.first;
     dataProcessingArmLogicalOperationFlagsSetting(arguments.S, arguments.Rd, result, operand2.second);
 }
 
 void GBA::CPU::cmpArm(DataProcessingArguments arguments) {
-    std::cout << "# Instruction type: cmp\n";
-    auto operand2 = calculateOperand2(arguments.shifted_value, arguments.shift_value, arguments.shift_type);
-    uint32_t result = R(arguments.Rn) - operand2.first;
-    dataProcessingArmArithmeticOperationFlagsSetting(
-        arguments.S, R(arguments.Rn), arguments.Rd, result, R(arguments.Rn), operand2.first, false);
+    auto operand2 = calculateOperand2(
+        arguments.shifted_value, arguments.shift_value, arguments.shift_type, arguments.register_shift);
+    dataProcessingArmArithmeticOperationFlagsSetting(arguments.S, arguments.Rd, R(arguments.Rn), ~operand2.first, 1);
     // TODO check if arguments.Rd should be arguments.Rn
 }
 
 void GBA::CPU::cmnArm(DataProcessingArguments arguments) {
-    std::cout << "# Instruction type: cmn\n";
-    auto operand2 = calculateOperand2(arguments.shifted_value, arguments.shift_value, arguments.shift_type);
-    uint32_t result = R(arguments.Rn) + operand2.first;
-    dataProcessingArmArithmeticOperationFlagsSetting(
-        arguments.S, R(arguments.Rn), arguments.Rd, result, R(arguments.Rn), operand2.first, true);
+    auto operand2 = calculateOperand2(
+        arguments.shifted_value, arguments.shift_value, arguments.shift_type, arguments.register_shift);
+    dataProcessingArmArithmeticOperationFlagsSetting(arguments.S, arguments.Rd, R(arguments.Rn), operand2.first, 0);
     // TODO check if arguments.Rd should be arguments.Rn
 }
 
 void GBA::CPU::orrArm(DataProcessingArguments arguments) {
-    std::cout << "# Instruction type: orr\n";
-    auto operand2 = calculateOperand2(arguments.shifted_value, arguments.shift_value, arguments.shift_type);
+    auto operand2 = calculateOperand2(
+        arguments.shifted_value, arguments.shift_value, arguments.shift_type, arguments.register_shift);
     R(arguments.Rd) = R(arguments.Rn) | operand2.first;
     dataProcessingArmLogicalOperationFlagsSetting(arguments.S, arguments.Rd, R(arguments.Rd), operand2.second);
 }
 
 void GBA::CPU::movArm(DataProcessingArguments arguments) {
-    std::cout << "# Instruction type: mov\n";
-    auto operand2 = calculateOperand2(arguments.shifted_value, arguments.shift_value, arguments.shift_type);
+    auto operand2 = calculateOperand2(
+        arguments.shifted_value, arguments.shift_value, arguments.shift_type, arguments.register_shift);
     R(arguments.Rd) = operand2.first;
     dataProcessingArmLogicalOperationFlagsSetting(arguments.S, arguments.Rd, R(arguments.Rd), operand2.second);
 }
 
-void GBA::CPU::retArm(DataProcessingArguments arguments) {
-    std::cout << "# Instruction type: mov (ret)\n";
-    PC() = LR(getMode());
-    if (arguments.S) {
-        switch (getMode()) {
-        case Mode::FastInterrupt:
-            CPSR = SPSR_FIQ;
-            break;
-        case Mode::Supervisor:
-            CPSR = SPSR_SVC;
-            break;
-        case Mode::Abort:
-            CPSR = SPSR_ABT;
-            break;
-        case Mode::Interrupt:
-            CPSR = SPSR_IRQ;
-            break;
-        case Mode::User:
-        case Mode::System:
-            // todo todo
-            break;
-        case Mode::Undefined:
-        default:
-            throw;
-        }
-    }
-}
-
 void GBA::CPU::bicArm(DataProcessingArguments arguments) {
-    std::cout << "# Instruction type: bic\n";
-    auto operand2 = calculateOperand2(arguments.shifted_value, arguments.shift_value, arguments.shift_type);
+    auto operand2 = calculateOperand2(
+        arguments.shifted_value, arguments.shift_value, arguments.shift_type, arguments.register_shift);
     R(arguments.Rd) = R(arguments.Rn) & ~operand2.first;
     dataProcessingArmLogicalOperationFlagsSetting(arguments.S, arguments.Rd, R(arguments.Rd), operand2.second);
 }
 
 void GBA::CPU::mvnArm(DataProcessingArguments arguments) {
-    std::cout << "# Instruction type: mvn\n";
-    auto operand2 = calculateOperand2(arguments.shifted_value, arguments.shift_value, arguments.shift_type);
+    auto operand2 = calculateOperand2(
+        arguments.shifted_value, arguments.shift_value, arguments.shift_type, arguments.register_shift);
     R(arguments.Rd) = ~operand2.first;
     dataProcessingArmLogicalOperationFlagsSetting(arguments.S, arguments.Rd, R(arguments.Rd), operand2.second);
 }
 
-bool GBA::CPU::checkCondition(uint32_t instruction_code) const {
-    std::cout << std::hex << std::setw(8) << std::setfill('0') << instruction_code << std::dec << '\n';
-    uint32_t condition = (instruction_code >> 28) & 0xF;
-    bool negative_flag = (CPSR >> 31) & 0x1;
-    bool zero_flag = (CPSR >> 30) & 0x1;
-    bool carry_flag = (CPSR >> 29) & 0x1;
-    bool overflow_flag = (CPSR >> 28) & 0x1;
+namespace {
+
+// Whether a condition passes for the NZCV nibble
+constexpr bool evaluateCondition(uint32_t condition, uint32_t flags) {
+    bool negative_flag = (flags >> 3) & 0x1;
+    bool zero_flag = (flags >> 2) & 0x1;
+    bool carry_flag = (flags >> 1) & 0x1;
+    bool overflow_flag = flags & 0x1;
     switch (condition) {
     case 0b0000:
         return zero_flag;
@@ -672,28 +1049,163 @@ bool GBA::CPU::checkCondition(uint32_t instruction_code) const {
         return zero_flag || negative_flag != overflow_flag;
     case 0b1110:
         return true;
-    case 0b1111:  // This is never used/reserved flag so I am not sure what to do here
     default:
-        throw;  // TODO: invalid condition error handling
+        // NV is reserved on ARMv4 and never executes
+        return false;
+    }
+}
+
+// Bit n of entry c tells whether condition c passes for the NZCV nibble n
+constexpr std::array<uint16_t, 16> makeConditionTable() {
+    std::array<uint16_t, 16> table{};
+    for (uint32_t condition = 0; condition < 16; condition++) {
+        for (uint32_t flags = 0; flags < 16; flags++) {
+            if (evaluateCondition(condition, flags))
+                table[condition] |= 1 << flags;
+        }
     }
+    return table;
 }
 
-GBA::Opcode GBA::CPU::getOpcodeArm(uint32_t instruction_code) const {
-    return static_cast<GBA::Opcode>((instruction_code >> 21) & 0xF);
+constexpr std::array<uint16_t, 16> condition_table = makeConditionTable();
+
+}
+
+bool GBA::CPU::checkCondition(uint32_t instruction_code) const {
+    return (condition_table[instruction_code >> 28] >> (getFlags() >> 28)) & 0x1;
+}
+
+template <GBA::Opcode opcode, bool S, bool I, GBA::ShiftType shift_type, bool register_shift>
+void GBA::CPU::dataProcessingArm(uint32_t instruction_code, uint32_t pc) {
+    constexpr bool logical = opcode == Opcode::AND || opcode == Opcode::XOR || opcode == Opcode::TST ||
+                             opcode == Opcode::TEQ || opcode == Opcode::ORR || opcode == Opcode::MOV ||
+                             opcode == Opcode::BIC || opcode == Opcode::MVN;
+    constexpr bool uses_carry = opcode == Opcode::ADC || opcode == Opcode::SBC || opcode == Opcode::RSC;
+    constexpr bool rrx = !I && !register_shift && shift_type == ShiftType::RotateRight;
+    // the old carry is only worth materializing when the shifter may pass it through or the operation adds it
+    bool carry = (S && logical) || uses_carry || rrx ? getCarryFlag() : false;
+    const bool carry_in = carry;
+    // R15 reads as the instruction address + 8, + 12 when the shift amount comes from a register
+    const uint32_t pc_value = pc + (register_shift ? 12 : 8);
+
+    uint32_t operand2;
+    if constexpr (I) {
+        uint32_t rotation = ((instruction_code >> 8) & 0xF) * 2;
+        operand2 = rotateRight(instruction_code & 0xFF, rotation);
+        if (rotation != 0)
+            carry = operand2 >> 31;
+    }
+    else {
+        uint32_t Rm = instruction_code & 0xF;
+        uint32_t value = Rm == 15 ? pc_value : R(Rm);
+        if constexpr (register_shift) {
+            // reading the shift amount from a register takes an extra internal cycle
+            addInternalCycles(1);
+            operand2 = shiftByRegister<shift_type>(value, R((instruction_code >> 8) & 0xF) & 0xFF, carry);
+        }
+        else
+            operand2 = shiftByImmediate<shift_type>(value, (instruction_code >> 7) & 0x1F, carry);
+    }
+
+    uint32_t Rn = (instruction_code >> 16) & 0xF;
+    uint32_t operand1 = Rn == 15 ? pc_value : R(Rn);
+
+    // arithmetic operations are all a + b + carry, subtraction adds the inverted operand plus one
+    uint32_t a = 0;
+    uint32_t b = 0;
+    bool c = false;
+    uint32_t result;
+    if constexpr (opcode == Opcode::AND || opcode == Opcode::TST)
+        result = operand1 & operand2;
+    else if constexpr (opcode == Opcode::XOR || opcode == Opcode::TEQ)
+        result = operand1 ^ operand2;
+    else if constexpr (opcode == Opcode::ORR)
+        result = operand1 | operand2;
+    else if constexpr (opcode == Opcode::MOV)
+        result = operand2;
+    else if constexpr (opcode == Opcode::BIC)
+        result = operand1 & ~operand2;
+    else if constexpr (opcode == Opcode::MVN)
+        result = ~operand2;
+    else {
+        if constexpr (opcode == Opcode::SUB || opcode == Opcode::CMP || opcode == Opcode::SBC) {
+            a = operand1;
+            b = ~operand2;
+        }
+        else if constexpr (opcode == Opcode::RSB || opcode == Opcode::RSC) {
+            a = operand2;
+            b = ~operand1;
+        }
+        else {
+            a = operand1;
+            b = operand2;
+        }
+        if constexpr (uses_carry)
+            c = carry_in;
+        else
+            c = opcode == Opcode::SUB || opcode == Opcode::CMP || opcode == Opcode::RSB;
+        result = a + b + c;
+    }
+
+    constexpr bool writes_result =
+        opcode != Opcode::TST && opcode != Opcode::TEQ && opcode != Opcode::CMP && opcode != Opcode::CMN;
+    if constexpr (writes_result) {
+        uint32_t Rd = (instruction_code >> 12) & 0xF;
+        if (Rd == 15) {
+            // writing PC with S set returns from an exception by restoring CPSR from the SPSR
+            if constexpr (S) {
+                if (hasSPSR())
+                    writeCPSR(SPSR());
+            }
+            PC() = result & (inThumb() ? 0xFFFFFFFE : 0xFFFFFFFC);
+            return;
+        }
+        R(Rd) = result;
+    }
+
+    if constexpr (S) {
+        // only the inputs are recorded, NZCV is computed when something reads it
+        if constexpr (logical)
+            setLogicalFlags(result, carry);
+        else
+            setAddFlags(a, b, c);
+    }
 }
 
 void GBA::CPU::callDataProcessingInstruction(uint32_t instruction_code, uint32_t pc) {
-    if (!checkCondition(instruction_code))
-        return;  // If the condition is not met, do nothing, later check what should happen if anything
+    if (checkCondition(instruction_code))
+        (this->*lookupArm(instruction_code))(instruction_code, pc);
+}
+
+void GBA::CPU::callMRSInstruction(uint32_t instruction_code, uint32_t pc) {
+    bool use_SPSR = (instruction_code >> 22) & 0x1;
+    uint32_t Rd = (instruction_code >> 12) & 0xF;
+    R(Rd) = use_SPSR && hasSPSR() ? SPSR() : getCPSR();
+}
+
+void GBA::CPU::callMSRInstruction(uint32_t instruction_code, uint32_t pc) {
+    uint32_t value;
+    if ((instruction_code >> 25) & 0x1)
+        value = rotateRight(instruction_code & 0xFF, ((instruction_code >> 8) & 0xF) * 2);
+    else
+        value = R(instruction_code & 0xF);
 
-    auto opcode = getOpcodeArm(instruction_code);
-    GBA::DataProcessingArguments arguments = decodeDataProcessingArguments(instruction_code, opcode, pc);
-    // todo: fix this ugly code
-    if (opcode == GBA::Opcode::MOV && ((instruction_code >> 12) & 0xF) == 0xF && (instruction_code & 0xF) == 0xE) {
-        retArm(arguments);
+    // bits 19-16 select the flags, status, extension and control bytes
+    uint32_t mask = 0;
+    for (uint32_t field = 0; field < 4; field++) {
+        if ((instruction_code >> (16 + field)) & 0x1)
+            mask |= 0xFF << (8 * field);
+    }
+
+    bool use_SPSR = (instruction_code >> 22) & 0x1;
+    if (use_SPSR) {
+        if (hasSPSR())
+            SPSR() = (SPSR() & ~mask) | (value & mask);
     }
     else {
-        (this->*data_processing_instruction_type[static_cast<int>(getOpcodeArm(instruction_code))])(arguments);
+        if (getMode() == Mode::User)  // only the flags can be written in User mode
+            mask &= 0xFF000000;
+        writeCPSR((getCPSR() & ~mask) | (value & mask));
     }
 }
 
@@ -701,9 +1213,9 @@ GBA::MultiplyArguments GBA::CPU::decodeMultiplyArguments(uint32_t instruction_co
     GBA::MultiplyArguments arguments;
     arguments.A = (instruction_code >> 20) & 0x1;
     arguments.S = (instruction_code >> 19) & 0x1;
-    arguments.Rd = (instruction_code >> 15) & 0xF;
-    arguments.Rn = (instruction_code >> 11) & 0xF;
-    arguments.Rs = (instruction_code >> 7) & 0xF;
+    arguments.Rd = (instruction_code >> 16) & 0xF;
+    arguments.Rn = (instruction_code >> 12) & 0xF;
+    arguments.Rs = (instruction_code >> 8) & 0xF;
     arguments.Rm = instruction_code & 0xF;
     arguments.PC = pc;
     return arguments;
@@ -711,6 +1223,7 @@ GBA::MultiplyArguments GBA::CPU::decodeMultiplyArguments(uint32_t instruction_co
 
 void GBA::CPU::multiplyArmFlagSetting(bool S, uint32_t Rd) {
     if (S && Rd != 15) {
+        resolveFlags();
         if (R(Rd) & (1 << 31))
             CPSR |= (1 << 31);
         else
@@ -725,23 +1238,35 @@ void GBA::CPU::multiplyArmFlagSetting(bool S, uint32_t Rd) {
     }
 }
 
-void GBA::CPU::mulArm(MultiplyArguments arguments) {
+namespace {
+
+// Internal cycles of the multiplier array, it stops early once the remaining bytes of the multiplier are all
+// zeros (or all ones for signed multiplies)
+uint32_t getMultiplyCycles(uint32_t multiplier, bool is_signed) {
+    uint32_t cycles = 4;
+    for (uint32_t mask = 0xFFFFFF00; mask != 0; mask <<= 8) {
+        uint32_t top = multiplier & mask;
+        if (top == 0 || (is_signed && top == mask))
+            cycles--;
+    }
+    return std::max<uint32_t>(cycles, 1);
+}
+
+}
 
+void GBA::CPU::mulArm(MultiplyArguments arguments) {
+    addInternalCycles(getMultiplyCycles(R(arguments.Rs), true));
     R(arguments.Rd) = R(arguments.Rm) * R(arguments.Rs);
     multiplyArmFlagSetting(arguments.S, arguments.Rd);
 }
 
 void GBA::CPU::mlaArm(MultiplyArguments arguments) {
+    addInternalCycles(getMultiplyCycles(R(arguments.Rs), true) + 1);
     R(arguments.Rd) = R(arguments.Rm) * R(arguments.Rs) + R(arguments.Rn);
     multiplyArmFlagSetting(arguments.S, arguments.Rd);
 }
 
 void GBA::CPU::callMultiplyInstruction(uint32_t instruction_code, uint32_t pc) {
-    if (!checkCondition(instruction_code))
-        return;
-
-    // TODO: remove debug statements
-    std::cout << "# Instruction type: Multiply\n";
     GBA::MultiplyArguments arguments = decodeMultiplyArguments(instruction_code, pc);
     if (arguments.A)
         mlaArm(arguments);
@@ -756,51 +1281,50 @@ GBA::MultiplyLongArguments GBA::CPU::decodeMultiplyLongArguments(uint32_t instru
     arguments.S = (instruction_code >> 20) & 0x1;
     arguments.RdHi = (instruction_code >> 16) & 0xF;
     arguments.RdLo = (instruction_code >> 12) & 0xF;
-    arguments.Rm = (instruction_code >> 8) & 0xF;
-    arguments.Rs = instruction_code & 0xF;
+    arguments.Rs = (instruction_code >> 8) & 0xF;
+    arguments.Rm = instruction_code & 0xF;
     arguments.PC = pc;
     return arguments;
 }
 
 void GBA::CPU::umullArm(MultiplyLongArguments arguments) {
-    uint64_t result = R(arguments.Rm) * R(arguments.Rs);
+    addInternalCycles(getMultiplyCycles(R(arguments.Rs), false) + 1);
+    uint64_t result = static_cast<uint64_t>(R(arguments.Rm)) * R(arguments.Rs);
     R(arguments.RdLo) = result & 0xFFFFFFFF;
     R(arguments.RdHi) = result >> 32;
 }
 
 void GBA::CPU::umlalArm(MultiplyLongArguments arguments) {
+    addInternalCycles(getMultiplyCycles(R(arguments.Rs), false) + 2);
     uint64_t accumulator = (static_cast<uint64_t>(R(arguments.RdHi)) << 32) | R(arguments.RdLo);
-    uint64_t result = R(arguments.Rm) * R(arguments.Rs) + accumulator;
+    uint64_t result = static_cast<uint64_t>(R(arguments.Rm)) * R(arguments.Rs) + accumulator;
     R(arguments.RdLo) = result & 0xFFFFFFFF;
-    R(arguments.RdHi) = (result >> 32) & 0xFFFFFFFF;
+    R(arguments.RdHi) = result >> 32;
 }
 
 void GBA::CPU::smullArm(MultiplyLongArguments arguments) {
-    int64_t result = static_cast<int64_t>(arguments.Rm) * static_cast<int64_t>(R(arguments.Rs));
-    int32_t temp = static_cast<int32_t>(result & 0xFFFFFFFF);
-    R(arguments.RdLo) = *reinterpret_cast<uint32_t*>(&temp);
-    temp = static_cast<int32_t>((result >> 32) & 0xFFFFFFFF);
-    R(arguments.RdHi) = *reinterpret_cast<uint32_t*>(&temp);
+    addInternalCycles(getMultiplyCycles(R(arguments.Rs), true) + 1);
+    int64_t result = static_cast<int64_t>(static_cast<int32_t>(R(arguments.Rm))) *
+                     static_cast<int32_t>(R(arguments.Rs));
+    R(arguments.RdLo) = static_cast<uint64_t>(result) & 0xFFFFFFFF;
+    R(arguments.RdHi) = static_cast<uint64_t>(result) >> 32;
 }
 
 void GBA::CPU::smlalArm(MultiplyLongArguments arguments) {
-    int64_t accumulator = (static_cast<int64_t>(R(arguments.RdHi)) << 32) | R(arguments.RdLo);
-    int64_t result = static_cast<int64_t>(R(arguments.Rm)) * static_cast<int64_t>(R(arguments.Rs)) + accumulator;
-    int32_t temp = static_cast<int32_t>(result & 0xFFFFFFFF);
-    R(arguments.RdLo) = *reinterpret_cast<uint32_t*>(&temp);
-    temp = static_cast<int32_t>((result >> 32) & 0xFFFFFFFF);
-    R(arguments.RdHi) = *reinterpret_cast<uint32_t*>(&temp);
+    addInternalCycles(getMultiplyCycles(R(arguments.Rs), true) + 2);
+    uint64_t accumulator = (static_cast<uint64_t>(R(arguments.RdHi)) << 32) | R(arguments.RdLo);
+    int64_t product = static_cast<int64_t>(static_cast<int32_t>(R(arguments.Rm))) *
+                      static_cast<int32_t>(R(arguments.Rs));
+    uint64_t result = static_cast<uint64_t>(product) + accumulator;
+    R(arguments.RdLo) = result & 0xFFFFFFFF;
+    R(arguments.RdHi) = result >> 32;
 }
 
 void GBA::CPU::callMultiplyLongInstruction(uint32_t instruction_code, uint32_t pc) {
-    if (!checkCondition(instruction_code))
-        return;
-
-    std::cout << "# Instruction type: Multiply Long\n";
     GBA::MultiplyLongArguments arguments = decodeMultiplyLongArguments(instruction_code, pc);
     if (arguments.U) {
         if (arguments.A)
-            umullArm(arguments);
+            smlalArm(arguments);
         else
             smullArm(arguments);
     }
@@ -808,10 +1332,11 @@ void GBA::CPU::callMultiplyLongInstruction(uint32_t instruction_code, uint32_t p
         if (arguments.A)
             umlalArm(arguments);
         else
-            smlalArm(arguments);
+            umullArm(arguments);
     }
 
     if (arguments.S && arguments.RdHi != 15 && arguments.RdLo != 15) {
+        resolveFlags();
         if (R(arguments.RdHi) & (1 << 31))
             CPSR |= (1 << 31);
         else
@@ -838,106 +1363,77 @@ GBA::SingleDataTransferArguments GBA::CPU::decodeSingleDataTransferArguments(uin
     arguments.Rn = (instruction_code >> 16) & 0xF;
     arguments.Rd = (instruction_code >> 12) & 0xF;
     arguments.offset = instruction_code & 0xFFF;
+    arguments.PC = pc;
     return arguments;
 }
 
 void GBA::CPU::ldrArm(SingleDataTransferArguments arguments) {
-    uint32_t address = R(arguments.Rn);
+    // R15 reads as the instruction address + 8
+    uint32_t address = arguments.Rn == 15 ? arguments.PC + 8 : R(arguments.Rn);
     uint32_t offset = 0;
     if (arguments.I) {
-        uint32_t shifted_value = R(arguments.offset & 0xF);
+        uint32_t Rm = arguments.offset & 0xF;
+        uint32_t shifted_value = Rm == 15 ? arguments.PC + 8 : R(Rm);
         ShiftType shift_type = static_cast<ShiftType>((arguments.offset >> 5) & 0x3);
-        bool bit_4 = (arguments.offset >> 4) & 0x1;
-        uint32_t shift_value = 0;
-        if (bit_4)
-            shift_value = R((arguments.offset >> 8) & 0xF);
-        else
-            shift_value = (arguments.offset >> 7) & 0x1F;
-
-        auto operand2 = calculateOperand2(shifted_value, shift_value, shift_type);
-        offset = operand2.first;
+        // register offsets only take immediate shift amounts, the carry out is not used
+        uint32_t shift_value = (arguments.offset >> 7) & 0x1F;
+        bool carry = getCarryFlag();
+        offset = shift(shift_type, shifted_value, shift_value, false, carry);
     }
     else {
         offset = arguments.offset;
     }
 
-    if (arguments.P) {  // pre indexing
-        if (arguments.U)
-            address += arguments.offset;
-        else
-            address -= arguments.offset;
-    }
+    uint32_t written_back_base = arguments.U ? address + offset : address - offset;
+    if (arguments.P)  // pre indexing
+        address = written_back_base;
 
-    if (arguments.B)
-        R(arguments.Rd) = memory.memory[address];
-    else {
-        R(arguments.Rd) = memory.memory[address];
-        R(arguments.Rd) |= memory.memory[address + 1] << 8;
-        R(arguments.Rd) |= memory.memory[address + 2] << 16;
-        R(arguments.Rd) |= memory.memory[address + 3] << 24;
-    }
+    uint32_t value = arguments.B ? dataRead8(address) : dataRead32Rotated(address);
+    addInternalCycles(1);
 
-    if (arguments.W == 1) {
-        if (arguments.U)
-            R(arguments.Rn) += arguments.offset;
-        else
-            R(arguments.Rn) -= arguments.offset;
-    }
+    // post indexing always writes back, the loaded value wins when the base is also the destination
+    if (!arguments.P || arguments.W)
+        R(arguments.Rn) = written_back_base;
+    R(arguments.Rd) = value;
 }
 
 void GBA::CPU::strArm(SingleDataTransferArguments arguments) {
-    uint32_t address = R(arguments.Rn);
+    uint32_t address = arguments.Rn == 15 ? arguments.PC + 8 : R(arguments.Rn);
     uint32_t offset;
 
     if (arguments.I) {
-        uint32_t shifted_value = R(arguments.offset & 0xF);
+        uint32_t Rm = arguments.offset & 0xF;
+        uint32_t shifted_value = Rm == 15 ? arguments.PC + 8 : R(Rm);
         ShiftType shift_type = static_cast<ShiftType>((arguments.offset >> 5) & 0x3);
-        bool bit_4 = (arguments.offset >> 4) & 0x1;
-        uint32_t shift_value = 0;
-        if (bit_4)
-            shift_value = R((arguments.offset >> 8) & 0xF);
-        else
-            shift_value = (arguments.offset >> 7) & 0x1F;
-
-        auto operand2 = calculateOperand2(shifted_value, shift_value, shift_type);
-        offset = operand2.first;
+        // register offsets only take immediate shift amounts, the carry out is not used
+        uint32_t shift_value = (arguments.offset >> 7) & 0x1F;
+        bool carry = getCarryFlag();
+        offset = shift(shift_type, shifted_value, shift_value, false, carry);
     }
     else {
         offset = arguments.offset;
     }
 
-    if (arguments.P) {  // pre indexing
-        if (arguments.U)
-            address += offset;
-        else
-            address -= offset;
-    }
+    uint32_t written_back_base = arguments.U ? address + offset : address - offset;
+    if (arguments.P)  // pre indexing
+        address = written_back_base;
 
+    // a stored PC is the instruction address + 12
+    uint32_t value = arguments.Rd == 15 ? arguments.PC + 12 : R(arguments.Rd);
     if (arguments.B)
-        memory.memory[address] = R(arguments.Rd) & 0xFF;
-    else {
-        memory.memory[address] = R(arguments.Rd) & 0xFF;
-        memory.memory[address + 1] = (R(arguments.Rd) >> 8) & 0xFF;
-        memory.memory[address + 2] = (R(arguments.Rd) >> 16) & 0xFF;
-        memory.memory[address + 3] = (R(arguments.Rd) >> 24) & 0xFF;
-    }
+        dataWrite8(address, value & 0xFF);
+    else
+        dataWrite32(address, value);
 
-    if (arguments.W == 1) {
-        if (arguments.U)
-            R(arguments.Rn) += offset;
-        else
-            R(arguments.Rn) -= offset;
-    }
+    // post indexing always writes back
+    if (!arguments.P || arguments.W)
+        R(arguments.Rn) = written_back_base;
 }
 
 // LDR R0, [R1, #4]
 // LDR R0, [R1, #4]!
 // LDR R0, [R1], #4
 void GBA::CPU::callSingleDataTransferInstruction(uint32_t instruction_code, uint32_t pc) {
-    if (!checkCondition(instruction_code))
-        return;
-
-    std::cout << "# Instruction type: Single Data Transfer\n";
     GBA::SingleDataTransferArguments arguments = decodeSingleDataTransferArguments(instruction_code, pc);
     if (arguments.L)
         ldrArm(arguments);
@@ -963,108 +1459,84 @@ GBA::HalfWordAndSignedDataTransferArguments
         uint32_t bits_0_3 = instruction_code & 0xF;
         arguments.offset = (bits_8_11 << 4) | bits_0_3;
     }
-    else
-        arguments.offset = R(instruction_code & 0xF);
+    else {
+        uint32_t Rm = instruction_code & 0xF;
+        arguments.offset = Rm == 15 ? pc + 8 : R(Rm);
+    }
     return arguments;
 }
 
 void GBA::CPU::ldrhArm(HalfWordAndSignedDataTransferArguments arguments) {
-    uint32_t address = R(arguments.Rn);
+    uint32_t address = arguments.Rn == 15 ? arguments.PC + 8 : R(arguments.Rn);
+    uint32_t written_back_base = arguments.U ? address + arguments.offset : address - arguments.offset;
+    if (arguments.P)  // pre indexing
+        address = written_back_base;
 
-    if (arguments.P) {
-        if (arguments.U)
-            address += arguments.offset;
-        else
-            address -= arguments.offset;
-    }
-
-    R(arguments.Rd) = memory.memory[address];
-    R(arguments.Rd) |= memory.memory[address + 1] << 8;
+    uint32_t value = dataRead16Rotated(address);
+    addInternalCycles(1);
 
-    if (arguments.W) {
-        if (arguments.U)
-            R(arguments.Rn) += arguments.offset;
-        else
-            R(arguments.Rn) -= arguments.offset;
-    }
+    // post indexing always writes back, the loaded value wins when the base is also the destination
+    if (!arguments.P || arguments.W)
+        R(arguments.Rn) = written_back_base;
+    R(arguments.Rd) = value;
 }
 
 void GBA::CPU::strhArm(HalfWordAndSignedDataTransferArguments arguments) {
-    uint32_t address = R(arguments.Rn);
-
-    if (arguments.P) {
-        if (arguments.U)
-            address += arguments.offset;
-        else
-            address -= arguments.offset;
-    }
+    uint32_t address = arguments.Rn == 15 ? arguments.PC + 8 : R(arguments.Rn);
+    uint32_t written_back_base = arguments.U ? address + arguments.offset : address - arguments.offset;
+    if (arguments.P)  // pre indexing
+        address = written_back_base;
 
-    memory.memory[address] = R(arguments.Rd) & 0xFF;
-    memory.memory[address + 1] = (R(arguments.Rd) >> 8) & 0xFF;
+    uint32_t value = arguments.Rd == 15 ? arguments.PC + 12 : R(arguments.Rd);
+    dataWrite16(address, value & 0xFFFF);
 
-    if (arguments.W) {
-        if (arguments.U)
-            R(arguments.Rn) += arguments.offset;
-        else
-            R(arguments.Rn) -= arguments.offset;
-    }
+    // post indexing always writes back
+    if (!arguments.P || arguments.W)
+        R(arguments.Rn) = written_back_base;
 }
 
 void GBA::CPU::ldrsbArm(HalfWordAndSignedDataTransferArguments arguments) {
-    uint32_t address = R(arguments.Rn);
-
-    if (arguments.P) {
-        if (arguments.U)
-            address += arguments.offset;
-        else
-            address -= arguments.offset;
-    }
+    uint32_t address = arguments.Rn == 15 ? arguments.PC + 8 : R(arguments.Rn);
+    uint32_t written_back_base = arguments.U ? address + arguments.offset : address - arguments.offset;
+    if (arguments.P)  // pre indexing
+        address = written_back_base;
 
     // load single byte and sign-extend it
-    R(arguments.Rd) = memory.memory[address];
-    if (R(arguments.Rd) & (1 << 7))
-        R(arguments.Rd) |= 0xFFFFFF00;
-    else
-        R(arguments.Rd) &= 0x000000FF;
+    uint32_t value = dataRead8(address);
+    addInternalCycles(1);
+    if (value & (1 << 7))
+        value |= 0xFFFFFF00;
 
-    if (arguments.W) {
-        if (arguments.U)
-            R(arguments.Rn) += arguments.offset;
-        else
-            R(arguments.Rn) -= arguments.offset;
-    }
+    if (!arguments.P || arguments.W)
+        R(arguments.Rn) = written_back_base;
+    R(arguments.Rd) = value;
 }
 
 void GBA::CPU::ldrshArm(HalfWordAndSignedDataTransferArguments arguments) {
-    uint32_t address = R(arguments.Rn);
-
-    if (arguments.P) {
-        if (arguments.U)
-            address += arguments.offset;
-        else
-            address -= arguments.offset;
+    uint32_t address = arguments.Rn == 15 ? arguments.PC + 8 : R(arguments.Rn);
+    uint32_t written_back_base = arguments.U ? address + arguments.offset : address - arguments.offset;
+    if (arguments.P)  // pre indexing
+        address = written_back_base;
+
+    addInternalCycles(1);
+    uint32_t value;
+    if (address & 0x1) {  // misaligned LDRSH loads the addressed byte sign-extended
+        value = dataRead8(address);
+        if (value & (1 << 7))
+            value |= 0xFFFFFF00;
     }
-
-    R(arguments.Rd) = memory.memory[address];
-    R(arguments.Rd) |= memory.memory[address + 1] << 8;
-    if (R(arguments.Rd) & (1 << 15))
-        R(arguments.Rd) |= 0xFFFF0000;
-    else
-        R(arguments.Rd) &= 0x0000FFFF;
-
-    if (arguments.W) {
-        if (arguments.U)
-            R(arguments.Rn) += arguments.offset;
-        else
-            R(arguments.Rn) -= arguments.offset;
+    else {
+        value = dataRead16(address);
+        if (value & (1 << 15))
+            value |= 0xFFFF0000;
     }
+
+    if (!arguments.P || arguments.W)
+        R(arguments.Rn) = written_back_base;
+    R(arguments.Rd) = value;
 }
 
 void GBA::CPU::callHalfWordAndSignedDataTransferInstruction(uint32_t instruction_code, uint32_t pc) {
-    if (!checkCondition(instruction_code))
-        return;
-
-    std::cout << "# Instruction type: Halfword Data Transfer\n";
     GBA::HalfWordAndSignedDataTransferArguments arguments =
         decodeHalfWordAndSignedDataTransferArguments(instruction_code, pc);
     if (arguments.L == 0b0)
@@ -1077,16 +1549,12 @@ void GBA::CPU::callHalfWordAndSignedDataTransferInstruction(uint32_t instruction
             ldrsbArm(arguments);
         else if (bits_S_H == 0b11)
             ldrshArm(arguments);
-        else
-            throw;  // 00 == SWP instruction like this should not exist
+        else  // a load with S and H clear is neither SWP nor a multiply, it is undefined
+            callUndefinedInstruction(instruction_code, pc);
     }
 }
 
 void GBA::CPU::callSingleDataSwapInstruction(uint32_t instruction_code, uint32_t pc) {
-    if (!checkCondition(instruction_code))
-        return;
-
-    std::cout << "# Instruction type: Single Data Swap\n";
     swpArm(instruction_code);
 }
 
@@ -1097,32 +1565,18 @@ void GBA::CPU::swpArm(uint32_t instruction_code) {
     uint32_t address = R(Rn);
     bool bit_22 = (instruction_code >> 22) & 0x1;
     uint32_t Rm_value = R(Rm);
+    addInternalCycles(1);
     if (bit_22) {
-        R(Rd) = memory.memory[address];
-    }
-    else {
-        R(Rd) = memory.memory[address];
-        R(Rd) |= memory.memory[address + 1] << 8;
-        R(Rd) |= memory.memory[address + 2] << 16;
-        R(Rd) |= memory.memory[address + 3] << 24;
-    }
-
-    if (bit_22) {
-        memory.memory[address] = Rm_value & 0xFF;
+        R(Rd) = dataRead8(address);
+        dataWrite8(address, Rm_value & 0xFF);
     }
     else {
-        memory.memory[address] = Rm_value & 0xFF;
-        memory.memory[address + 1] = (Rm_value >> 8) & 0xFF;
-        memory.memory[address + 2] = (Rm_value >> 16) & 0xFF;
-        memory.memory[address + 3] = (Rm_value >> 24) & 0xFF;
+        R(Rd) = dataRead32Rotated(address);
+        dataWrite32(address, Rm_value);
     }
 }
 
 void GBA::CPU::callBlockDataTransferInstruction(uint32_t instruction_code, uint32_t pc) {
-    if (!checkCondition(instruction_code))
-        return;
-
-    std::cout << "# Instruction type: Block Data Transfer\n";
     BlockDataTransferArguments arguments = decodeBlockDataTransferInstruction(instruction_code, pc);
     if (arguments.L == 0b1) {
         ldmArm(arguments);
@@ -1141,114 +1595,116 @@ GBA::BlockDataTransferArguments GBA::CPU::decodeBlockDataTransferInstruction(uin
     arguments.L = (instruction_code >> 20) & 0x1;     // Load/Store bit
     arguments.Rn = (instruction_code >> 16) & 0xF;    // Base register
     arguments.registers = instruction_code & 0xFFFF;  // Register list bitfield
+    arguments.PC = pc;
     return arguments;
 }
 
+namespace {
+
+// Registers are always transferred lowest first to the lowest address, returns that address and the written back base
+std::pair<uint32_t, uint32_t> getBlockDataTransferAddresses(const GBA::BlockDataTransferArguments& arguments, uint32_t base) {
+    uint32_t size = 0;
+    for (uint32_t i = 0; i < 16; i++) {
+        if ((arguments.registers & (0b1 << i)) != 0)
+            size += 4;
+    }
+    if (arguments.U)
+        return {arguments.P ? base + 4 : base, base + size};
+    return {arguments.P ? base - size : base - size + 4, base - size};
+}
+
+}
+
 void GBA::CPU::ldmArm(GBA::BlockDataTransferArguments arguments) {
-    uint32_t address = R(arguments.Rn) & 0xFFFFFFE0;  // address must be word-aligned
+    auto [address, written_back_base] = getBlockDataTransferAddresses(arguments, R(arguments.Rn));
+    if (arguments.W)
+        R(arguments.Rn) = written_back_base;  // a loaded base overwrites the written back value below
+    bool loads_pc = (arguments.registers & (0b1 << 15)) != 0;
+    // S without PC in the list transfers the User bank, with PC it restores CPSR after the load
+    bool user_bank = arguments.S == 0b1 && !loads_pc;
+    addInternalCycles(1);
     for (uint32_t i = 0; i < 15; i++) {
         if ((arguments.registers & (0b1 << i)) != 0) {
-            if (arguments.S == 0b0) {
-                R(i) = memory.memory[address];
-                R(i) |= memory.memory[address + 1] << 8;
-                R(i) |= memory.memory[address + 2] << 16;
-                R(i) |= memory.memory[address + 3] << 24;
-            }
-            else {
-                R_USRSYS(i) = memory.memory[address];
-                R_USRSYS(i) |= memory.memory[address + 1] << 8;
-                R_USRSYS(i) |= memory.memory[address + 2] << 16;
-                R_USRSYS(i) |= memory.memory[address + 3] << 24;
-            }
-            if (arguments.U == 0b1) {
-                address += 4;
-            }
-            else {
-                address -= 4;
-            }
+            if (!user_bank)
+                R(i) = dataRead32(address);
+            else
+                R_USRSYS(i) = dataRead32(address);
+            address += 4;
         }
     }
-    if ((arguments.registers & (0b1 << 15)) != 0) {
-        PC() = memory.memory[address];
-        PC() |= memory.memory[address + 1] << 8;
-        PC() |= memory.memory[address + 2] << 16;
-        PC() |= memory.memory[address + 3] << 24;
-        if (arguments.S == 0b1) {  // mode change
-            switch (getMode()) {
-            case Mode::User:
-            case Mode::System:
-                break;
-            case Mode::FastInterrupt:
-                CPSR = SPSR_FIQ;
-                break;
-            case Mode::Supervisor:
-                CPSR = SPSR_SVC;
-                break;
-            case Mode::Abort:
-                CPSR = SPSR_ABT;
-                break;
-            case Mode::Interrupt:
-                CPSR = SPSR_IRQ;
-                break;
-            case Mode::Undefined:
-                CPSR = SPSR_UND;
-                break;
-            default:
-                throw;
-            }
-        }
+    if (loads_pc) {
+        uint32_t value = dataRead32(address);
+        if (arguments.S == 0b1 && hasSPSR())
+            writeCPSR(SPSR());
+        // ARMv4 does not interwork on loads to PC, the ignored low bits are cleared
+        PC() = value & (inThumb() ? 0xFFFFFFFE : 0xFFFFFFFC);
     }
 }
 
 void GBA::CPU::stmArm(GBA::BlockDataTransferArguments arguments) {
-    uint32_t address = R(arguments.Rn) & 0xFFFFFFE0;  // check this
+    auto [address, written_back_base] = getBlockDataTransferAddresses(arguments, R(arguments.Rn));
+    bool first = true;
     for (uint32_t i = 0; i < 16; i++) {
         if ((arguments.registers & (0b1 << i)) != 0) {
-            if (arguments.S == 0b0) {
-                memory.memory[address] = R(i) & 0xFF;
-                memory.memory[address + 1] = (R(i) >> 8) & 0xFF;
-                memory.memory[address + 2] = (R(i) >> 16) & 0xFF;
-                memory.memory[address + 3] = (R(i) >> 24) & 0xFF;
-            }
-            else {  // User bank transfer
-                memory.memory[address] = R_USRSYS(i) & 0xFF;
-                memory.memory[address + 1] = (R_USRSYS(i) >> 8) & 0xFF;
-                memory.memory[address + 2] = (R_USRSYS(i) >> 16) & 0xFF;
-                memory.memory[address + 3] = (R_USRSYS(i) >> 24) & 0xFF;
-            }
-            if (arguments.U == 0b1) {
-                address += 4;
-            }
-            else {
-                address -= 4;
-            }
+            uint32_t value = arguments.S == 0b0 ? R(i) : R_USRSYS(i);  // S selects the User bank
+            if (i == 15)  // a stored PC is the instruction address + 12
+                value = arguments.PC + 12;
+            // the base is written back after the first transfer, it is stored unchanged only if it comes first
+            if (i == arguments.Rn && arguments.W && !first)
+                value = written_back_base;
+            dataWrite32(address, value);
+            address += 4;
+            first = false;
         }
     }
+    if (arguments.W)
+        R(arguments.Rn) = written_back_base;
 }
 
 void GBA::CPU::callSoftwareInterruptInstruction(uint32_t instruction_code, uint32_t pc) {
-    std::cout << "# Instruction type: Software Interrupt\n";
-    LR(Mode::Supervisor) = pc + 4;
-    PC() = 0x08;
-    SPSR_SVC = CPSR;
-    setMode(Mode::Supervisor);
+    uint32_t bios_cycles;
+    if (hle_bios && BIOS::call(*this, (instruction_code >> 16) & 0xFF, bios_cycles)) {
+        addInternalCycles(bios_cycles);
+        return;
+    }
+    enterException(Mode::Supervisor, 0x08, pc + 4);
+}
+
+void GBA::CPU::takeInterrupt() {
+    // the handler returns with SUBS PC, LR, #4 to the instruction that would have run next
+    enterException(Mode::Interrupt, 0x18, PC() + 4);
+    total_cycles += memory.getFetchCycles<uint32_t>(0x18, false) + memory.getFetchCycles<uint32_t>(0x1C, true);
+}
+
+void GBA::CPU::enterException(Mode mode, uint32_t vector, uint32_t return_address) {
+    uint32_t cpsr = getCPSR();
+    setMode(mode);
+    SPSR() = cpsr;
+    R(14) = return_address;
+    // exceptions are handled in ARM state with IRQs disabled
+    writeCPSR((getCPSR() & ~0x20u) | 0x80);
+    PC() = vector;
+}
+
+void GBA::CPU::callUndefinedInstruction(uint32_t instruction_code, uint32_t pc) {
+    // the handler returns with MOVS PC, LR to the instruction after the undefined one
+    enterException(Mode::Undefined, 0x04, pc + 4);
 }
 
 void GBA::CPU::bxArm(uint32_t instruction_code) {
     uint32_t Rn = R(instruction_code & 0xF);
-    PC() = Rn;
     // Check: Arm or Thumb
-    if (Rn & 0x1)
+    if (Rn & 0x1) {
         CPSR |= (1 << 5);
-    else
+        PC() = Rn & 0xFFFFFFFE;
+    }
+    else {
         CPSR &= ~(1 << 5);
+        PC() = Rn & 0xFFFFFFFC;
+    }
 }
 
 void GBA::CPU::callBranchAndExchangeInstruction(uint32_t instruction_code, uint32_t pc) {
-    if (!checkCondition(instruction_code))
-        return;
-
-    std::cout << "# Instruction type: Branch Exchange\n";
     bxArm(instruction_code);
 }
 
@@ -1270,10 +1726,6 @@ void GBA::CPU::bArm(uint32_t instruction_code, uint32_t pc) {
 }
 
 void GBA::CPU::callBranchInstruction(uint32_t instruction_code, uint32_t pc) {
-    if (!checkCondition(instruction_code))
-        return;
-
-    std::cout << "# Instruction type: Branch\n";
     if ((instruction_code >> 24) & 0b1) {
         blArm(instruction_code, pc);
     }
@@ -1282,7 +1734,7 @@ void GBA::CPU::callBranchInstruction(uint32_t instruction_code, uint32_t pc) {
     }
 }
 
-GBA::ThumbInstructionType GBA::CPU::decodeThumb(uint16_t instruction_code) {
+constexpr GBA::ThumbInstructionType decodeThumbInstructionType(uint16_t instruction_code) {
     if (isAddSubstractThumb(instruction_code))
         return GBA::ThumbInstructionType::AddSubtract;
     if (isMoveShiftedRegisterThumb(instruction_code))
@@ -1325,6 +1777,79 @@ GBA::ThumbInstructionType GBA::CPU::decodeThumb(uint16_t instruction_code) {
     return GBA::ThumbInstructionType::Undefined;
 }
 
+GBA::ThumbInstructionType GBA::CPU::decodeThumb(uint16_t instruction_code) {
+    return decodeThumbInstructionType(instruction_code);
+}
+
+namespace {
+
+constexpr GBA::CPU::ThumbInstructionHandler thumbInstructionHandler(GBA::ThumbInstructionType instruction_type) {
+    using GBA::CPU;
+    using GBA::ThumbInstructionType;
+    switch (instruction_type) {
+    case ThumbInstructionType::MoveShiftedRegister:
+        return &CPU::callMoveShiftedRegisterThumbInstruction;
+    case ThumbInstructionType::AddSubtract:
+        return &CPU::callAddSubtractThumbInstruction;
+    case ThumbInstructionType::MoveCompareAddSubtractImmediate:
+        return &CPU::callMoveCompareAddSubtractImmediateThumbInstruction;
+    case ThumbInstructionType::ALUOperation:
+        return &CPU::callALUOperationThumbInstruction;
+    case ThumbInstructionType::HighRegisterOperationBranchExchange:
+        return &CPU::callHiRegisterOperationBranchExchangeInstruction;
+    case ThumbInstructionType::PCRelativeLoad:
+        return &CPU::callPCRelativeLoad;
+    case ThumbInstructionType::LoadStoreRegOffset:
+        return &CPU::callLoadStoreRegOffset;
+    case ThumbInstructionType::LoadStoreSignByteHalfword:
+        return &CPU::callLoadStoreSignExtendedByteHalfword;
+    case ThumbInstructionType::LoadStoreImmediateOffset:
+        return &CPU::callLoadStoreImmediateOffset;
+    case ThumbInstructionType::LoadStoreHalfword:
+        return &CPU::callLoadStoreHalfword;
+    case ThumbInstructionType::SPRelativeLoadStore:
+        return &CPU::callSPRelativeLoadStore;
+    case ThumbInstructionType::LoadAddress:
+        return &CPU::callLoadAddress;
+    case ThumbInstructionType::AddOffsetToStackPointer:
+        return &CPU::callAddOffsetToStackPointer;
+    case ThumbInstructionType::PushPopRegisters:
+        return &CPU::callPushPopRegisters;
+    case ThumbInstructionType::MultipleLoadStore:
+        return &CPU::callMultipleLoadStore;
+    case ThumbInstructionType::ConditionalBranch:
+        return &CPU::callConditionalBranch;
+    case ThumbInstructionType::SoftwareInterrupt:
+        return &CPU::callSoftwareInterruptThumb;
+    case ThumbInstructionType::UnconditionalBranch:
+        return &CPU::callUnconitionalBranch;
+    case ThumbInstructionType::LongBranchLink:
+        return &CPU::callLongBranchLink;
+    case ThumbInstructionType::Undefined:
+    default:
+        return &CPU::callUndefinedThumbInstruction;
+    }
+}
+
+constexpr std::array<GBA::CPU::ThumbInstructionHandler, 1024> makeThumbInstructionTable() {
+    std::array<GBA::CPU::ThumbInstructionHandler, 1024> table{};
+    for (uint32_t index = 0; index < table.size(); index++)
+        table[index] = thumbInstructionHandler(decodeThumbInstructionType(static_cast<uint16_t>(index << 6)));
+    return table;
+}
+
+constexpr std::array<GBA::CPU::ThumbInstructionHandler, 1024> generated_thumb_instruction_table =
+    makeThumbInstructionTable();
+
+}
+
+GBA::CPU::ThumbInstructionHandler GBA::CPU::getThumbInstructionHandler(ThumbInstructionType instruction_type) {
+    return thumbInstructionHandler(instruction_type);
+}
+
+const std::array<GBA::CPU::ThumbInstructionHandler, 1024> GBA::CPU::thumb_instruction_table =
+    generated_thumb_instruction_table;
+
 GBA::MoveShifterRegisterThumbArguments GBA::CPU::decodeMoveShiftedRegisterThumbArguments(uint16_t instruction_code) {
     GBA::MoveShifterRegisterThumbArguments arguments;
     arguments.Rd = instruction_code & 0x7;
@@ -1404,9 +1929,9 @@ void GBA::CPU::subThumb(AddSubtractThumbArguments arguments) {
 void GBA::CPU::callAddSubtractThumbInstruction(uint16_t instruction_code) {
     AddSubtractThumbArguments arguments = decodeAddSubtractThumbArguments(instruction_code);
     if (arguments.op)
-        addThumb(arguments);
-    else
         subThumb(arguments);
+    else
+        addThumb(arguments);
 }
 
 GBA::MoveCompareAddSubtractImmediateThumbArguments
@@ -1479,19 +2004,19 @@ void GBA::CPU::xorThumb(ALUoperationThumbArguments arguments) {
 
 void GBA::CPU::lslThumb(ALUoperationThumbArguments arguments) {
     DataProcessingArguments data_processing_arguments(
-        1, arguments.Rd, 0, R(arguments.Rd), R(arguments.Rs), GBA::ShiftType::LogicalLeft, PC());
+        1, arguments.Rd, 0, R(arguments.Rd), R(arguments.Rs) & 0xFF, GBA::ShiftType::LogicalLeft, PC(), true);
     movArm(data_processing_arguments);
 }
 
 void GBA::CPU::lsrThumb(ALUoperationThumbArguments arguments) {
     DataProcessingArguments data_processing_arguments(
-        1, arguments.Rd, 0, R(arguments.Rd), R(arguments.Rs), GBA::ShiftType::LogicalRight, PC());
+        1, arguments.Rd, 0, R(arguments.Rd), R(arguments.Rs) & 0xFF, GBA::ShiftType::LogicalRight, PC(), true);
     movArm(data_processing_arguments);
 }
 
 void GBA::CPU::asrThumb(ALUoperationThumbArguments arguments) {
     DataProcessingArguments data_processing_arguments(
-        1, arguments.Rd, 0, R(arguments.Rd), R(arguments.Rs), GBA::ShiftType::ArithmeticRight, PC());
+        1, arguments.Rd, 0, R(arguments.Rd), R(arguments.Rs) & 0xFF, GBA::ShiftType::ArithmeticRight, PC(), true);
     movArm(data_processing_arguments);
 }
 
@@ -1509,7 +2034,7 @@ void GBA::CPU::sbcThumb(ALUoperationThumbArguments arguments) {
 
 void GBA::CPU::rorThumb(ALUoperationThumbArguments arguments) {
     DataProcessingArguments data_processing_arguments(
-        1, arguments.Rd, 0, R(arguments.Rd), R(arguments.Rs), GBA::ShiftType::RotateRight, PC());
+        1, arguments.Rd, 0, R(arguments.Rd), R(arguments.Rs) & 0xFF, GBA::ShiftType::RotateRight, PC(), true);
     movArm(data_processing_arguments);
 }
 
@@ -1609,6 +2134,11 @@ GBA::HiRegisterOperationsBranchExchangeArguments
     return arguments;
 }
 
+uint32_t GBA::CPU::readHiRegister(uint32_t index) {
+    // PC already points past the instruction
+    return index == 15 ? PC() + 2 : R(index);
+}
+
 void GBA::CPU::addHiRegisterOperationBranchExchange(HiRegisterOperationsBranchExchangeArguments arguments) {
     uint32_t source_number, destination_number;
     if (arguments.H1)
@@ -1621,7 +2151,11 @@ void GBA::CPU::addHiRegisterOperationBranchExchange(HiRegisterOperationsBranchEx
     else
         destination_number = arguments.Rd;
 
-    R(destination_number) += R(source_number);
+    uint32_t result = readHiRegister(destination_number) + readHiRegister(source_number);
+    if (destination_number == 15)
+        PC() = result & 0xFFFFFFFE;
+    else
+        R(destination_number) = result;
 }
 
 void GBA::CPU::cmpHiRegisterOperationBranchExchange(HiRegisterOperationsBranchExchangeArguments arguments) {
@@ -1636,8 +2170,7 @@ void GBA::CPU::cmpHiRegisterOperationBranchExchange(HiRegisterOperationsBranchEx
     else
         destination_number = arguments.Rd;
 
-    DataProcessingArguments data_processing_arguments(
-        1, 0, destination_number, R(source_number), 0, GBA::ShiftType::LogicalLeft, PC());
+    setAddFlags(readHiRegister(destination_number), ~readHiRegister(source_number), 1);
 }
 
 void GBA::CPU::movHiRegisterOperationBranchExchange(HiRegisterOperationsBranchExchangeArguments arguments) {
@@ -1652,7 +2185,11 @@ void GBA::CPU::movHiRegisterOperationBranchExchange(HiRegisterOperationsBranchEx
     else
         destination_number = arguments.Rd;
 
-    R(destination_number) = R(source_number);
+    uint32_t result = readHiRegister(source_number);
+    if (destination_number == 15)
+        PC() = result & 0xFFFFFFFE;
+    else
+        R(destination_number) = result;
 }
 
 void GBA::CPU::bxHiRegisterOperationBranchExchange(HiRegisterOperationsBranchExchangeArguments arguments) {
@@ -1662,7 +2199,16 @@ void GBA::CPU::bxHiRegisterOperationBranchExchange(HiRegisterOperationsBranchExc
     else
         source_number = arguments.Rs;
 
-    bxArm(R(source_number));
+    // BX PC is only meant to be used from word aligned addresses, the target is the aligned PC + 4
+    uint32_t target = source_number == 15 ? readHiRegister(15) & 0xFFFFFFFC : readHiRegister(source_number);
+    if (target & 0x1) {
+        CPSR |= (1 << 5);
+        PC() = target & 0xFFFFFFFE;
+    }
+    else {
+        CPSR &= ~(1 << 5);
+        PC() = target & 0xFFFFFFFC;
+    }
 }
 
 void GBA::CPU::callHiRegisterOperationBranchExchangeInstruction(uint16_t instruction_code) {
@@ -1680,6 +2226,15 @@ void GBA::CPU::callHiRegisterOperationBranchExchangeInstruction(uint16_t instruc
         return;  // TODO: invalid op error handling
 }
 
+void GBA::CPU::callPCRelativeLoad(uint16_t instruction_code) {
+    uint32_t Rd = (instruction_code >> 8) & 0x7;
+    uint32_t offset = (instruction_code & 0xFF) << 2;
+    // PC reads as the instruction address + 4 with bit 1 forced to 0
+    uint32_t address = ((PC() + 2) & 0xFFFFFFFC) + offset;
+    R(Rd) = dataRead32(address);
+    addInternalCycles(1);
+}
+
 GBA::LoadStoreRegOffsetArguments GBA::CPU::decodeLoadStoreRegOffsetArguments(uint16_t instruction_code) {
     LoadStoreRegOffsetArguments arguments;
     arguments.Rd = instruction_code & 0x7;
@@ -1703,11 +2258,10 @@ GBA::LoadStoreImmediateOffsetArguments GBA::CPU::decodeLoadStoreImmediateOffsetA
     LoadStoreImmediateOffsetArguments arguments;
     arguments.Rd = instruction_code & 0x7;
     arguments.Rb = (instruction_code >> 3) & 0x7;
-    arguments.offset =
-        (instruction_code >> 6) & 0x1F;  // not sure because these instructions transfer byte or word values between
-                                         // registers and memory using an immediate 5 or 7-bit offset.
     arguments.L = (instruction_code >> 11) & 0x1;
     arguments.B = (instruction_code >> 12) & 0x1;
+    // 5-bit offset for bytes, 7-bit word aligned offset for words
+    arguments.offset = ((instruction_code >> 6) & 0x1F) << (arguments.B ? 0 : 2);
     return arguments;
 }
 
@@ -1721,27 +2275,18 @@ void GBA::CPU::callLoadStoreImmediateOffset(uint16_t instruction_code) {
 }
 
 void GBA::CPU::ldrThumb(uint32_t address, uint32_t Rd, bool B) {
-    if (B) {
-        R(Rd) = memory.memory[address];
-    }
-    else {
-        R(Rd) = memory.memory[address];
-        R(Rd) |= memory.memory[address + 1] << 8;
-        R(Rd) |= memory.memory[address + 2] << 16;
-        R(Rd) |= memory.memory[address + 3] << 24;
-    }
+    addInternalCycles(1);
+    if (B)
+        R(Rd) = dataRead8(address);
+    else
+        R(Rd) = dataRead32Rotated(address);
 }
 
 void GBA::CPU::strThumb(uint32_t address, uint32_t Rd, bool B) {
-    if (B) {
-        memory.memory[address] = R(Rd) & 0xFF;
-    }
-    else {
-        memory.memory[address] = R(Rd) & 0xFF;
-        memory.memory[address + 1] = (R(Rd) >> 8) & 0xFF;
-        memory.memory[address + 2] = (R(Rd) >> 16) & 0xFF;
-        memory.memory[address + 3] = (R(Rd) >> 24) & 0xFF;
-    }
+    if (B)
+        dataWrite8(address, R(Rd) & 0xFF);
+    else
+        dataWrite32(address, R(Rd));
 }
 
 GBA::LoadStoreSignExtendedByteHalfwordArguments
@@ -1758,26 +2303,25 @@ GBA::LoadStoreSignExtendedByteHalfwordArguments
 void GBA::CPU::callLoadStoreSignExtendedByteHalfword(uint16_t instruction_code) {
     LoadStoreSignExtendedByteHalfwordArguments arguments =
         decodeLoadStoreSignExtendedByteHalfwordArguments(instruction_code);
-    uint32_t address = R(arguments.Rb) + R(arguments.Ro);
     uint32_t S_H = arguments.S << 1 | arguments.H;
     if (S_H == 0b00) {
         HalfWordAndSignedDataTransferArguments halfword_arguments(
-            0, 0, 0, 0, arguments.S, arguments.H, arguments.Rb, arguments.Rd, arguments.Ro, PC());
+            1, 1, 0, 0, arguments.S, arguments.H, arguments.Rb, arguments.Rd, R(arguments.Ro), PC());
         strhArm(halfword_arguments);
     }
     else if (S_H == 0b01) {
         HalfWordAndSignedDataTransferArguments halfword_arguments(
-            0, 0, 0, 1, arguments.S, arguments.H, arguments.Rb, arguments.Rd, arguments.Ro, PC());
+            1, 1, 0, 1, arguments.S, arguments.H, arguments.Rb, arguments.Rd, R(arguments.Ro), PC());
         ldrhArm(halfword_arguments);
     }
     else if (S_H == 0b10) {
         HalfWordAndSignedDataTransferArguments halfword_arguments(
-            0, 0, 0, 1, arguments.S, arguments.H, arguments.Rb, arguments.Rd, arguments.Ro, PC());
+            1, 1, 0, 1, arguments.S, arguments.H, arguments.Rb, arguments.Rd, R(arguments.Ro), PC());
         ldrsbArm(halfword_arguments);
     }
     else if (S_H == 0b11) {
         HalfWordAndSignedDataTransferArguments halfword_arguments(
-            0, 0, 0, 1, arguments.S, arguments.H, arguments.Rb, arguments.Rd, arguments.Ro, PC());
+            1, 1, 0, 1, arguments.S, arguments.H, arguments.Rb, arguments.Rd, R(arguments.Ro), PC());
         ldrshArm(halfword_arguments);
     }
     else
@@ -1788,10 +2332,9 @@ GBA::LoadStoreHalfwordArguments GBA::CPU::decodeLoadStoreHalfwordArguments(uint1
     LoadStoreHalfwordArguments arguments;
     arguments.Rd = instruction_code & 0x7;
     arguments.Rb = (instruction_code >> 3) & 0x7;
-    arguments.offset =
-        (instruction_code >> 6) &
-        0x1F << 1;  //#Imm is a full 6-bit address but must be halfword-aligned (ie with bit 0 set to 0) since
-                    // the assembler places #Imm >> 1 in the Offset5
+    arguments.offset = ((instruction_code >> 6) & 0x1F)
+                       << 1;  //#Imm is a full 6-bit address but must be halfword-aligned (ie with bit 0 set to 0)
+                              // since the assembler places #Imm >> 1 in the Offset5
     arguments.L = (instruction_code >> 11) & 0x1;
     return arguments;
 }
@@ -1800,13 +2343,11 @@ void GBA::CPU::callLoadStoreHalfword(uint16_t instruction_code) {
     LoadStoreHalfwordArguments arguments = decodeLoadStoreHalfwordArguments(instruction_code);
     uint32_t address = R(arguments.Rb) + arguments.offset;
     if (arguments.L) {
-        R(arguments.Rd) = memory.memory[address];
-        R(arguments.Rd) |= memory.memory[address + 1] << 8;
-    }
-    else {
-        memory.memory[address] = R(arguments.Rd) & 0xFF;
-        memory.memory[address + 1] = (R(arguments.Rd) >> 8) & 0xFF;
+        R(arguments.Rd) = dataRead16Rotated(address);
+        addInternalCycles(1);
     }
+    else
+        dataWrite16(address, R(arguments.Rd) & 0xFFFF);
 }
 
 GBA::SPRelativeLoadStoreArguments GBA::CPU::decodeSPRelativeLoadStoreArguments(uint16_t instruction_code) {
@@ -1819,7 +2360,7 @@ GBA::SPRelativeLoadStoreArguments GBA::CPU::decodeSPRelativeLoadStoreArguments(u
 
 void GBA::CPU::callSPRelativeLoadStore(uint16_t instruction_code) {
     SPRelativeLoadStoreArguments arguments = decodeSPRelativeLoadStoreArguments(instruction_code);
-    uint32_t address = SP(getMode()) + arguments.offset;  // TODO: check if SP is correct register in thumb mode
+    uint32_t address = R(13) + arguments.offset;
     if (arguments.L) {
         ldrThumb(address, arguments.Rd, 0);
     }
@@ -1839,23 +2380,22 @@ GBA::LoadAddressArguments GBA::CPU::decodeLoadAddressArguments(uint16_t instruct
 void GBA::CPU::callLoadAddress(uint16_t instruction_code) {
     LoadAddressArguments arguments = decodeLoadAddressArguments(instruction_code);
     if (arguments.SP) {
-        R(arguments.Rd) = SP(getMode()) + arguments.offset;  // TODO: check if SP is correct register in thumb mode
+        R(arguments.Rd) = R(13) + arguments.offset;
     }
     else {
-        R(arguments.Rd) = PC() & 0xFFFFFFFD;  // it 1 of the PC is always read as 0.
+        R(arguments.Rd) = (PC() + 2) & 0xFFFFFFFC;  // bit 1 of the PC is always read as 0
         R(arguments.Rd) += arguments.offset;
     }
 }
 
 void GBA::CPU::callAddOffsetToStackPointer(uint16_t instruction_code) {
-    uint32_t offset = (instruction_code & 0xFF);
+    // bit 7 is the sign, bits 6-0 the magnitude of the word offset
+    uint32_t offset = (instruction_code & 0x7F) << 2;
     bool S = (instruction_code >> 7) & 0x1;
-    int32_t signed_offset = (S << 7) | offset;
-
     if (S)
-        signed_offset |= ~0xFF;  // extend sign bit
-
-    SP(getMode()) += signed_offset << 2;
+        R(13) -= offset;
+    else
+        R(13) += offset;
 }
 
 GBA::PushPopRegistersArguments GBA::CPU::decodePushPopRegistersArguments(uint16_t instruction_code) {
@@ -1876,12 +2416,12 @@ void GBA::CPU::callPushPopRegisters(uint16_t instruction_code) {
         register_list |= 0x8000;  // set PC
     }
 
-    if (arguments.L) {
-        BlockDataTransferArguments block_arguments(0, 0, 0, 1, 1, 13, register_list, PC());
+    if (arguments.L) {  // POP is LDMIA SP!
+        BlockDataTransferArguments block_arguments(0, 1, 0, 1, 1, 13, register_list, PC());
         ldmArm(block_arguments);
     }
-    else {
-        BlockDataTransferArguments block_arguments(0, 0, 0, 1, 0, 13, register_list, PC());
+    else {  // PUSH is STMDB SP!
+        BlockDataTransferArguments block_arguments(1, 0, 0, 1, 0, 13, register_list, PC());
         stmArm(block_arguments);
     }
 }
@@ -1890,476 +2430,231 @@ void GBA::CPU::callMultipleLoadStore(uint16_t instruction_code) {
     bool L = (instruction_code >> 11) & 0x1;
     uint32_t Rlist = instruction_code & 0xFF;
     uint32_t Rb = (instruction_code >> 8) & 0x7;
-    if (L) {
-        BlockDataTransferArguments block_arguments(0, 0, 0, 1, 1, Rb, Rlist, PC());
+    // LDMIA/STMIA Rb!
+    BlockDataTransferArguments block_arguments(0, 1, 0, 1, L, Rb, Rlist, PC());
+    if (L)
         ldmArm(block_arguments);
-    }
-    else {
-        BlockDataTransferArguments block_arguments(0, 0, 0, 1, 0, Rb, Rlist, PC());
+    else
         stmArm(block_arguments);
-    }
 }
 
+// Thumb branch offsets are relative to the instruction address + 4, PC already points 2 bytes past the instruction
+
 void GBA::CPU::callConditionalBranch(uint16_t instruction_code) {
-    uint32_t offset = instruction_code & 0xFF;
+    int32_t offset = static_cast<int8_t>(instruction_code & 0xFF) * 2;
     uint32_t condition = (instruction_code >> 8) & 0xF;
-    if (checkCondition(condition)) {
-        PC() += offset << 1;
-        PC() -= 4;  // TODO check if correct I think it is because PC is 4 bytes ahead due to prefetch
-    }
+    if (checkCondition(condition << 28))
+        PC() += 2 + offset;
 }
 
 void GBA::CPU::callUnconitionalBranch(uint16_t instruction_code) {
-    uint32_t offset = instruction_code & 0x7FF;
-    PC() += offset << 1;
-    PC() -= 4;  // TODO check if correct I think it is because PC is 4 bytes ahead due to prefetch
+    int32_t offset = instruction_code & 0x7FF;
+    if (offset & 0x400)  // sign extend the 11-bit offset
+        offset -= 0x800;
+    PC() += 2 + offset * 2;
 }
 
 void GBA::CPU::callLongBranchLink(uint16_t instruction_code) {
-    uint32_t offset = instruction_code & 0x7FF;
+    int32_t offset = instruction_code & 0x7FF;
     uint32_t H = (instruction_code >> 11) & 0x1;
-    if (H) {
-        LR(getMode()) = offset << 1;
-        uint32_t current_PC = PC();
-        PC() = LR(getMode());
-        LR(getMode()) = current_PC;  // there should be an address of the next instruction after the BL instruction
-        LR(getMode()) |=
-            0x00000001;  // he address of the instruction following the BL is placed in LR and bit 0 of LR is set.
-    }
-}
-
-uint32_t& GBA::CPU::SP(GBA::CPU::Mode mode) {
-    if (mode == GBA::CPU::Mode::User || mode == GBA::CPU::Mode::System) {
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::SP)];
-    }
-    else if (mode == GBA::CPU::Mode::FastInterrupt) {
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::SP_FIQ)];
-    }
-    else if (mode == GBA::CPU::Mode::Supervisor) {
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::SP_SVC)];
-    }
-    else if (mode == GBA::CPU::Mode::Abort) {
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::SP_ABT)];
-    }
-    else if (mode == GBA::CPU::Mode::Interrupt) {
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::SP_IRQ)];
-    }
-    else if (mode == GBA::CPU::Mode::Undefined) {
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::SP_UND)];
-    }
-    // TODO: invalid mode error handling
-    throw;
-}
-
-const uint32_t& GBA::CPU::SP(GBA::CPU::Mode mode) const {
-    if (mode == GBA::CPU::Mode::User || mode == GBA::CPU::Mode::System) {
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::SP)];
-    }
-    else if (mode == GBA::CPU::Mode::FastInterrupt) {
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::SP_FIQ)];
-    }
-    else if (mode == GBA::CPU::Mode::Supervisor) {
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::SP_SVC)];
-    }
-    else if (mode == GBA::CPU::Mode::Abort) {
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::SP_ABT)];
-    }
-    else if (mode == GBA::CPU::Mode::Interrupt) {
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::SP_IRQ)];
-    }
-    else if (mode == GBA::CPU::Mode::Undefined) {
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::SP_UND)];
-    }
-    // TODO: invalid mode error handling
-    throw;
-}
-
-uint32_t& GBA::CPU::LR(GBA::CPU::Mode mode) {
-    if (mode == GBA::CPU::Mode::User || mode == GBA::CPU::Mode::System) {
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::LR)];
-    }
-    else if (mode == GBA::CPU::Mode::FastInterrupt) {
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::LR_FIQ)];
-    }
-    else if (mode == GBA::CPU::Mode::Supervisor) {
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::LR_SVC)];
-    }
-    else if (mode == GBA::CPU::Mode::Abort) {
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::LR_ABT)];
-    }
-    else if (mode == GBA::CPU::Mode::Interrupt) {
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::LR_IRQ)];
+    if (!H) {
+        // first half, the high part of the offset is added to the PC and kept in LR
+        if (offset & 0x400)
+            offset -= 0x800;
+        R(14) = PC() + 2 + (offset << 12);
     }
-    else if (mode == GBA::CPU::Mode::Undefined) {
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::LR_UND)];
+    else {
+        // second half, branch and leave the address of the next instruction in LR with bit 0 set
+        uint32_t next_instruction = PC();
+        PC() = (R(14) + (offset << 1)) & 0xFFFFFFFE;
+        R(14) = next_instruction | 0x1;
     }
-    // TODO: invalid mode error handling
-    throw;
 }
 
-const uint32_t& GBA::CPU::LR(GBA::CPU::Mode mode) const {
-    if (mode == GBA::CPU::Mode::User || mode == GBA::CPU::Mode::System) {
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::LR)];
-    }
-    else if (mode == GBA::CPU::Mode::FastInterrupt) {
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::LR_FIQ)];
-    }
-    else if (mode == GBA::CPU::Mode::Supervisor) {
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::LR_SVC)];
-    }
-    else if (mode == GBA::CPU::Mode::Abort) {
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::LR_ABT)];
-    }
-    else if (mode == GBA::CPU::Mode::Interrupt) {
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::LR_IRQ)];
-    }
-    else if (mode == GBA::CPU::Mode::Undefined) {
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::LR_UND)];
+void GBA::CPU::callSoftwareInterruptThumb(uint16_t instruction_code) {
+    uint32_t bios_cycles;
+    if (hle_bios && BIOS::call(*this, instruction_code & 0xFF, bios_cycles)) {
+        addInternalCycles(bios_cycles);
+        return;
     }
-    // TODO: invalid mode error handling
-    throw;
+    enterException(Mode::Supervisor, 0x08, PC());
 }
 
-uint32_t& GBA::CPU::PC() {
-    return registers[static_cast<int>(GBA::CPU::RegisterIndex::PC)];
+void GBA::CPU::callUndefinedThumbInstruction(uint16_t instruction_code) {
+    // PC already points to the next instruction, which is where the handler returns to
+    enterException(Mode::Undefined, 0x04, PC());
 }
 
-const uint32_t& GBA::CPU::PC() const {
-    return registers[static_cast<int>(GBA::CPU::RegisterIndex::PC)];
-}
-
-uint32_t& GBA::CPU::R(uint32_t index) {
-    switch (getMode()) {
+int GBA::CPU::getRegisterSlot(Mode mode, uint32_t index) {
+    if (index < 8 || index == 15)
+        return index;
+    if (mode == Mode::FastInterrupt)
+        return static_cast<int>(RegisterIndex::R8_FIQ) + (index - 8);
+    if (index < 13)
+        return index;
+    switch (mode) {
     case Mode::User:
     case Mode::System:
-        return R_USRSYS(index);
-    case Mode::FastInterrupt:
-        return R_FIQ(index);
+        return index;
     case Mode::Supervisor:
-        return R_SVC(index);
+        return static_cast<int>(RegisterIndex::R13_SVC) + (index - 13);
     case Mode::Abort:
-        return R_ABT(index);
+        return static_cast<int>(RegisterIndex::R13_ABT) + (index - 13);
     case Mode::Interrupt:
-        return R_IRQ(index);
+        return static_cast<int>(RegisterIndex::R13_IRQ) + (index - 13);
     case Mode::Undefined:
-        return R_UND(index);
+        return static_cast<int>(RegisterIndex::R13_UND) + (index - 13);
     default:
+        // TODO: invalid mode error handling
         throw;
     }
 }
 
-const uint32_t& GBA::CPU::R(uint32_t index) const {
-    switch (getMode()) {
-    case Mode::User:
-    case Mode::System:
-        return R_USRSYS(index);
+uint32_t& GBA::CPU::bankedRegister(Mode mode, uint32_t index) {
+    int slot = getRegisterSlot(mode, index);
+    // registers of the bank in use live in the active register file, their slots in registers are stale
+    if (slot == getRegisterSlot(bank_mode, index))
+        return active_registers[index];
+    return registers[slot];
+}
+
+const uint32_t& GBA::CPU::bankedRegister(Mode mode, uint32_t index) const {
+    int slot = getRegisterSlot(mode, index);
+    if (slot == getRegisterSlot(bank_mode, index))
+        return active_registers[index];
+    return registers[slot];
+}
+
+void GBA::CPU::switchBank(Mode mode) {
+    for (uint32_t i = 8; i < 15; i++) {
+        registers[getRegisterSlot(bank_mode, i)] = active_registers[i];
+        active_registers[i] = registers[getRegisterSlot(mode, i)];
+    }
+    bank_mode = mode;
+    switch (mode) {
     case Mode::FastInterrupt:
-        return R_FIQ(index);
+        spsr = &SPSR_FIQ;
+        break;
     case Mode::Supervisor:
-        return R_SVC(index);
+        spsr = &SPSR_SVC;
+        break;
     case Mode::Abort:
-        return R_ABT(index);
+        spsr = &SPSR_ABT;
+        break;
     case Mode::Interrupt:
-        return R_IRQ(index);
+        spsr = &SPSR_IRQ;
+        break;
     case Mode::Undefined:
-        return R_UND(index);
+        spsr = &SPSR_UND;
+        break;
     default:
-        throw;
+        spsr = nullptr;
+        break;
     }
 }
 
-uint32_t& GBA::CPU::R_USRSYS(uint32_t index) {
-    // TODO: error handling
-    if (index > 15) {
-        throw;
+uint32_t GBA::CPU::getFlags() const {
+    switch (flags_operation) {
+    case FlagsOperation::Logical:
+        return (flags_result & 0x80000000) | (static_cast<uint32_t>(flags_result == 0) << 30) |
+               (static_cast<uint32_t>(flags_carry) << 29) | (CPSR & 0x10000000);
+    case FlagsOperation::Add: {
+        uint64_t wide_result = static_cast<uint64_t>(flags_operand1) + flags_operand2 + flags_carry;
+        uint32_t result = static_cast<uint32_t>(wide_result);
+        uint32_t overflow = (~(flags_operand1 ^ flags_operand2) & (flags_operand1 ^ result)) >> 31;
+        return (result & 0x80000000) | (static_cast<uint32_t>(result == 0) << 30) |
+               (static_cast<uint32_t>(wide_result >> 32) << 29) | (overflow << 28);
+    }
+    default:
+        return CPSR & 0xF0000000;
     }
-    return registers[index];
 }
 
-const uint32_t& GBA::CPU::R_USRSYS(uint32_t index) const {
-    // TODO: error handling
-    if (index > 15) {
-        throw;
+bool GBA::CPU::getCarryFlag() const {
+    switch (flags_operation) {
+    case FlagsOperation::Logical:
+        return flags_carry;
+    case FlagsOperation::Add:
+        return (static_cast<uint64_t>(flags_operand1) + flags_operand2 + flags_carry) >> 32;
+    default:
+        return (CPSR >> 29) & 0x1;
     }
-    return registers[index];
+}
+
+void GBA::CPU::resolveFlags() {
+    CPSR = (CPSR & 0x0FFFFFFF) | getFlags();
+    flags_operation = FlagsOperation::None;
+}
+
+void GBA::CPU::writeCPSR(uint32_t value) {
+    bool mode_changed = ((CPSR ^ value) & 0x1F) != 0;
+    flags_operation = FlagsOperation::None;
+    CPSR = value;
+    if (mode_changed)
+        switchBank(getMode());
+    memory.setIRQDisabled(CPSR & 0x80);
+}
+
+uint32_t& GBA::CPU::SP(GBA::CPU::Mode mode) {
+    return bankedRegister(mode, 13);
+}
+
+const uint32_t& GBA::CPU::SP(GBA::CPU::Mode mode) const {
+    return bankedRegister(mode, 13);
+}
+
+uint32_t& GBA::CPU::LR(GBA::CPU::Mode mode) {
+    return bankedRegister(mode, 14);
+}
+
+const uint32_t& GBA::CPU::LR(GBA::CPU::Mode mode) const {
+    return bankedRegister(mode, 14);
+}
+
+uint32_t& GBA::CPU::R_USRSYS(uint32_t index) {
+    return bankedRegister(Mode::User, index);
+}
+
+const uint32_t& GBA::CPU::R_USRSYS(uint32_t index) const {
+    return bankedRegister(Mode::User, index);
 }
 
 uint32_t& GBA::CPU::R_FIQ(uint32_t index) {
-    switch (index) {
-    case 15:
-    case 0:
-    case 1:
-    case 2:
-    case 3:
-    case 4:
-    case 5:
-    case 6:
-    case 7:
-        return registers[index];
-    case 8:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R8_FIQ)];
-    case 9:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R9_FIQ)];
-    case 10:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R10_FIQ)];
-    case 11:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R11_FIQ)];
-    case 12:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R12_FIQ)];
-    case 13:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R13_FIQ)];
-    case 14:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R14_FIQ)];
-    default:
-        // TODO: error handling
-        throw;
-    }
+    return bankedRegister(Mode::FastInterrupt, index);
 }
 
 const uint32_t& GBA::CPU::R_FIQ(uint32_t index) const {
-    switch (index) {
-    case 15:
-    case 0:
-    case 1:
-    case 2:
-    case 3:
-    case 4:
-    case 5:
-    case 6:
-    case 7:
-        return registers[index];
-    case 8:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R8_FIQ)];
-    case 9:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R9_FIQ)];
-    case 10:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R10_FIQ)];
-    case 11:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R11_FIQ)];
-    case 12:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R12_FIQ)];
-    case 13:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R13_FIQ)];
-    case 14:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R14_FIQ)];
-    default:
-        // TODO: error handling
-        throw;
-    }
+    return bankedRegister(Mode::FastInterrupt, index);
 }
 
 uint32_t& GBA::CPU::R_SVC(uint32_t index) {
-    switch (index) {
-    case 15:
-    case 0:
-    case 1:
-    case 2:
-    case 3:
-    case 4:
-    case 5:
-    case 6:
-    case 7:
-    case 8:
-    case 9:
-    case 10:
-    case 11:
-    case 12:
-        return registers[index];
-    case 13:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R13_SVC)];
-    case 14:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R14_SVC)];
-    default:
-        // TODO: error handling
-        throw;
-    }
+    return bankedRegister(Mode::Supervisor, index);
 }
 
 const uint32_t& GBA::CPU::R_SVC(uint32_t index) const {
-    switch (index) {
-    case 15:
-    case 0:
-    case 1:
-    case 2:
-    case 3:
-    case 4:
-    case 5:
-    case 6:
-    case 7:
-    case 8:
-    case 9:
-    case 10:
-    case 11:
-    case 12:
-        return registers[index];
-    case 13:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R13_SVC)];
-    case 14:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R14_SVC)];
-    default:
-        // TODO: error handling
-        throw;
-    }
+    return bankedRegister(Mode::Supervisor, index);
 }
 
 uint32_t& GBA::CPU::R_ABT(uint32_t index) {
-    switch (index) {
-    case 15:
-    case 0:
-    case 1:
-    case 2:
-    case 3:
-    case 4:
-    case 5:
-    case 6:
-    case 7:
-    case 8:
-    case 9:
-    case 10:
-    case 11:
-    case 12:
-        return registers[index];
-    case 13:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R13_ABT)];
-    case 14:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R14_ABT)];
-    default:
-        // TODO: error handling
-        throw;
-    }
+    return bankedRegister(Mode::Abort, index);
 }
 
 const uint32_t& GBA::CPU::R_ABT(uint32_t index) const {
-    switch (index) {
-    case 15:
-    case 0:
-    case 1:
-    case 2:
-    case 3:
-    case 4:
-    case 5:
-    case 6:
-    case 7:
-    case 8:
-    case 9:
-    case 10:
-    case 11:
-    case 12:
-        return registers[index];
-    case 13:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R13_ABT)];
-    case 14:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R14_ABT)];
-    default:
-        // TODO: error handling
-        throw;
-    }
+    return bankedRegister(Mode::Abort, index);
 }
 
 uint32_t& GBA::CPU::R_IRQ(uint32_t index) {
-    switch (index) {
-    case 15:
-    case 0:
-    case 1:
-    case 2:
-    case 3:
-    case 4:
-    case 5:
-    case 6:
-    case 7:
-    case 8:
-    case 9:
-    case 10:
-    case 11:
-    case 12:
-        return registers[index];
-    case 13:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R13_IRQ)];
-    case 14:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R14_IRQ)];
-    default:
-        // TODO: error handling
-        throw;
-    }
+    return bankedRegister(Mode::Interrupt, index);
 }
 
 const uint32_t& GBA::CPU::R_IRQ(uint32_t index) const {
-    switch (index) {
-    case 15:
-    case 0:
-    case 1:
-    case 2:
-    case 3:
-    case 4:
-    case 5:
-    case 6:
-    case 7:
-    case 8:
-    case 9:
-    case 10:
-    case 11:
-    case 12:
-        return registers[index];
-    case 13:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R13_IRQ)];
-    case 14:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R14_IRQ)];
-    default:
-        // TODO: error handling
-        throw;
-    }
+    return bankedRegister(Mode::Interrupt, index);
 }
 
 uint32_t& GBA::CPU::R_UND(uint32_t index) {
-    switch (index) {
-    case 15:
-    case 0:
-    case 1:
-    case 2:
-    case 3:
-    case 4:
-    case 5:
-    case 6:
-    case 7:
-    case 8:
-    case 9:
-    case 10:
-    case 11:
-    case 12:
-        return registers[index];
-    case 13:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R13_UND)];
-    case 14:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R14_UND)];
-    default:
-        // TODO: error handling
-        throw;
-    }
+    return bankedRegister(Mode::Undefined, index);
 }
 
 const uint32_t& GBA::CPU::R_UND(uint32_t index) const {
-    switch (index) {
-    case 15:
-    case 0:
-    case 1:
-    case 2:
-    case 3:
-    case 4:
-    case 5:
-    case 6:
-    case 7:
-    case 8:
-    case 9:
-    case 10:
-    case 11:
-    case 12:
-        return registers[index];
-    case 13:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R13_UND)];
-    case 14:
-        return registers[static_cast<int>(GBA::CPU::RegisterIndex::R14_UND)];
-    default:
-        // TODO: error handling
-        throw;
-    }
+    return bankedRegister(Mode::Undefined, index);
 }
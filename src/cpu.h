@@ -1,13 +1,15 @@
 #ifndef GBA_CPU_H
 #define GBA_CPU_H
 
+#include "bios.h"
+#include "block_cache.h"
 #include "common.h"
 #include "instruction_types.h"
 #include "instruction_types_arguments.h"
+#include "jit.h"
 #include "memory.h"
 #include "opcode.h"
 #include <array>
-#include <iostream>
 #include <utility>
 #include <vector>
 
@@ -31,31 +33,91 @@ class CPU
 
     // TODO: remove this after refactoring Memory, add functionality to Memory
     void loadBIOS(const std::vector<uint8_t>& bios);
+    void loadROM(const std::vector<uint8_t>& rom);
+    void loadROM(std::shared_ptr<const ROMImage> image);
+    bool enableFastMem() { return memory.enableFastMem(); }
+    Memory& getMemory() { return memory; }
     std::pair<std::vector<uint8_t>::const_iterator, std::vector<uint8_t>::const_iterator> getDisplay() const;
 
-    void step();
+    // Executes one instruction and returns the cycles it took
+    uint32_t step();
+    // Executes instructions until at least the given number of cycles has passed, returns the cycles executed.
+    // A halted CPU skips straight to the end of the budget unless an interrupt is pending.
+    uint64_t runFor(uint64_t cycle_budget);
+    // Cycles executed since construction
+    uint64_t getTotalCycles() const { return total_cycles; }
+    // While halted or stopped (see Memory::PowerState) wakes up if an interrupt ends the sleep, otherwise skips to
+    // the total cycle count end. Returns whether the CPU is still sleeping.
+    bool sleep(uint64_t end);
+
+    // How runFor executes instructions, step() always fetches and looks up a single instruction
+    enum class Backend {
+        // step() in a loop
+        Interpreter,
+        // cached basic blocks of looked up instructions
+        BlockCache,
+        // cached blocks compiled to host code by the JIT
+        Recompiler,
+    };
+    // Switches the backend and drops all cached blocks, returns false (keeping the current backend) if the
+    // recompiler is not supported by the host
+    bool setBackend(Backend backend);
+    Backend getBackend() const { return backend; }
+    BlockCache::Stats getBlockCacheStats() const { return block_cache.getStats(); }
+    // The block backends detect loops that only poll memory (IO registers, flags set by interrupt handlers) and
+    // skip to the end of the runFor budget, which the emulator ends at the next scheduled event. Cycles skipped
+    // that way since construction:
+    uint64_t getIdleSkippedCycles() const { return idle_skipped_cycles; }
+    // Cycles skipped while halted or stopped (see Memory::PowerState), since construction
+    uint64_t getSleepingCycles() const { return sleeping_cycles; }
+    // With HLE BIOS the math and memory copy SWIs (see bios.h) run natively instead of jumping to the BIOS image,
+    // which is also what makes them work without a BIOS dump. Off by default.
+    void setHLEBIOS(bool enabled) { hle_bios = enabled; }
+    bool getHLEBIOS() const { return hle_bios; }
 
     InstructionType decodeArm(uint32_t instruction_code) const;
+
+    // ARM instructions are dispatched through a table indexed by bits 27-20 and 7-4 of the instruction,
+    // generated at compile time by running decodeArm on a representative encoding of every index
+    using ArmInstructionHandler = void (CPU::*)(uint32_t instruction_code, uint32_t pc);
+    static const std::array<ArmInstructionHandler, 4096> arm_instruction_table;
+    static constexpr uint32_t getArmTableIndex(uint32_t instruction_code) {
+        return ((instruction_code >> 16) & 0xFF0) | ((instruction_code >> 4) & 0xF);
+    }
+    static ArmInstructionHandler lookupArm(uint32_t instruction_code) {
+        return arm_instruction_table[getArmTableIndex(instruction_code)];
+    }
+    // Encoding decoded for a table index, the fields outside the index hold the values the architecture
+    // requires (SBO/SBZ): 0xFFF in bits 19-8 for BX, otherwise Rn = Rd = 0xF and bits 11-8 clear as in
+    // MRS, MSR, SWP and the register forms of LDRH/STRH
+    static constexpr uint32_t getArmTableEncoding(uint32_t index) {
+        uint32_t instruction_code = ((index & 0xFF0) << 16) | ((index & 0xF) << 4);
+        return instruction_code | (index == 0x121 ? 0x000FFF00 : 0x000FF000);
+    }
+    // Handler the table selects for an instruction of the given type
+    static ArmInstructionHandler getArmInstructionHandler(InstructionType instruction_type, uint32_t instruction_code);
     // TODO: https://developer.arm.com/documentation/ddi0210/c/Programmer-s-Model/Reset
     void reset();
+    // Puts the CPU and IO registers in the state the BIOS leaves them in when it jumps to the cartridge, so a
+    // ROM can start without running the BIOS boot sequence (or without a BIOS image at all)
+    void directBoot();
 
+    // Reserved values of the mode bits read as the last valid mode, whose registers stay in use
     Mode getMode() const;
     void setMode(Mode mode);
 
     bool inArm() const { return !inThumb(); }
     bool inThumb() const { return CPSR & 0x20; }
 
-    // Check if the instruction should be executed based on the condition field
+    // Check if the instruction should be executed based on the condition field, step() does this before calling
+    // an ARM handler so the handlers themselves don't
     bool checkCondition(uint32_t intruction_code) const;
 
-    DataProcessingArguments decodeDataProcessingArguments(uint32_t instruction_code, Opcode opcode, uint32_t pc);
     void dataProcessingArmLogicalOperationFlagsSetting(bool S, uint32_t Rd, uint32_t operation_result, bool carry);
+    // Flags of operand1 + operand2 + carry_in, subtraction passes the inverted operand and a carry of 1
     void dataProcessingArmArithmeticOperationFlagsSetting(
-        bool S, uint32_t Rd_before_operation, uint32_t Rd, uint32_t result, uint32_t operand1, uint32_t operand2,
-        bool isAdd);
+        bool S, uint32_t Rd, uint32_t operand1, uint32_t operand2, bool carry_in);
 
-    // there is not RET instruction, this is a variant of the MOVS instruction
-    void retArm(DataProcessingArguments arguments);
     void andArm(DataProcessingArguments arguments);
     void xorArm(DataProcessingArguments arguments);
     void subArm(DataProcessingArguments arguments);
@@ -72,13 +134,20 @@ class CPU
     void movArm(DataProcessingArguments arguments);
     void bicArm(DataProcessingArguments arguments);
     void mvnArm(DataProcessingArguments arguments);
-    using DataProcessingInstructionType = void (CPU::*)(DataProcessingArguments);
-    std::array<DataProcessingInstructionType, 16> data_processing_instruction_type;
 
-    std::pair<uint32_t, bool> calculateOperand2(uint32_t shifted_value, uint32_t shift_value, ShiftType shift_type);
-    Opcode getOpcodeArm(uint32_t intruction_code) const;
-    void
-        callDataProcessingInstruction(uint32_t intruction_code, uint32_t pc);  // this function name needs to be changed
+    // Shifts the second operand of the argument-struct handlers, returns the shifted value and the carry out
+    std::pair<uint32_t, bool>
+        calculateOperand2(uint32_t shifted_value, uint32_t shift_value, ShiftType shift_type, bool register_shift);
+
+    // ARM data processing, specialized on every field the decode table index fixes so each variant is
+    // straight-line code without an argument struct
+    template <Opcode opcode, bool S, bool I, ShiftType shift_type, bool register_shift>
+    void dataProcessingArm(uint32_t instruction_code, uint32_t pc);
+    // Executes any data processing instruction through the decode table, including the condition check
+    void callDataProcessingInstruction(uint32_t instruction_code, uint32_t pc);
+
+    void callMRSInstruction(uint32_t instruction_code, uint32_t pc);
+    void callMSRInstruction(uint32_t instruction_code, uint32_t pc);
 
     void callMultiplyInstruction(uint32_t intruction_code, uint32_t pc);
     MultiplyArguments decodeMultiplyArguments(uint32_t instruction_code, uint32_t pc);
@@ -122,9 +191,26 @@ class CPU
     void blArm(uint32_t instruction_code, uint32_t pc);
 
     void callSoftwareInterruptInstruction(uint32_t instruction_code, uint32_t pc);
+    // Takes the IRQ exception before the next instruction, done whenever Memory::isIRQPending is set at the start of
+    // step() or of a block
+    void takeInterrupt();
+    // Switches to the mode of an exception, saves CPSR to its SPSR and the return address to its LR, and jumps to
+    // the vector in ARM state with IRQs disabled
+    void enterException(Mode mode, uint32_t vector, uint32_t return_address);
+    // Coprocessor and undefined instructions, there are no coprocessors on the GBA
+    void callUndefinedInstruction(uint32_t instruction_code, uint32_t pc);
 
     ThumbInstructionType decodeThumb(uint16_t instruction_code);
 
+    // Thumb instructions are dispatched through a table indexed by bits 15-6, the decodeThumb chain never
+    // looks at the lower bits so the table is exact
+    using ThumbInstructionHandler = void (CPU::*)(uint16_t instruction_code);
+    static const std::array<ThumbInstructionHandler, 1024> thumb_instruction_table;
+    static ThumbInstructionHandler lookupThumb(uint16_t instruction_code) {
+        return thumb_instruction_table[instruction_code >> 6];
+    }
+    static ThumbInstructionHandler getThumbInstructionHandler(ThumbInstructionType instruction_type);
+
     void callMoveShiftedRegisterThumbInstruction(uint16_t instruction_code);
     MoveShifterRegisterThumbArguments decodeMoveShiftedRegisterThumbArguments(uint16_t instruction_code);
     void lslThumb(MoveShifterRegisterThumbArguments arguments);
@@ -166,11 +252,15 @@ class CPU
     void callHiRegisterOperationBranchExchangeInstruction(uint16_t instruction_code);
     HiRegisterOperationsBranchExchangeArguments
         decodeHiRegisterOperationBranchExchangeArguments(uint16_t instruction_code);
+    // Value of a register as an operand of the hi register operations, R15 reads as the instruction address + 4
+    uint32_t readHiRegister(uint32_t index);
     void addHiRegisterOperationBranchExchange(HiRegisterOperationsBranchExchangeArguments arguments);
     void cmpHiRegisterOperationBranchExchange(HiRegisterOperationsBranchExchangeArguments arguments);
     void movHiRegisterOperationBranchExchange(HiRegisterOperationsBranchExchangeArguments arguments);
     void bxHiRegisterOperationBranchExchange(HiRegisterOperationsBranchExchangeArguments arguments);
 
+    void callPCRelativeLoad(uint16_t instruction_code);
+
     void callLoadStoreRegOffset(uint16_t instruction_code);
     LoadStoreRegOffsetArguments decodeLoadStoreRegOffsetArguments(uint16_t instruction_code);
 
@@ -206,6 +296,9 @@ class CPU
 
     void callLongBranchLink(uint16_t instruction_code);
 
+    void callSoftwareInterruptThumb(uint16_t instruction_code);
+    void callUndefinedThumbInstruction(uint16_t instruction_code);
+
     // Stack Pointer, R13 by convention
     uint32_t& SP(Mode mode);
     const uint32_t& SP(Mode mode) const;
@@ -217,12 +310,12 @@ class CPU
     // R15 is the Program Counter
     // In ARM mode, bits 1 to 0 are undefined and must be ignored
     // In Thumb mode, bit 0 is undefined and must be ignored
-    uint32_t& PC();
-    const uint32_t& PC() const;
+    uint32_t& PC() { return active_registers[15]; }
+    const uint32_t& PC() const { return active_registers[15]; }
 
     // General purpose registers for the current mode
-    uint32_t& R(uint32_t index);
-    const uint32_t& R(uint32_t index) const;
+    uint32_t& R(uint32_t index) { return active_registers[index]; }
+    const uint32_t& R(uint32_t index) const { return active_registers[index]; }
 
     // General purpose registers for User and System mode, R0 to R15
     uint32_t& R_USRSYS(uint32_t index);
@@ -248,9 +341,48 @@ class CPU
     uint32_t& R_UND(uint32_t index);
     const uint32_t& R_UND(uint32_t index) const;
 
-    uint32_t getCPSR() const { return CPSR; }
+    uint32_t getCPSR() const { return (CPSR & 0x0FFFFFFF) | getFlags(); }
+
+    // NZCV is evaluated lazily: flag-setting ALU instructions only record their inputs, and the flags are computed
+    // when a condition, MRS, an exception entry or getCPSR reads them. The NZCV bits of CPSR are stale while an
+    // operation is recorded.
+    enum class FlagsOperation : uint8_t {
+        None,     // NZCV are in CPSR
+        Logical,  // N and Z from flags_result, C is flags_carry, V is unchanged in CPSR
+        Add,      // flags_operand1 + flags_operand2 + flags_carry
+    };
+    void setLogicalFlags(uint32_t result, bool carry) {
+        // V survives logical operations, it has to be taken out of a recorded addition first
+        if (flags_operation == FlagsOperation::Add)
+            resolveFlags();
+        flags_operation = FlagsOperation::Logical;
+        flags_result = result;
+        flags_carry = carry;
+    }
+    void setAddFlags(uint32_t operand1, uint32_t operand2, bool carry_in) {
+        flags_operation = FlagsOperation::Add;
+        flags_operand1 = operand1;
+        flags_operand2 = operand2;
+        flags_carry = carry_in;
+    }
+    // NZCV in bits 31 to 28
+    uint32_t getFlags() const;
+    bool getCarryFlag() const;
+    // Writes the recorded flags back to CPSR, needed before updating single flag bits
+    void resolveFlags();
+
+    // Saved Program Status Register of the current mode, User and System mode have none
+    bool hasSPSR() const { return spsr != nullptr; }
+    uint32_t& SPSR() { return *spsr; }
+
+    // Writes CPSR and swaps the banked registers if the mode bits change, every write that can change the mode
+    // has to go through here
+    void writeCPSR(uint32_t value);
 
   private:
+    friend class JIT;
+    friend bool BIOS::call(CPU& cpu, uint32_t function, uint32_t& cycles);
+
     enum class RegisterIndex {
         R0 = 0,
         R1 = 1,
@@ -298,7 +430,19 @@ class CPU
         LR_UND = R14_UND,
     };
 
-    // All general and banked registers
+    // Slot of a mode's register in registers
+    static int getRegisterSlot(Mode mode, uint32_t index);
+    // A mode's register wherever it currently lives, in the active register file or in its bank slot
+    uint32_t& bankedRegister(Mode mode, uint32_t index);
+    const uint32_t& bankedRegister(Mode mode, uint32_t index) const;
+    // Saves R8 to R14 to the slots of bank_mode and loads the ones of mode
+    void switchBank(Mode mode);
+
+    // R0 to R15 of the current mode, this is what the instruction handlers work on
+    uint32_t active_registers[16];
+    // Mode whose banked registers are loaded into active_registers
+    Mode bank_mode;
+    // Banked copies of the registers, the slots of bank_mode are stale while it is active
     uint32_t registers[31];
 
     // Current Program Status Register
@@ -310,7 +454,102 @@ class CPU
     uint32_t SPSR_ABT;
     uint32_t SPSR_IRQ;
     uint32_t SPSR_UND;
+
+    FlagsOperation flags_operation;
+    uint32_t flags_result;
+    uint32_t flags_operand1;
+    uint32_t flags_operand2;
+    bool flags_carry;
+    // SPSR of the current mode, null in User and System mode
+    uint32_t* spsr;
     Memory memory;
+
+    // Cycles of the instruction being executed. step() counts the fetches and the pipeline refill after a branch,
+    // the handlers add their data accesses (dataRead/dataWrite) and internal cycles. Access times come from the
+    // memory timing tables.
+    uint32_t cycles;
+    uint64_t total_cycles;
+    // Whether the next opcode fetch follows the previous one on the bus, a data access in between breaks it
+    bool fetch_sequential;
+    // Set after the first data access of an instruction, later accesses at next_data_address (LDM/STM) are
+    // sequential
+    bool data_burst;
+    uint32_t next_data_address;
+
+    void addInternalCycles(uint32_t count) { cycles += count; }
+
+    // One instruction fetched from pc, step() and the block cache share these. finishInstruction adds the
+    // pipeline refill if the instruction did not continue at next_pc and returns the instruction's cycles.
+    void executeArm(ArmInstructionHandler handler, uint32_t instruction_code, uint32_t pc);
+    // Everything executeArm does before checking the condition
+    void beginArm(uint32_t instruction_code, uint32_t pc);
+    void executeThumb(ThumbInstructionHandler handler, uint16_t instruction_code, uint32_t pc);
+    uint32_t finishInstruction(uint32_t next_pc);
+
+    const BlockCache::Block* buildBlock(uint32_t address, bool thumb);
+    void runArmBlock(const BlockCache::Block& block, uint64_t end);
+    void runThumbBlock(const BlockCache::Block& block, uint64_t end);
+    // Runs cached blocks one after another until the budget ends or PC leaves the cacheable regions
+    void runBlocksThreaded(uint64_t end);
+    // Skips the rest of the budget if block is an idle loop that just branched back to its start
+    void skipIdleLoop(const BlockCache::Block& block, uint64_t end);
+    // Same for the idle loop starting at address
+    void skipIdleLoop(uint32_t address, bool thumb, uint64_t end);
+    // Drops cached and compiled blocks in code pages written since the last call
+    void invalidateWrittenCode();
+    void clearBlocks();
+
+    Backend backend;
+    BlockCache block_cache;
+    // Created when the recompiler is first selected
+    std::unique_ptr<JIT> jit;
+    uint64_t idle_skipped_cycles;
+    uint64_t sleeping_cycles;
+    bool hle_bios;
+    // An HLE IntrWait is halted and comes back to its swi to check the flags again
+    bool hle_intr_wait;
+
+    template <class T>
+    void addDataCycles(uint32_t address) {
+        cycles += memory.getAccessCycles<T>(address, data_burst && address == next_data_address);
+        data_burst = true;
+        next_data_address = address + sizeof(T);
+        fetch_sequential = false;
+    }
+
+    // Data accesses of the instruction handlers
+    uint32_t dataRead8(uint32_t address) {
+        addDataCycles<uint8_t>(address);
+        return memory.read8(address);
+    }
+    uint32_t dataRead16(uint32_t address) {
+        addDataCycles<uint16_t>(address);
+        return memory.read16(address);
+    }
+    uint32_t dataRead32(uint32_t address) {
+        addDataCycles<uint32_t>(address);
+        return memory.read32(address);
+    }
+    uint32_t dataRead16Rotated(uint32_t address) {
+        addDataCycles<uint16_t>(address);
+        return memory.read16Rotated(address);
+    }
+    uint32_t dataRead32Rotated(uint32_t address) {
+        addDataCycles<uint32_t>(address);
+        return memory.read32Rotated(address);
+    }
+    void dataWrite8(uint32_t address, uint8_t value) {
+        addDataCycles<uint8_t>(address);
+        memory.write8(address, value);
+    }
+    void dataWrite16(uint32_t address, uint16_t value) {
+        addDataCycles<uint16_t>(address);
+        memory.write16(address, value);
+    }
+    void dataWrite32(uint32_t address, uint32_t value) {
+        addDataCycles<uint32_t>(address);
+        memory.write32(address, value);
+    }
 };
 
 }
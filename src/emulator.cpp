@@ -1,10 +1,14 @@
 #include "emulator.h"
+#include <algorithm>
+#include <cassert>
 
-GBA::Emulator::Emulator() : cpu{} {
+GBA::Emulator::Emulator() : cpu{}, scheduler{}, target_cycles{} {
     this->cpu.reset();
+    scheduler.schedule(Scheduler::Event::HBlank, HDrawCycles);
+    scheduler.schedule(Scheduler::Event::Scanline, CyclesPerScanline);
 }
 
-GBA::Emulator::Emulator(const std::vector<uint8_t>& bios) : cpu{} {
+GBA::Emulator::Emulator(const std::vector<uint8_t>& bios) : Emulator() {
     this->cpu.loadBIOS(bios);
     this->cpu.reset();
 }
@@ -18,8 +22,85 @@ void GBA::Emulator::loadBIOS(const std::vector<uint8_t>& bios) {
     this->cpu.reset();
 }
 
-void GBA::Emulator::step() {
-    this->cpu.step();
+void GBA::Emulator::loadROM(const std::vector<uint8_t>& rom) {
+    this->cpu.loadROM(rom);
+    this->cpu.reset();
+}
+
+void GBA::Emulator::loadROM(std::shared_ptr<const ROMImage> image) {
+    this->cpu.loadROM(std::move(image));
+    this->cpu.reset();
+}
+
+bool GBA::Emulator::enableFastMem() {
+    return this->cpu.enableFastMem();
+}
+
+uint32_t GBA::Emulator::step() {
+    uint64_t start = cpu.getTotalCycles();
+    // a halted CPU has no instruction to run, it sleeps up to the next event instead
+    if (!cpu.sleep(scheduler.getNextTimestamp()))
+        cpu.step();
+    runEvents();
+    return cpu.getTotalCycles() - start;
+}
+
+void GBA::Emulator::runFor(uint32_t cycles) {
+    target_cycles += cycles;
+    while (cpu.getTotalCycles() < target_cycles) {
+        uint64_t until = std::min(target_cycles, scheduler.getNextTimestamp());
+        if (cpu.getTotalCycles() < until)
+            cpu.runFor(until - cpu.getTotalCycles());
+        runEvents();
+    }
+}
+
+void GBA::Emulator::runEvents() {
+    Scheduler::Event event;
+    uint64_t timestamp;
+    while (scheduler.popDue(cpu.getTotalCycles(), event, timestamp)) {
+        switch (event) {
+        case Scheduler::Event::HBlank:
+            onHBlank(timestamp);
+            break;
+        case Scheduler::Event::Scanline:
+            onScanline(timestamp);
+            break;
+        case Scheduler::Event::Count:
+            // only counts the events, it is never scheduled
+            assert(false);
+            break;
+        }
+    }
+}
+
+void GBA::Emulator::onHBlank(uint64_t timestamp) {
+    Memory& memory = cpu.getMemory();
+    uint16_t dispstat = memory.read16(Memory::DISPSTATAddress) | 0x2;
+    memory.write16(Memory::DISPSTATAddress, dispstat);
+    if (dispstat & 0x10)
+        memory.requestInterrupt(Memory::HBlankInterrupt);
+    scheduler.schedule(Scheduler::Event::HBlank, timestamp + CyclesPerScanline);
+}
+
+void GBA::Emulator::onScanline(uint64_t timestamp) {
+    // https://problemkaputt.de/gbatek.htm#lcdiointerruptsandstatus
+    Memory& memory = cpu.getMemory();
+    uint16_t vcount = (memory.read16(Memory::VCOUNTAddress) + 1) % ScanlinesPerFrame;
+    uint16_t dispstat = memory.read16(Memory::DISPSTATAddress) & ~0x7;
+    // the VBlank flag is clear again on the last scanline
+    if (vcount >= VisibleScanlines && vcount != ScanlinesPerFrame - 1)
+        dispstat |= 0x1;
+    if (vcount == dispstat >> 8)
+        dispstat |= 0x4;
+    memory.write16(Memory::VCOUNTAddress, vcount);
+    memory.write16(Memory::DISPSTATAddress, dispstat);
+    // bits 3 and 5 enable the VBlank interrupt at the start of VBlank and the VCount match one
+    if (vcount == VisibleScanlines && (dispstat & 0x8))
+        memory.requestInterrupt(Memory::VBlankInterrupt);
+    if ((dispstat & 0x4) && (dispstat & 0x20))
+        memory.requestInterrupt(Memory::VCountInterrupt);
+    scheduler.schedule(Scheduler::Event::Scanline, timestamp + CyclesPerScanline);
 }
 
 std::pair<std::vector<uint8_t>::const_iterator, std::vector<uint8_t>::const_iterator> GBA::Emulator::getDisplay() const {
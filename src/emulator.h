@@ -4,6 +4,7 @@
 #include "common.h"
 #include "cpu.h"
 #include "memory.h"
+#include "scheduler.h"
 #include <vector>
 
 namespace GBA {
@@ -16,11 +17,45 @@ class Emulator
     ~Emulator();
 
     void loadBIOS(const std::vector<uint8_t>& bios);
-    void step();
+    void loadROM(const std::vector<uint8_t>& rom);
+    void loadROM(std::shared_ptr<const ROMImage> image);
+    // Starts the loaded ROM in the state the BIOS hands over to it, skipping the boot intro. Loading a BIOS or ROM
+    // afterwards resets the CPU to the BIOS again.
+    void directBoot() { cpu.directBoot(); }
+    // Use the host virtual memory backend for guest memory, returns false if the host does not support it
+    bool enableFastMem();
+    // Selects how the CPU executes instructions, returns false if the backend is not supported by the host
+    bool setBackend(CPU::Backend backend) { return cpu.setBackend(backend); }
+    BlockCache::Stats getBlockCacheStats() const { return cpu.getBlockCacheStats(); }
+    uint64_t getIdleSkippedCycles() const { return cpu.getIdleSkippedCycles(); }
+    uint64_t getSleepingCycles() const { return cpu.getSleepingCycles(); }
+    void setHLEBIOS(bool enabled) { cpu.setHLEBIOS(enabled); }
+    // 160 visible and 68 VBlank scanlines of 1232 cycles, the last 226 cycles of each are HBlank
+    static const uint32_t CyclesPerScanline = 1232;
+    static const uint32_t HDrawCycles = 1006;
+    static const uint32_t VisibleScanlines = 160;
+    static const uint32_t ScanlinesPerFrame = 228;
+    static const uint32_t CyclesPerFrame = CyclesPerScanline * ScanlinesPerFrame;
+
+    // Executes one instruction and the events that became due, returns the cycles it took. A halted CPU sleeps up to
+    // the next event instead.
+    uint32_t step();
+    // Runs the CPU for the given number of cycles. The CPU runs uninterrupted until the budget or the next
+    // scheduled event is reached. Instructions are not split, so a call may run a few cycles over, the next
+    // call runs that many cycles less.
+    void runFor(uint32_t cycles);
+    void runFrame() { runFor(CyclesPerFrame); }
     std::pair<std::vector<uint8_t>::const_iterator, std::vector<uint8_t>::const_iterator> getDisplay() const;
 
   private:
+    void runEvents();
+    void onHBlank(uint64_t timestamp);
+    void onScanline(uint64_t timestamp);
+
     CPU cpu;
+    Scheduler scheduler;
+    // Total cycle count runFor runs up to, the CPU may already be past it
+    uint64_t target_cycles;
 };
 
 }
@@ -0,0 +1,281 @@
+#include "fastmem.h"
+#include "memory.h"
+#include "rom_image.h"
+
+#if GBA_FASTMEM_SUPPORTED
+
+#include <atomic>
+#include <csignal>
+#include <cstring>
+#include <mutex>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+namespace {
+
+struct FastMemFixup
+{
+    int32_t fault;   // faulting instruction, relative to this field
+    int32_t resume;  // first instruction after it, relative to this field
+    uint32_t access;
+};
+
+// Bounds of the section filled by the inline accessors in fastmem.h, weak so linking works without any accessor
+extern "C" __attribute__((weak)) const FastMemFixup __start_gba_fastmem_fixups[];
+extern "C" __attribute__((weak)) const FastMemFixup __stop_gba_fastmem_fixups[];
+
+const uint8_t* fixupTarget(const int32_t& field) {
+    return reinterpret_cast<const uint8_t*>(&field) + field;
+}
+
+const FastMemFixup* findFixup(uintptr_t instruction) {
+    if (__start_gba_fastmem_fixups == nullptr)
+        return nullptr;
+    for (const FastMemFixup* fixup = __start_gba_fastmem_fixups; fixup != __stop_gba_fastmem_fixups; fixup++) {
+        if (reinterpret_cast<uintptr_t>(fixupTarget(fixup->fault)) == instruction)
+            return fixup;
+    }
+    return nullptr;
+}
+
+// Live arenas, looked up from the signal handler so this must not allocate or lock
+const size_t MaxArenas = 64;
+std::atomic<GBA::FastMem*> arenas[MaxArenas];
+
+GBA::FastMem* findArena(const void* address) {
+    for (auto& slot : arenas) {
+        GBA::FastMem* arena = slot.load(std::memory_order_acquire);
+        if (arena != nullptr && arena->contains(address))
+            return arena;
+    }
+    return nullptr;
+}
+
+struct sigaction previous_action;
+std::once_flag handler_installed;
+
+void handleFault(int signal, siginfo_t* info, void* context) {
+    auto* ucontext = static_cast<ucontext_t*>(context);
+    greg_t* registers = ucontext->uc_mcontext.gregs;
+    const FastMemFixup* fixup = findFixup(static_cast<uintptr_t>(registers[REG_RIP]));
+    GBA::FastMem* arena = fixup != nullptr ? findArena(info->si_addr) : nullptr;
+    if (arena == nullptr) {
+        // not a guest access, hand the fault to whoever was installed before us
+        if (previous_action.sa_flags & SA_SIGINFO) {
+            previous_action.sa_sigaction(signal, info, context);
+        }
+        else if (previous_action.sa_handler != SIG_DFL && previous_action.sa_handler != SIG_IGN) {
+            previous_action.sa_handler(signal);
+        }
+        else {
+            // returning re-executes the instruction which then faults with the default action
+            sigaction(signal, &previous_action, nullptr);
+        }
+        return;
+    }
+
+    auto access = static_cast<GBA::FastMem::Access>(fixup->access);
+    uint32_t address = static_cast<uint32_t>(registers[REG_RSI]);
+    uint32_t value = arena->service(access, address, static_cast<uint32_t>(registers[REG_RDX]));
+    if (access == GBA::FastMem::Access::Read8 || access == GBA::FastMem::Access::Read16 ||
+        access == GBA::FastMem::Access::Read32)
+        registers[REG_RAX] = value;
+    registers[REG_RIP] = reinterpret_cast<greg_t>(fixupTarget(fixup->resume));
+}
+
+void installHandler() {
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_sigaction = handleFault;
+    action.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &previous_action);
+}
+
+uint64_t roundDownToHostPage(uint64_t size) {
+    uint64_t page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    return size & ~(page_size - 1);
+}
+
+}
+
+GBA::FastMem::FastMem(Memory& memory)
+    : memory(memory), base{}, ram_fd{-1}, ram{}, rom_fd{-1} {
+}
+
+GBA::FastMem::~FastMem() {
+    for (auto& slot : arenas) {
+        FastMem* arena = this;
+        if (slot.compare_exchange_strong(arena, nullptr))
+            break;
+    }
+    if (base != nullptr)
+        munmap(base, ArenaSize + GuardSize);
+    if (ram != nullptr)
+        munmap(ram, Memory::RAMSize);
+    if (ram_fd >= 0)
+        close(ram_fd);
+    if (rom_fd >= 0)
+        close(rom_fd);
+}
+
+std::unique_ptr<GBA::FastMem> GBA::FastMem::create(Memory& memory) {
+    // every mirror of IWRAM (32K) has to start on a host page boundary
+    if (sysconf(_SC_PAGESIZE) > static_cast<long>(Memory::IWRAMSize))
+        return nullptr;
+
+    std::unique_ptr<FastMem> arena(new FastMem(memory));
+    if (!arena->reserve() || !arena->mapRAM())
+        return nullptr;
+    if (memory.rom_image && !arena->mapROM(*memory.rom_image))
+        return nullptr;
+
+    bool registered = false;
+    for (auto& slot : arenas) {
+        FastMem* empty = nullptr;
+        if (slot.compare_exchange_strong(empty, arena.get())) {
+            registered = true;
+            break;
+        }
+    }
+    if (!registered)
+        return nullptr;
+    std::call_once(handler_installed, installHandler);
+    return arena;
+}
+
+bool GBA::FastMem::contains(const void* address) const {
+    auto host = static_cast<const uint8_t*>(address);
+    return host >= base && host < base + ArenaSize + GuardSize;
+}
+
+uint32_t GBA::FastMem::service(Access access, uint32_t address, uint32_t value) {
+    switch (access) {
+    case Access::Read8:
+        return memory.readSlow<uint8_t>(address);
+    case Access::Read16:
+        return memory.readSlow<uint16_t>(address);
+    case Access::Read32:
+        return memory.readSlow<uint32_t>(address);
+    case Access::Write8:
+        memory.writeSlow<uint8_t>(address, value & 0xFF);
+        break;
+    case Access::Write16:
+        memory.writeSlow<uint16_t>(address, value & 0xFFFF);
+        break;
+    case Access::Write32:
+        memory.writeSlow<uint32_t>(address, value);
+        break;
+    }
+    return 0;
+}
+
+bool GBA::FastMem::reserve() {
+    void* arena = mmap(nullptr, ArenaSize + GuardSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (arena == MAP_FAILED)
+        return false;
+    base = static_cast<uint8_t*>(arena);
+    return true;
+}
+
+bool GBA::FastMem::mapView(uint32_t address, int fd, uint64_t offset, uint64_t size, bool writable) {
+    int protection = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* view = mmap(base + address, size, protection, MAP_SHARED | MAP_FIXED, fd, offset);
+    return view != MAP_FAILED;
+}
+
+bool GBA::FastMem::mapRAM() {
+    ram_fd = memfd_create("gba-ram", MFD_CLOEXEC);
+    if (ram_fd < 0 || ftruncate(ram_fd, Memory::RAMSize) != 0)
+        return false;
+    void* view = mmap(nullptr, Memory::RAMSize, PROT_READ | PROT_WRITE, MAP_SHARED, ram_fd, 0);
+    if (view == MAP_FAILED)
+        return false;
+    ram = static_cast<uint8_t*>(view);
+    std::memcpy(ram + Memory::BIOSOffset, memory.bios, Memory::BIOSSize);
+    std::memcpy(ram + Memory::EWRAMOffset, memory.ewram, Memory::EWRAMSize);
+    std::memcpy(ram + Memory::IWRAMOffset, memory.iwram, Memory::IWRAMSize);
+    std::memcpy(ram + Memory::VRAMOffset, memory.vram, Memory::VRAMSize);
+
+    // BIOS is read-only to the guest, writes fault and are dropped by the slow path
+    if (!mapView(0x00000000, ram_fd, Memory::BIOSOffset, Memory::BIOSSize, false))
+        return false;
+    const uint32_t region_size = 1 << 24;
+    for (uint32_t offset = 0; offset < region_size; offset += Memory::EWRAMSize) {
+        if (!mapView(0x02000000 + offset, ram_fd, Memory::EWRAMOffset, Memory::EWRAMSize, true))
+            return false;
+    }
+    for (uint32_t offset = 0; offset < region_size; offset += Memory::IWRAMSize) {
+        if (!mapView(0x03000000 + offset, ram_fd, Memory::IWRAMOffset, Memory::IWRAMSize, true))
+            return false;
+    }
+    // VRAM mirrors every 128K, the last 32K of each mirror repeats 0x10000-0x17FFF
+    for (uint32_t offset = 0; offset < region_size; offset += 0x20000) {
+        if (!mapView(0x06000000 + offset, ram_fd, Memory::VRAMOffset, Memory::VRAMSize, true) ||
+            !mapView(0x06018000 + offset, ram_fd, Memory::VRAMOffset + 0x10000, 0x8000, true))
+            return false;
+    }
+    return true;
+}
+
+bool GBA::FastMem::mapROM(const ROMImage& image) {
+    const uint32_t windows[] = {0x08000000, 0x0A000000, 0x0C000000};
+    for (uint32_t window : windows) {
+        void* view = mmap(
+            base + window, 2 * Memory::ROMMaxSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+            -1, 0);
+        if (view == MAP_FAILED)
+            return false;
+    }
+    if (rom_fd >= 0) {
+        close(rom_fd);
+        rom_fd = -1;
+    }
+
+    int fd = image.getFd();
+    if (fd < 0) {
+        rom_fd = memfd_create("gba-rom", MFD_CLOEXEC);
+        if (rom_fd < 0 || ftruncate(rom_fd, image.getSize()) != 0 ||
+            pwrite(rom_fd, image.getData(), image.getSize(), 0) != static_cast<ssize_t>(image.getSize()))
+            return false;
+        fd = rom_fd;
+    }
+
+    // a partial last host page stays unmapped so reads past the end reach the open bus emulation
+    uint64_t mapped_size = roundDownToHostPage(image.getSize());
+    if (mapped_size == 0)
+        return true;
+    for (uint32_t window : windows) {
+        if (!mapView(window, fd, 0, mapped_size, false))
+            return false;
+    }
+    return true;
+}
+
+#else
+
+GBA::FastMem::FastMem(Memory& memory)
+    : memory(memory), base{}, ram_fd{-1}, ram{}, rom_fd{-1} {
+}
+
+GBA::FastMem::~FastMem() {
+}
+
+std::unique_ptr<GBA::FastMem> GBA::FastMem::create(Memory&) {
+    return nullptr;
+}
+
+bool GBA::FastMem::contains(const void*) const {
+    return false;
+}
+
+uint32_t GBA::FastMem::service(Access, uint32_t, uint32_t) {
+    return 0;
+}
+
+bool GBA::FastMem::mapROM(const ROMImage&) {
+    return false;
+}
+
+#endif
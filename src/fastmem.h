@@ -0,0 +1,152 @@
+#ifndef GBA_FASTMEM_H
+#define GBA_FASTMEM_H
+
+#include "common.h"
+#include <cstdint>
+#include <memory>
+
+#if defined(__linux__) && defined(__x86_64__) && defined(__GNUC__)
+#define GBA_FASTMEM_SUPPORTED 1
+#else
+#define GBA_FASTMEM_SUPPORTED 0
+#endif
+
+namespace GBA {
+
+class Memory;
+class ROMImage;
+
+// Host virtual memory backend for Memory. The whole 32-bit guest address space is reserved as PROT_NONE and
+// only BIOS, EWRAM, IWRAM, VRAM and cartridge ROM (with all of their mirrors) are backed by memfd pages, so a
+// guest access is a single host load/store from base + address. Accesses to anything else fault, the SIGSEGV
+// handler services them through Memory's slow path and resumes after the faulting instruction.
+class FastMem
+{
+  public:
+    static const uint64_t ArenaSize = 1ull << 32;
+    // Never mapped, catches host code walking off the end of the arena
+    static const uint64_t GuardSize = 64 * 1024;
+
+    // Kind of access recorded for every fastmem load/store so the fault handler knows how to service it
+    enum class Access : uint32_t {
+        Read8 = 0,
+        Read16 = 1,
+        Read32 = 2,
+        Write8 = 3,
+        Write16 = 4,
+        Write32 = 5,
+    };
+
+    static constexpr bool isSupported() { return GBA_FASTMEM_SUPPORTED; }
+
+    // Reserves the arena and moves the contents of memory's directly mapped regions into it,
+    // returns null if the host does not support it or the mappings could not be created
+    static std::unique_ptr<FastMem> create(Memory& memory);
+    ~FastMem();
+    FastMem(const FastMem&) = delete;
+    FastMem& operator=(const FastMem&) = delete;
+
+    uint8_t* getBase() const { return base; }
+
+    // Read-write view of the backing file, this becomes the region buffer of Memory
+    uint8_t* getRAM() const { return ram; }
+
+    // Replaces the cartridge mapped in the three wait state windows, returns false on failure.
+    // Images backed by a file are mapped from it directly, others are copied into an anonymous file.
+    bool mapROM(const ROMImage& image);
+
+    bool contains(const void* address) const;
+
+    // Emulates a faulting access through Memory's slow path, returns the loaded value for reads
+    uint32_t service(Access access, uint32_t address, uint32_t value);
+
+  private:
+    explicit FastMem(Memory& memory);
+    bool reserve();
+    bool mapRAM();
+    bool mapView(uint32_t address, int fd, uint64_t offset, uint64_t size, bool writable);
+
+    Memory& memory;
+    uint8_t* base;
+    int ram_fd;
+    uint8_t* ram;
+    int rom_fd;
+};
+
+#if GBA_FASTMEM_SUPPORTED
+
+// Every access instruction is recorded in the gba_fastmem_fixups section as (faulting instruction, resume
+// address, access kind), both addresses relative to the entry. The guest address is always in rsi, loaded
+// values are returned in eax and stored values are taken from edx so the fault handler can emulate them.
+// The entries join the section group of the enclosing function, so they are dropped along with a duplicate
+// inline copy the linker discards instead of pointing into it.
+#define GBA_FASTMEM_FIXUP(access)               \
+    ".pushsection gba_fastmem_fixups,\"a?\"\n"  \
+    ".balign 4\n"                               \
+    ".long 1b - .\n"                            \
+    ".long 2b - .\n"                            \
+    ".long " #access "\n"                       \
+    ".popsection\n"
+
+template <class T>
+inline T fastMemRead(uint8_t* base, uint32_t address) {
+    uint32_t value;
+    uint64_t offset = address;
+    if constexpr (sizeof(T) == 1)
+        asm volatile("1: movzbl (%%rdi,%%rsi), %%eax\n2:\n" GBA_FASTMEM_FIXUP(0)
+                     : "=a"(value)
+                     : "D"(base), "S"(offset)
+                     : "memory");
+    else if constexpr (sizeof(T) == 2)
+        asm volatile("1: movzwl (%%rdi,%%rsi), %%eax\n2:\n" GBA_FASTMEM_FIXUP(1)
+                     : "=a"(value)
+                     : "D"(base), "S"(offset)
+                     : "memory");
+    else
+        asm volatile("1: movl (%%rdi,%%rsi), %%eax\n2:\n" GBA_FASTMEM_FIXUP(2)
+                     : "=a"(value)
+                     : "D"(base), "S"(offset)
+                     : "memory");
+    return static_cast<T>(value);
+}
+
+template <class T>
+inline void fastMemWrite(uint8_t* base, uint32_t address, T value) {
+    uint32_t data = value;
+    uint64_t offset = address;
+    if constexpr (sizeof(T) == 1)
+        asm volatile("1: movb %%dl, (%%rdi,%%rsi)\n2:\n" GBA_FASTMEM_FIXUP(3)
+                     :
+                     : "D"(base), "S"(offset), "d"(data)
+                     : "memory");
+    else if constexpr (sizeof(T) == 2)
+        asm volatile("1: movw %%dx, (%%rdi,%%rsi)\n2:\n" GBA_FASTMEM_FIXUP(4)
+                     :
+                     : "D"(base), "S"(offset), "d"(data)
+                     : "memory");
+    else
+        asm volatile("1: movl %%edx, (%%rdi,%%rsi)\n2:\n" GBA_FASTMEM_FIXUP(5)
+                     :
+                     : "D"(base), "S"(offset), "d"(data)
+                     : "memory");
+}
+
+#undef GBA_FASTMEM_FIXUP
+
+#else
+
+// Never called, FastMem::create always fails on unsupported hosts
+template <class T>
+inline T fastMemRead(uint8_t*, uint32_t) {
+    return 0;
+}
+
+template <class T>
+inline void fastMemWrite(uint8_t*, uint32_t, T) {
+}
+
+#endif
+
+}
+
+#endif
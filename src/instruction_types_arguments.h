@@ -13,19 +13,21 @@ struct DataProcessingArguments
     uint32_t shifted_value;
     uint32_t shift_value;
     ShiftType shift_type;
-    uint32_t PC;  // address of the instruction
+    uint32_t PC;          // address of the instruction
+    bool register_shift;  // shift_value comes from a register, 0 means no shift instead of LSR/ASR #32 or RRX
 
     DataProcessingArguments() = default;
     DataProcessingArguments(
         bool S, uint32_t _Rd, uint32_t _Rn, uint32_t _shifted_value, uint32_t _shift_value, ShiftType _shift_type,
-        uint32_t _PC)
+        uint32_t _PC, bool _register_shift = false)
         : S(S),
           Rn(_Rn),
           Rd(_Rd),
           shifted_value(_shifted_value),
           shift_value(_shift_value),
           shift_type(_shift_type),
-          PC(_PC){};
+          PC(_PC),
+          register_shift(_register_shift){};
 };
 
 struct MultiplyArguments
@@ -45,7 +47,7 @@ struct MultiplyArguments
 
 struct MultiplyLongArguments
 {
-    bool U;  // unsigned bit
+    bool U;  // signed bit, set for SMULL/SMLAL
     bool A;  // accumulate bit
     bool S;  // status bit
     uint32_t RdHi;
@@ -0,0 +1,395 @@
+#include "jit.h"
+#include "cpu.h"
+#include "shifter.h"
+#include "trace.h"
+
+#if GBA_JIT_SUPPORTED
+
+#include <cstring>
+#include <sys/mman.h>
+
+namespace {
+
+// Upper bound of the code compiled for one block, checked before compiling instead of on every byte
+const size_t MaxBlockCodeSize = 96 * GBA::BlockCache::MaxBlockLength + 256;
+
+// Just the x86-64 encodings the recompiler uses. The CPU is addressed through rbx, the end of the cycle budget
+// is kept in r12, eax and ecx are scratch.
+class Emitter
+{
+  public:
+    explicit Emitter(uint8_t* position) : position(position) {}
+
+    uint8_t* here() const { return position; }
+
+    void bytes(std::initializer_list<uint8_t> values) {
+        for (uint8_t value : values)
+            *position++ = value;
+    }
+    void imm32(uint32_t value) {
+        std::memcpy(position, &value, sizeof(value));
+        position += sizeof(value);
+    }
+    void imm64(uint64_t value) {
+        std::memcpy(position, &value, sizeof(value));
+        position += sizeof(value);
+    }
+    void rel32(const uint8_t* target) { imm32(static_cast<uint32_t>(target - (position + 4))); }
+
+    // [rbx + displacement] operands
+    void loadEAX(int32_t displacement) {
+        bytes({0x8B, 0x83});
+        imm32(displacement);
+    }
+    void loadECX(int32_t displacement) {
+        bytes({0x8B, 0x8B});
+        imm32(displacement);
+    }
+    void storeEAX(int32_t displacement) {
+        bytes({0x89, 0x83});
+        imm32(displacement);
+    }
+    void storeECX(int32_t displacement) {
+        bytes({0x89, 0x8B});
+        imm32(displacement);
+    }
+    void storeImmediate(int32_t displacement, uint32_t value) {
+        bytes({0xC7, 0x83});
+        imm32(displacement);
+        imm32(value);
+    }
+    void subtractFromEAX(int32_t displacement) {
+        bytes({0x2B, 0x83});
+        imm32(displacement);
+    }
+
+    void moveEAX(uint32_t value) {
+        bytes({0xB8});
+        imm32(value);
+    }
+    void moveECXToEAX() { bytes({0x89, 0xC8}); }
+    void notECX() { bytes({0xF7, 0xD1}); }
+    // opcode is the eax, imm32 form of the operation
+    void aluEAXImmediate(uint8_t opcode, uint32_t value) {
+        bytes({opcode});
+        imm32(value);
+    }
+    // opcode is the r/m32, r32 form of the operation
+    void aluEAXECX(uint8_t opcode) { bytes({opcode, 0xC8}); }
+
+    // jcc (0x83 jae, 0x84 je, 0x85 jne) and jmp to target
+    void jumpIf(uint8_t condition, const uint8_t* target) {
+        bytes({0x0F, condition});
+        rel32(target);
+    }
+    void jump(const uint8_t* target) {
+        bytes({0xE9});
+        rel32(target);
+    }
+
+    // cmp qword [rbx + displacement], r12
+    void compareWithEnd(int32_t displacement) {
+        bytes({0x4C, 0x39, 0xA3});
+        imm32(displacement);
+    }
+    // cmp dword [rbx + displacement], imm32
+    void compareImmediate(int32_t displacement, uint32_t value) {
+        bytes({0x81, 0xBB});
+        imm32(displacement);
+        imm32(value);
+    }
+
+    // helper(cpu, argument, pc, end), then test al, al
+    void callHelper(const void* helper, const void* argument, uint32_t pc) {
+        bytes({0x48, 0x89, 0xDF});  // mov rdi, rbx
+        bytes({0x48, 0xBE});        // mov rsi, imm64
+        imm64(reinterpret_cast<uint64_t>(argument));
+        bytes({0xBA});  // mov edx, imm32
+        imm32(pc);
+        bytes({0x4C, 0x89, 0xE1});  // mov rcx, r12
+        bytes({0x48, 0xB8});        // mov rax, imm64
+        imm64(reinterpret_cast<uint64_t>(helper));
+        bytes({0xFF, 0xD0});  // call rax
+        bytes({0x84, 0xC0});  // test al, al
+    }
+
+  private:
+    uint8_t* position;
+};
+
+// Branch target of a block's last instruction if it is a direct branch, the fallthrough address otherwise
+uint32_t getArmBranchTarget(uint32_t instruction_code, uint32_t pc) {
+    if ((instruction_code & 0x0E000000) != 0x0A000000)
+        return pc + 4;
+    int32_t offset = static_cast<int32_t>(instruction_code << 8) >> 6;
+    return pc + 8 + offset;
+}
+
+uint32_t getThumbBranchTarget(uint16_t instruction_code, uint32_t pc) {
+    // conditional branch, SWI (condition 0xF) excluded
+    if ((instruction_code & 0xF000) == 0xD000 && (instruction_code & 0x0F00) != 0x0F00)
+        return pc + 4 + (static_cast<int32_t>(static_cast<int8_t>(instruction_code & 0xFF)) << 1);
+    if ((instruction_code & 0xF800) == 0xE000)
+        return pc + 4 + (static_cast<int32_t>(static_cast<uint32_t>(instruction_code) << 21) >> 20);
+    return pc + 2;
+}
+
+}
+
+GBA::JIT::JIT(CPU& cpu) : cpu(cpu), code{}, code_size{}, stubs_size{}, entry{}, exit{}, blocks{}, idle_blocks{} {
+}
+
+GBA::JIT::~JIT() {
+    if (code != nullptr)
+        munmap(code, CodeBufferSize);
+}
+
+std::unique_ptr<GBA::JIT> GBA::JIT::create(CPU& cpu) {
+    void* buffer =
+        mmap(nullptr, CodeBufferSize, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED)
+        return nullptr;
+    std::unique_ptr<JIT> jit(new JIT(cpu));
+    jit->code = static_cast<uint8_t*>(buffer);
+
+    // entry(cpu, end, block): keeps the stack 16-byte aligned for the helper calls
+    Emitter emitter(jit->code);
+    jit->entry = emitter.here();
+    emitter.bytes({0x53});                    // push rbx
+    emitter.bytes({0x41, 0x54});              // push r12
+    emitter.bytes({0x48, 0x83, 0xEC, 0x08});  // sub rsp, 8
+    emitter.bytes({0x48, 0x89, 0xFB});        // mov rbx, rdi
+    emitter.bytes({0x49, 0x89, 0xF4});        // mov r12, rsi
+    emitter.bytes({0xFF, 0xE2});              // jmp rdx
+    jit->exit = emitter.here();
+    emitter.bytes({0x48, 0x83, 0xC4, 0x08});  // add rsp, 8
+    emitter.bytes({0x41, 0x5C});              // pop r12
+    emitter.bytes({0x5B});                    // pop rbx
+    emitter.bytes({0xC3});                    // ret
+    jit->code_size = jit->stubs_size = emitter.here() - jit->code;
+    return jit;
+}
+
+const uint8_t* GBA::JIT::find(uint32_t address, bool thumb) const {
+    auto it = blocks.find(address | thumb);
+    return it == blocks.end() ? nullptr : it->second;
+}
+
+bool GBA::JIT::isIdleLoop(uint32_t address, bool thumb) const {
+    return idle_blocks.count(address | thumb) != 0;
+}
+
+const uint8_t* GBA::JIT::compile(const BlockCache::Block& block) {
+    if (code_size + MaxBlockCodeSize > CodeBufferSize)
+        return nullptr;
+
+    auto displacement = [this](const void* member) {
+        return static_cast<int32_t>(static_cast<const uint8_t*>(member) - reinterpret_cast<const uint8_t*>(&cpu));
+    };
+    const int32_t pc_register = displacement(&cpu.active_registers[15]);
+    const int32_t total_cycles = displacement(&cpu.total_cycles);
+    const int32_t fetch_sequential = displacement(&cpu.fetch_sequential);
+
+    uint8_t* start = code + code_size;
+    Emitter emitter(start);
+    uint32_t pc = block.address;
+    uint32_t target;
+
+    if (block.thumb) {
+        for (size_t i = 0; i < block.thumb_ops.size(); i++, pc += 2) {
+            emitter.callHelper(reinterpret_cast<const void*>(&runThumbOp), &block.thumb_ops[i], pc);
+            emitter.jumpIf(0x84, exit);
+            if (i + 1 < block.thumb_ops.size()) {
+                emitter.compareImmediate(pc_register, pc + 2);
+                emitter.jumpIf(0x85, exit);
+            }
+        }
+        target = getThumbBranchTarget(block.thumb_ops.back().instruction_code, pc - 2);
+    }
+    else {
+        for (size_t i = 0; i < block.arm_ops.size(); i++, pc += 4) {
+            uint32_t instruction_code = block.arm_ops[i].instruction_code;
+            uint32_t opcode = (instruction_code >> 21) & 0xF;
+            uint32_t rn = (instruction_code >> 16) & 0xF;
+            uint32_t rd = (instruction_code >> 12) & 0xF;
+            uint32_t rm = instruction_code & 0xF;
+            bool immediate = (instruction_code >> 25) & 0x1;
+            bool uses_rn = opcode != 0xD && opcode != 0xF;
+            // AND, EOR, SUB, RSB, ADD, ORR, MOV, BIC and MVN without S and without a shift, neither reading nor
+            // writing R15. Translated instructions are not traced, so only with tracing off.
+            bool translated = Trace::level == Trace::Off && (instruction_code >> 28) == 0xE &&
+                              (instruction_code & 0x0C100000) == 0 && (opcode <= 0x4 || opcode >= 0xC) &&
+                              rd != 15 && (!uses_rn || rn != 15) &&
+                              (immediate || ((instruction_code & 0xFF0) == 0 && rm != 15));
+            if (!translated) {
+                emitter.callHelper(reinterpret_cast<const void*>(&runArmOp), &block.arm_ops[i], pc);
+                emitter.jumpIf(0x84, exit);
+                if (i + 1 < block.arm_ops.size()) {
+                    emitter.compareImmediate(pc_register, pc + 4);
+                    emitter.jumpIf(0x85, exit);
+                }
+                continue;
+            }
+
+            // the fetch: fetch_cycles entry for the address, the sequential entries follow 32 bytes later
+            const uint8_t* fetch_cycles = &cpu.memory.fetch_cycles[Memory::getTimingIndex(pc, true, false)];
+            emitter.bytes({0x0F, 0xB6, 0x8B});  // movzx ecx, byte [rbx + fetch_sequential]
+            emitter.imm32(fetch_sequential);
+            emitter.bytes({0xC1, 0xE1, 0x05});  // shl ecx, 5
+            emitter.bytes({0x48, 0xB8});        // mov rax, imm64
+            emitter.imm64(reinterpret_cast<uint64_t>(fetch_cycles));
+            emitter.bytes({0x0F, 0xB6, 0x04, 0x08});  // movzx eax, byte [rax + rcx]
+            emitter.bytes({0x48, 0x01, 0x83});        // add [rbx + total_cycles], rax
+            emitter.imm32(total_cycles);
+            emitter.bytes({0xC6, 0x83});  // mov byte [rbx + fetch_sequential], 1
+            emitter.imm32(fetch_sequential);
+            emitter.bytes({0x01});
+
+            const int32_t rd_register = displacement(&cpu.active_registers[rd]);
+            const int32_t rn_register = displacement(&cpu.active_registers[rn]);
+            uint32_t operand = rotateRight(instruction_code & 0xFF, ((instruction_code >> 8) & 0xF) * 2);
+            if (!immediate)
+                emitter.loadECX(displacement(&cpu.active_registers[rm]));
+
+            if (opcode == 0xD || opcode == 0xF) {
+                if (immediate) {
+                    emitter.storeImmediate(rd_register, opcode == 0xF ? ~operand : operand);
+                }
+                else {
+                    if (opcode == 0xF)
+                        emitter.notECX();
+                    emitter.storeECX(rd_register);
+                }
+            }
+            else if (opcode == 0x3) {
+                // RSB: operand - Rn
+                if (immediate)
+                    emitter.moveEAX(operand);
+                else
+                    emitter.moveECXToEAX();
+                emitter.subtractFromEAX(rn_register);
+                emitter.storeEAX(rd_register);
+            }
+            else {
+                // host eax, imm32 and r/m32, r32 opcodes, BIC is an AND with the inverted operand
+                uint8_t immediate_opcode;
+                uint8_t register_opcode;
+                switch (opcode) {
+                case 0x1:
+                    immediate_opcode = 0x35;
+                    register_opcode = 0x31;
+                    break;
+                case 0x2:
+                    immediate_opcode = 0x2D;
+                    register_opcode = 0x29;
+                    break;
+                case 0x4:
+                    immediate_opcode = 0x05;
+                    register_opcode = 0x01;
+                    break;
+                case 0xC:
+                    immediate_opcode = 0x0D;
+                    register_opcode = 0x09;
+                    break;
+                default:
+                    immediate_opcode = 0x25;
+                    register_opcode = 0x21;
+                    break;
+                }
+                emitter.loadEAX(rn_register);
+                if (immediate) {
+                    emitter.aluEAXImmediate(immediate_opcode, opcode == 0xE ? ~operand : operand);
+                }
+                else {
+                    if (opcode == 0xE)
+                        emitter.notECX();
+                    emitter.aluEAXECX(register_opcode);
+                }
+                emitter.storeEAX(rd_register);
+            }
+
+            emitter.storeImmediate(pc_register, pc + 4);
+            emitter.compareWithEnd(total_cycles);
+            emitter.jumpIf(0x83, exit);
+        }
+        target = getArmBranchTarget(block.arm_ops.back().instruction_code, pc - 4);
+    }
+
+    // block linking, the budget and code writes have been checked after the last instruction
+    // idle loops return after every iteration so the CPU can skip the rest of them
+    const uint8_t* linked = target == block.address ? (block.idle ? nullptr : start) : find(target, block.thumb);
+    if (linked != nullptr) {
+        emitter.compareImmediate(pc_register, target);
+        emitter.jumpIf(0x84, linked);
+    }
+    emitter.jump(exit);
+
+    code_size = emitter.here() - code;
+    blocks[block.address | block.thumb] = start;
+    if (block.idle)
+        idle_blocks.insert(block.address | block.thumb);
+    return start;
+}
+
+void GBA::JIT::run(const uint8_t* block_code, uint64_t end) {
+    using Entry = void (*)(CPU* cpu, uint64_t end, const uint8_t* block_code);
+    reinterpret_cast<Entry>(const_cast<uint8_t*>(entry))(&cpu, end, block_code);
+}
+
+void GBA::JIT::clear() {
+    code_size = stubs_size;
+    blocks.clear();
+    idle_blocks.clear();
+}
+
+bool GBA::JIT::runArmOp(CPU* cpu, const BlockCache::ArmOp* op, uint32_t pc, uint64_t end) {
+    cpu->executeArm(op->handler, op->instruction_code, pc);
+    cpu->finishInstruction(pc + 4);
+    return cpu->inArm() && !cpu->memory.hasCodeWrites() && !cpu->memory.isSleeping() && cpu->total_cycles < end;
+}
+
+bool GBA::JIT::runThumbOp(CPU* cpu, const BlockCache::ThumbOp* op, uint32_t pc, uint64_t end) {
+    cpu->executeThumb(op->handler, op->instruction_code, pc);
+    cpu->finishInstruction(pc + 2);
+    return cpu->inThumb() && !cpu->memory.hasCodeWrites() && !cpu->memory.isSleeping() && cpu->total_cycles < end;
+}
+
+#else
+
+GBA::JIT::JIT(CPU& cpu) : cpu(cpu), code{}, code_size{}, stubs_size{}, entry{}, exit{}, blocks{}, idle_blocks{} {
+}
+
+GBA::JIT::~JIT() {
+}
+
+std::unique_ptr<GBA::JIT> GBA::JIT::create(CPU&) {
+    return nullptr;
+}
+
+const uint8_t* GBA::JIT::find(uint32_t, bool) const {
+    return nullptr;
+}
+
+bool GBA::JIT::isIdleLoop(uint32_t, bool) const {
+    return false;
+}
+
+const uint8_t* GBA::JIT::compile(const BlockCache::Block&) {
+    return nullptr;
+}
+
+void GBA::JIT::run(const uint8_t*, uint64_t) {
+}
+
+void GBA::JIT::clear() {
+}
+
+bool GBA::JIT::runArmOp(CPU*, const BlockCache::ArmOp*, uint32_t, uint64_t) {
+    return false;
+}
+
+bool GBA::JIT::runThumbOp(CPU*, const BlockCache::ThumbOp*, uint32_t, uint64_t) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef GBA_JIT_H
+#define GBA_JIT_H
+
+#include "block_cache.h"
+#include "common.h"
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+#if defined(__linux__) && defined(__x86_64__) && defined(__GNUC__)
+#define GBA_JIT_SUPPORTED 1
+#else
+#define GBA_JIT_SUPPORTED 0
+#endif
+
+namespace GBA {
+
+class CPU;
+
+// x86-64 recompiler for the blocks of the block cache. Simple ARM data processing instructions (unconditional,
+// no flags, immediate or plain register operand) are translated to host instructions working on the active
+// register file, every other instruction is a call to its interpreter handler. Thumb blocks are never translated,
+// every Thumb instruction is such a call, so for Thumb code this only saves the dispatch between blocks. Blocks
+// ending in a branch to an already compiled block (or to themselves) jump there directly as long as the cycle
+// budget allows.
+//
+// Compiled code refers to the ops of the block cache, so whenever blocks are dropped from the cache all compiled
+// code has to be dropped with clear().
+class JIT
+{
+  public:
+    static const size_t CodeBufferSize = 16 * 1024 * 1024;
+
+    static constexpr bool isSupported() { return GBA_JIT_SUPPORTED; }
+
+    // Maps the code buffer, returns null if the host does not support it or refuses executable memory
+    static std::unique_ptr<JIT> create(CPU& cpu);
+    ~JIT();
+    JIT(const JIT&) = delete;
+    JIT& operator=(const JIT&) = delete;
+
+    // Compiled code of the block at address, null if it has not been compiled
+    const uint8_t* find(uint32_t address, bool thumb) const;
+    // Whether the compiled block at address is an idle loop, see CPU::skipIdleLoop
+    bool isIdleLoop(uint32_t address, bool thumb) const;
+    // Compiles a block, returns null when the code buffer is full
+    const uint8_t* compile(const BlockCache::Block& block);
+    // Runs compiled code until it leaves the compiled blocks or the total cycle count reaches end
+    void run(const uint8_t* code, uint64_t end);
+    void clear();
+
+    size_t getCodeSize() const { return code_size; }
+    size_t getBlockCount() const { return blocks.size(); }
+
+  private:
+    explicit JIT(CPU& cpu);
+
+    // Called from compiled code, runs one op through the interpreter. Returns false if the block has to be left
+    // even when the op continued at the next instruction.
+    static bool runArmOp(CPU* cpu, const BlockCache::ArmOp* op, uint32_t pc, uint64_t end);
+    static bool runThumbOp(CPU* cpu, const BlockCache::ThumbOp* op, uint32_t pc, uint64_t end);
+
+    CPU& cpu;
+    uint8_t* code;
+    size_t code_size;
+    size_t stubs_size;
+    // Code entering compiled blocks (saves registers and jumps to the block) and leaving them
+    const uint8_t* entry;
+    const uint8_t* exit;
+    std::unordered_map<uint32_t, const uint8_t*> blocks;
+    // Keys of the compiled blocks that are idle loops
+    std::unordered_set<uint32_t> idle_blocks;
+};
+
+}
+
+#endif
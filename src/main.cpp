@@ -1,6 +1,8 @@
 #include "common.h"
 #include "emulator.h"
+#include "trace.h"
 #include <SDL2/SDL.h>
+#include <cstring>
 #include <vector>
 
 void handleKeyEvent(const SDL_Event& event) {
@@ -51,32 +53,75 @@ void handleKeyEvent(const SDL_Event& event) {
 }
 
 int main(int argc, char** argv) {
-    if (argc != 2) {
-        std::fprintf(stderr, "Usage: GBA_Emu ROM\n");
+    // --direct-boot skips the BIOS boot intro, always done when there is no BIOS to run it
+    bool direct_boot = false;
+    // --backend picks how instructions run, so the backends can be compared on the same ROM
+    GBA::CPU::Backend backend = GBA::CPU::Backend::BlockCache;
+    // --fastmem maps guest memory into the host address space, accesses to IO and the other unmapped regions fault
+    bool fastmem = false;
+    while (argc > 1 && std::strncmp(argv[1], "--", 2) == 0) {
+        if (std::strcmp(argv[1], "--direct-boot") == 0)
+            direct_boot = true;
+        else if (std::strcmp(argv[1], "--fastmem") == 0)
+            fastmem = true;
+        else if (std::strcmp(argv[1], "--backend=interp") == 0)
+            backend = GBA::CPU::Backend::Interpreter;
+        else if (std::strcmp(argv[1], "--backend=cache") == 0)
+            backend = GBA::CPU::Backend::BlockCache;
+        else if (std::strcmp(argv[1], "--backend=jit") == 0)
+            backend = GBA::CPU::Backend::Recompiler;
+        else {
+            std::fprintf(stderr, "Unknown option %s\n", argv[1]);
+            return -1;
+        }
+        argv++;
+        argc--;
+    }
+    if (argc != 2 && argc != 3) {
+        std::fprintf(stderr, "Usage: GBA_Emu [--direct-boot] [--fastmem] [--backend=interp|cache|jit] ROM [BIOS]\n");
         return -1;
     }
+    if constexpr (GBA::Trace::level > GBA::Trace::Off) {
+        // has to come before fastmem so its fault handler forwards real crashes here
+        FILE* trace_file = std::fopen("gba_trace.bin", "wb");
+        if (trace_file != NULL)
+            GBA::Trace::dumpOnCrash(fileno(trace_file));
+    }
     GBA::Emulator emulator;
+    // the page tables stay in use if the host can't reserve the arena
+    if (fastmem && !emulator.enableFastMem())
+        std::fprintf(stderr, "Fastmem is not supported on this host, using the page tables\n");
+    // the block cache works everywhere, the recompiler only on x86-64 hosts that allow executable memory
+    if (!emulator.setBackend(backend)) {
+        std::fprintf(stderr, "The recompiler is not supported on this host, using the block cache\n");
+        emulator.setBackend(GBA::CPU::Backend::BlockCache);
+    }
     {
-        FILE* rom_file = std::fopen(argv[1], "rb");
-        if (rom_file == NULL) {
-            std::perror("Failed to open file");
+        auto rom = GBA::ROMImage::map(argv[1]);
+        if (rom == nullptr) {
+            std::perror("Failed to map ROM file");
             return -1;
         }
-        std::fseek(rom_file, 0, SEEK_END);
-        auto rom_size = std::ftell(rom_file);
-        std::rewind(rom_file);
-        if (rom_size < 0) {
-            std::fprintf(stderr, "Failed to determine ROM size\n");
-            return -1;
-        }
-        std::vector<uint8_t> rom_buffer(rom_size);
-        if (std::fread(rom_buffer.data(), sizeof(uint8_t), rom_buffer.size(), rom_file) != rom_size) {
-            std::fprintf(stderr, "Failed to read the entire file\n");
+        emulator.loadROM(std::move(rom));
+    }
+    if (argc == 3) {
+        FILE* bios_file = std::fopen(argv[2], "rb");
+        if (bios_file == NULL) {
+            std::perror("Failed to open BIOS file");
             return -1;
         }
-        std::fclose(rom_file);
-        emulator.loadBIOS(std::move(rom_buffer));
-    }
+        std::vector<uint8_t> bios_buffer(GBA::Memory::BIOSSize);
+        bios_buffer.resize(std::fread(bios_buffer.data(), sizeof(uint8_t), bios_buffer.size(), bios_file));
+        std::fclose(bios_file);
+        emulator.loadBIOS(bios_buffer);
+    }
+    else {
+        // without a BIOS dump its functions have to be emulated
+        emulator.loadBIOS(GBA::BIOS::makeHLEImage());
+        emulator.setHLEBIOS(true);
+    }
+    if (direct_boot || argc == 2)
+        emulator.directBoot();
 
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         std::fprintf(stderr, "Failed to initialize SDL2 library: %s\n", SDL_GetError());
@@ -131,9 +176,7 @@ int main(int argc, char** argv) {
                 break;
             }
         }
-        // TODO: emulate n instructions (advance N clock cycles?)
-        for (size_t i = 0; i < 400; i++)
-            emulator.step();  // how many is N?
+        emulator.runFrame();
         SDL_RenderClear(renderer);
         auto [displayBufferStart, displayBufferEnd] = emulator.getDisplay();
         // TODO: render
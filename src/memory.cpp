@@ -1,24 +1,448 @@
 #include "memory.h"
+#include <algorithm>
 #include <cstring>
 
-GBA::Memory::Memory() : memory(MaxSize) {
-    for(size_t i = 0; i < DisplayBufferSize; i += 4) {
-        memory[DisplayBufferAddress + i] = 0x00;        // R
-        memory[DisplayBufferAddress + i + 1] = 0x00;    // G
-        memory[DisplayBufferAddress + i + 2] = 0x00;    // B
-        memory[DisplayBufferAddress + i + 3] = 0xFF;    // A
+GBA::Memory::Memory()
+    : ram_storage(RAMSize),
+      bios{},
+      ewram{},
+      iwram{},
+      vram{},
+      rom_image{},
+      rom{},
+      rom_size{},
+      io(IOSize),
+      palette(PaletteSize),
+      oam(OAMSize),
+      sram(SRAMSize),
+      display_buffer(DisplayBufferSize),
+      read_pages{},
+      write_pages{},
+      fastmem{},
+      fastmem_base{},
+      access_cycles{},
+      fetch_cycles{},
+      code_pages{},
+      marked_code_pages{},
+      code_writes{},
+      power_state{PowerState::Running},
+      irq_disabled{},
+      irq_pending{} {
+    // at most every page is written once before the writes are cleared, recording them never allocates
+    code_writes.reserve(CodePageCount);
+    for (size_t i = 0; i < DisplayBufferSize; i += 4) {
+        display_buffer[i] = 0x00;      // R
+        display_buffer[i + 1] = 0x00;  // G
+        display_buffer[i + 2] = 0x00;  // B
+        display_buffer[i + 3] = 0xFF;  // A
     }
+    setRAM(ram_storage.data());
+    mapPages();
+    updateWaitStates();
 }
 
 GBA::Memory::~Memory() {
 }
 
+void GBA::Memory::setRAM(uint8_t* ram) {
+    bios = ram + BIOSOffset;
+    ewram = ram + EWRAMOffset;
+    iwram = ram + IWRAMOffset;
+    vram = ram + VRAMOffset;
+}
+
 void GBA::Memory::loadBIOS(const std::vector<uint8_t>& bios) {
-    std::memcpy(memory.data(), bios.data(), bios.size());
+    std::memcpy(this->bios, bios.data(), std::min<size_t>(bios.size(), BIOSSize));
+}
+
+void GBA::Memory::loadROM(const std::vector<uint8_t>& rom) {
+    loadROM(ROMImage::fromBuffer(rom));
+}
+
+void GBA::Memory::loadROM(std::shared_ptr<const ROMImage> image) {
+    rom_image = std::move(image);
+    rom = rom_image->getData();
+    rom_size = rom_image->getSize();
+    // if the arena can't map the new cartridge its windows stay unmapped and ROM reads fault into the slow path
+    if (fastmem)
+        fastmem->mapROM(*rom_image);
+    mapPages();
+}
+
+bool GBA::Memory::enableFastMem() {
+    if (fastmem)
+        return true;
+    fastmem = FastMem::create(*this);
+    if (!fastmem)
+        return false;
+    setRAM(fastmem->getRAM());
+    ram_storage.clear();
+    ram_storage.shrink_to_fit();
+    mapPages();
+    fastmem_base = fastmem->getBase();
+    return true;
+}
+
+void GBA::Memory::mapPages() {
+    read_pages.fill(nullptr);
+    write_pages.fill(nullptr);
+
+    auto region_page = [](Region region) { return static_cast<uint32_t>(region) << (24 - PageShift); };
+    const uint32_t pages_per_region = 1 << (24 - PageShift);
+
+    read_pages[region_page(Region::BIOS)] = bios;
+
+    for (uint32_t i = 0; i < pages_per_region; i++) {
+        uint32_t offset = i << PageShift;
+        uint32_t page = region_page(Region::EWRAM) + i;
+        read_pages[page] = write_pages[page] = &ewram[offset & (EWRAMSize - 1)];
+        page = region_page(Region::IWRAM) + i;
+        read_pages[page] = write_pages[page] = &iwram[offset & (IWRAMSize - 1)];
+        page = region_page(Region::VRAM) + i;
+        read_pages[page] = write_pages[page] = &vram[getVRAMOffset(offset)];
+    }
+
+    // the last partial page of the cartridge is left to the slow path so it can return open bus values
+    for (uint32_t offset = 0; offset + PageSize <= rom_size; offset += PageSize) {
+        for (auto region : {Region::ROMWaitState0, Region::ROMWaitState1, Region::ROMWaitState2}) {
+            uint32_t page = region_page(region) + (offset >> PageShift);
+            read_pages[page] = &rom[offset];
+        }
+    }
+}
+
+void GBA::Memory::markCode(uint32_t address) {
+    uint32_t code_page = getCodePage(address);
+    if (code_page != NoCodePage && !code_pages.test(code_page)) {
+        code_pages.set(code_page);
+        marked_code_pages++;
+    }
+}
+
+void GBA::Memory::updateWaitStates() {
+    // https://problemkaputt.de/gbatek.htm#gbasystemcontrol
+    uint16_t waitcnt = loadLittleEndian<uint16_t>(&io[WAITCNTAddress & (IOSize - 1)]);
+    const uint8_t nonsequential_waits[] = {4, 3, 2, 8};
+    const uint8_t sequential_waits[][2] = {{2, 1}, {4, 1}, {8, 1}};
+    bool prefetch = (waitcnt >> 14) & 0x1;
+
+    for (uint32_t region = 0; region < 16; region++) {
+        // cycles of one access of the bus width, and whether the bus is 16 bits wide
+        uint32_t nonsequential = 1;
+        uint32_t sequential = 1;
+        bool narrow_bus = false;
+        switch (static_cast<Region>(region)) {
+        case Region::EWRAM:
+            nonsequential = sequential = 3;
+            narrow_bus = true;
+            break;
+        case Region::Palette:
+        case Region::VRAM:
+            narrow_bus = true;
+            break;
+        case Region::ROMWaitState0:
+        case Region::ROMWaitState0Mirror:
+        case Region::ROMWaitState1:
+        case Region::ROMWaitState1Mirror:
+        case Region::ROMWaitState2:
+        case Region::ROMWaitState2Mirror: {
+            uint32_t wait_state = (region - static_cast<uint32_t>(Region::ROMWaitState0)) / 2;
+            nonsequential = 1 + nonsequential_waits[(waitcnt >> (2 + 3 * wait_state)) & 0x3];
+            sequential = 1 + sequential_waits[wait_state][(waitcnt >> (4 + 3 * wait_state)) & 0x1];
+            narrow_bus = true;
+            break;
+        }
+        case Region::SRAM:
+        case Region::SRAMMirror:
+            nonsequential = sequential = 1 + nonsequential_waits[waitcnt & 0x3];
+            break;
+        default:
+            break;
+        }
+
+        for (bool word : {false, true}) {
+            // a word on a 16-bit bus is the access itself followed by a sequential one for the upper half
+            uint32_t second_half = word && narrow_bus ? sequential : 0;
+            access_cycles[getTimingIndex(region << 24, word, false)] = nonsequential + second_half;
+            access_cycles[getTimingIndex(region << 24, word, true)] = sequential + second_half;
+            fetch_cycles[getTimingIndex(region << 24, word, false)] = nonsequential + second_half;
+            fetch_cycles[getTimingIndex(region << 24, word, true)] = sequential + second_half;
+        }
+        // the prefetcher reads ahead while the CPU is busy, sequential opcodes are then ready in one cycle per
+        // halfword
+        if (prefetch && region >= static_cast<uint32_t>(Region::ROMWaitState0) &&
+            region <= static_cast<uint32_t>(Region::ROMWaitState2Mirror)) {
+            fetch_cycles[getTimingIndex(region << 24, false, true)] = 1;
+            fetch_cycles[getTimingIndex(region << 24, true, true)] = 2;
+        }
+    }
+}
+
+uint32_t GBA::Memory::getVRAMOffset(uint32_t address) {
+    uint32_t offset = address & 0x1FFFF;
+    if (offset >= VRAMSize)
+        offset -= 0x8000;
+    return offset;
+}
+
+namespace {
+
+// Video memory sits on a 16-bit bus, byte writes are duplicated to both halves of the halfword
+template <class T>
+void storeVideoMemory(uint8_t* data, uint32_t address, T value) {
+    if constexpr (sizeof(T) == 1)
+        GBA::storeLittleEndian<uint16_t>(data - (address & 0x1), static_cast<uint16_t>(value * 0x0101));
+    else
+        GBA::storeLittleEndian<T>(data, value);
+}
+
+// Bytes past the end of the cartridge return the lower bits of their halfword address
+template <class T>
+T readROMOpenBus(const uint8_t* rom, uint32_t rom_size, uint32_t offset) {
+    T value = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+        uint32_t byte_offset = offset + i;
+        uint32_t open_bus = (byte_offset >> 1) & 0xFFFF;
+        uint32_t byte = (byte_offset & 0x1) ? open_bus >> 8 : open_bus & 0xFF;
+        if (byte_offset < rom_size)
+            byte = rom[byte_offset];
+        value |= static_cast<T>(byte) << (8 * i);
+    }
+    return value;
+}
+
+}
+
+template <class T>
+T GBA::Memory::readSlow(uint32_t address) const {
+    address &= ~static_cast<uint32_t>(sizeof(T) - 1);
+    if (address >> 28)  // nothing is mapped above 0x0FFFFFFF
+        return 0;
+
+    switch (getRegion(address)) {
+    case Region::BIOS:
+        if (address >= BIOSSize)
+            return 0;
+        return loadLittleEndian<T>(&bios[address]);
+    case Region::EWRAM:
+        return loadLittleEndian<T>(&ewram[address & (EWRAMSize - 1)]);
+    case Region::IWRAM:
+        return loadLittleEndian<T>(&iwram[address & (IWRAMSize - 1)]);
+    case Region::IO:
+        if ((address & 0x00FFFFFF) >= IOSize)
+            return 0;
+        return loadLittleEndian<T>(&io[address & (IOSize - 1)]);
+    case Region::Palette:
+        return loadLittleEndian<T>(&palette[address & (PaletteSize - 1)]);
+    case Region::VRAM:
+        return loadLittleEndian<T>(&vram[getVRAMOffset(address)]);
+    case Region::OAM:
+        return loadLittleEndian<T>(&oam[address & (OAMSize - 1)]);
+    case Region::ROMWaitState0:
+    case Region::ROMWaitState0Mirror:
+    case Region::ROMWaitState1:
+    case Region::ROMWaitState1Mirror:
+    case Region::ROMWaitState2:
+    case Region::ROMWaitState2Mirror: {
+        uint32_t offset = address & (ROMMaxSize - 1);
+        if (offset + sizeof(T) <= rom_size)
+            return loadLittleEndian<T>(&rom[offset]);
+        return readROMOpenBus<T>(rom, rom_size, offset);
+    }
+    case Region::SRAM:
+    case Region::SRAMMirror:
+        // SRAM sits on an 8-bit bus, wider reads return the byte repeated
+        return static_cast<T>(sram[address & (SRAMSize - 1)] * static_cast<T>(0x01010101));
+    default:
+        return 0;
+    }
+}
+
+template <class T>
+void GBA::Memory::writeSlow(uint32_t address, T value) {
+    if (address >> 28)
+        return;
+    if (getRegion(address) != Region::SRAM && getRegion(address) != Region::SRAMMirror)
+        address &= ~static_cast<uint32_t>(sizeof(T) - 1);
+
+    switch (getRegion(address)) {
+    case Region::EWRAM:
+        storeLittleEndian<T>(&ewram[address & (EWRAMSize - 1)], value);
+        break;
+    case Region::IWRAM:
+        storeLittleEndian<T>(&iwram[address & (IWRAMSize - 1)], value);
+        break;
+    case Region::IO:
+        if ((address & 0x00FFFFFF) < IOSize) {
+            uint16_t requested = loadLittleEndian<uint16_t>(&io[IFAddress & (IOSize - 1)]);
+            storeLittleEndian<T>(&io[address & (IOSize - 1)], value);
+            if ((address & (IOSize - 1) & ~0x3) == (WAITCNTAddress & (IOSize - 1)))
+                updateWaitStates();
+            uint32_t offset = address & (IOSize - 1) & ~static_cast<uint32_t>(sizeof(T) - 1);
+            uint32_t haltcnt_offset = HALTCNTAddress & (IOSize - 1);
+            if (offset <= haltcnt_offset && haltcnt_offset < offset + sizeof(T))
+                power_state = (io[haltcnt_offset] & 0x80) ? PowerState::Stopped : PowerState::Halted;
+            // writing 1s to IF acknowledges those interrupts, the written bytes clear bits instead of replacing them
+            uint32_t if_offset = IFAddress & (IOSize - 1);
+            for (uint32_t i = 0; i < 2; i++) {
+                if (offset <= if_offset + i && if_offset + i < offset + sizeof(T))
+                    io[if_offset + i] = (requested >> (8 * i)) & ~io[if_offset + i];
+            }
+            if (offset + sizeof(T) > (IEAddress & (IOSize - 1)) && offset <= (IMEAddress & (IOSize - 1)))
+                updateInterrupts();
+        }
+        break;
+    case Region::Palette:
+        storeVideoMemory<T>(&palette[address & (PaletteSize - 1)], address, value);
+        break;
+    case Region::VRAM:
+        storeVideoMemory<T>(&vram[getVRAMOffset(address)], address, value);
+        break;
+    case Region::OAM:
+        if constexpr (sizeof(T) != 1)  // byte writes to OAM are ignored
+            storeLittleEndian<T>(&oam[address & (OAMSize - 1)], value);
+        break;
+    case Region::SRAM:
+    case Region::SRAMMirror:
+        // only the byte selected by the address reaches the 8-bit SRAM bus
+        sram[address & (SRAMSize - 1)] = static_cast<uint8_t>(value >> (8 * (address & (sizeof(T) - 1))));
+        break;
+    case Region::BIOS:
+    default:
+        // BIOS and cartridge ROM are read-only, unused regions ignore writes
+        break;
+    }
+}
+
+template uint8_t GBA::Memory::readSlow<uint8_t>(uint32_t address) const;
+template uint16_t GBA::Memory::readSlow<uint16_t>(uint32_t address) const;
+template uint32_t GBA::Memory::readSlow<uint32_t>(uint32_t address) const;
+template void GBA::Memory::writeSlow<uint8_t>(uint32_t address, uint8_t value);
+template void GBA::Memory::writeSlow<uint16_t>(uint32_t address, uint16_t value);
+template void GBA::Memory::writeSlow<uint32_t>(uint32_t address, uint32_t value);
+
+void GBA::Memory::requestInterrupt(uint16_t interrupts) {
+    uint8_t* request = &io[IFAddress & (IOSize - 1)];
+    storeLittleEndian<uint16_t>(request, loadLittleEndian<uint16_t>(request) | interrupts);
+    updateInterrupts();
+}
+
+uint16_t GBA::Memory::getPendingInterrupts() const {
+    return loadLittleEndian<uint16_t>(&io[IEAddress & (IOSize - 1)]) &
+           loadLittleEndian<uint16_t>(&io[IFAddress & (IOSize - 1)]);
+}
+
+void GBA::Memory::setIRQDisabled(bool disabled) {
+    irq_disabled = disabled;
+    updateInterrupts();
+}
+
+void GBA::Memory::updateInterrupts() {
+    bool master_enable = io[IMEAddress & (IOSize - 1)] & 0x1;
+    irq_pending = master_enable && !irq_disabled && getPendingInterrupts() != 0;
+}
+
+template <class T>
+void GBA::Memory::copy(uint32_t destination, uint32_t source, uint32_t count) {
+    destination &= ~static_cast<uint32_t>(sizeof(T) - 1);
+    source &= ~static_cast<uint32_t>(sizeof(T) - 1);
+    while (count > 0) {
+        uint32_t source_page = source >> PageShift;
+        uint32_t destination_page = destination >> PageShift;
+        // units left in both pages, overlapping runs are copied unit by unit to keep the forward order
+        uint32_t run = std::min({count, (PageSize - (source & (PageSize - 1))) / static_cast<uint32_t>(sizeof(T)),
+                                 (PageSize - (destination & (PageSize - 1))) / static_cast<uint32_t>(sizeof(T))});
+        const uint8_t* from = source_page < PageCount ? read_pages[source_page] : nullptr;
+        uint8_t* to = destination_page < PageCount ? write_pages[destination_page] : nullptr;
+        if (from != nullptr && to != nullptr) {
+            from += source & (PageSize - 1);
+            to += destination & (PageSize - 1);
+            uint32_t size = run * sizeof(T);
+            if (from + size <= to || to + size <= from) {
+                std::memcpy(to, from, size);
+                recordCodeWrites(destination, size);
+                source += size;
+                destination += size;
+                count -= run;
+                continue;
+            }
+        }
+        write<T>(destination, read<T>(source));
+        source += sizeof(T);
+        destination += sizeof(T);
+        count--;
+    }
+}
+
+template <class T>
+void GBA::Memory::fill(uint32_t destination, T value, uint32_t count) {
+    destination &= ~static_cast<uint32_t>(sizeof(T) - 1);
+    while (count > 0) {
+        uint32_t page = destination >> PageShift;
+        uint32_t run = std::min(count, (PageSize - (destination & (PageSize - 1))) / static_cast<uint32_t>(sizeof(T)));
+        uint8_t* to = page < PageCount ? write_pages[page] : nullptr;
+        if (to != nullptr) {
+            to += destination & (PageSize - 1);
+            for (uint32_t i = 0; i < run; i++)
+                storeLittleEndian<T>(to + i * sizeof(T), value);
+            recordCodeWrites(destination, run * sizeof(T));
+            destination += run * sizeof(T);
+            count -= run;
+            continue;
+        }
+        write<T>(destination, value);
+        destination += sizeof(T);
+        count--;
+    }
+}
+
+template <class T>
+void GBA::Memory::writeBuffer(uint32_t destination, const uint8_t* data, uint32_t count) {
+    destination &= ~static_cast<uint32_t>(sizeof(T) - 1);
+    while (count > 0) {
+        uint32_t page = destination >> PageShift;
+        uint32_t run = std::min(count, (PageSize - (destination & (PageSize - 1))) / static_cast<uint32_t>(sizeof(T)));
+        uint8_t* to = page < PageCount ? write_pages[page] : nullptr;
+        // byte writes to VRAM do not store a single byte, leave them to write
+        if (to != nullptr && (sizeof(T) != 1 || getRegion(destination) != Region::VRAM)) {
+            std::memcpy(to + (destination & (PageSize - 1)), data, run * sizeof(T));
+            recordCodeWrites(destination, run * sizeof(T));
+            data += run * sizeof(T);
+            destination += run * sizeof(T);
+            count -= run;
+            continue;
+        }
+        write<T>(destination, loadLittleEndian<T>(data));
+        data += sizeof(T);
+        destination += sizeof(T);
+        count--;
+    }
+}
+
+template void GBA::Memory::copy<uint16_t>(uint32_t destination, uint32_t source, uint32_t count);
+template void GBA::Memory::copy<uint32_t>(uint32_t destination, uint32_t source, uint32_t count);
+template void GBA::Memory::fill<uint16_t>(uint32_t destination, uint16_t value, uint32_t count);
+template void GBA::Memory::fill<uint32_t>(uint32_t destination, uint32_t value, uint32_t count);
+template void GBA::Memory::writeBuffer<uint8_t>(uint32_t destination, const uint8_t* data, uint32_t count);
+template void GBA::Memory::writeBuffer<uint16_t>(uint32_t destination, const uint8_t* data, uint32_t count);
+template void GBA::Memory::writeBuffer<uint32_t>(uint32_t destination, const uint8_t* data, uint32_t count);
+
+uint32_t GBA::Memory::read16Rotated(uint32_t address) const {
+    uint32_t value = read16(address);
+    if (address & 0x1)
+        return (value >> 8) | (value << 24);
+    return value;
+}
+
+uint32_t GBA::Memory::read32Rotated(uint32_t address) const {
+    uint32_t value = read32(address);
+    uint32_t rotation = (address & 0x3) * 8;
+    if (rotation == 0)
+        return value;
+    return (value >> rotation) | (value << (32 - rotation));
 }
 
 std::pair<std::vector<uint8_t>::const_iterator, std::vector<uint8_t>::const_iterator>
     GBA::Memory::getDisplayBuffer() const {
-    return std::make_pair(
-        memory.begin() + DisplayBufferAddress, memory.begin() + DisplayBufferAddress + DisplayBufferSize);
+    return std::make_pair(display_buffer.begin(), display_buffer.end());
 }
@@ -2,32 +2,338 @@
 #define GBA_MEMORY_H
 
 #include "common.h"
+#include "fastmem.h"
+#include "rom_image.h"
+#include <array>
+#include <bitset>
 #include <cstdint>
+#include <cstring>
+#include <memory>
 #include <utility>
 #include <vector>
 
 namespace GBA {
 
+// Guest memory is little-endian, on little-endian hosts these compile to a single host load/store
+template <class T>
+inline T loadLittleEndian(const uint8_t* data) {
+    T value;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = 0;
+    for (size_t i = 0; i < sizeof(T); i++)
+        value |= static_cast<T>(data[i]) << (8 * i);
+#else
+    std::memcpy(&value, data, sizeof(T));
+#endif
+    return value;
+}
+
+template <class T>
+inline void storeLittleEndian(uint8_t* data, T value) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for (size_t i = 0; i < sizeof(T); i++)
+        data[i] = static_cast<uint8_t>(value >> (8 * i));
+#else
+    std::memcpy(data, &value, sizeof(T));
+#endif
+}
+
 class Memory
 {
   public:
-    // This should be mapped somehow
-    // https://github.com/ayvacs/gba.js.org/blob/main/iodineGBA/core/Memory.js#L4975
-    static const size_t MaxSize = 0xFFFFFFFF;
-    static const size_t DisplayBufferAddress = 1 << 30;
+    // GBA memory map, regions are selected by bits 27-24 of the address
+    // https://problemkaputt.de/gbatek.htm#gbamemorymap
+    enum class Region {
+        BIOS = 0x0,
+        EWRAM = 0x2,
+        IWRAM = 0x3,
+        IO = 0x4,
+        Palette = 0x5,
+        VRAM = 0x6,
+        OAM = 0x7,
+        ROMWaitState0 = 0x8,
+        ROMWaitState0Mirror = 0x9,
+        ROMWaitState1 = 0xA,
+        ROMWaitState1Mirror = 0xB,
+        ROMWaitState2 = 0xC,
+        ROMWaitState2Mirror = 0xD,
+        SRAM = 0xE,
+        SRAMMirror = 0xF,
+    };
+
+    static const uint32_t BIOSSize = 16 * 1024;
+    static const uint32_t EWRAMSize = 256 * 1024;
+    static const uint32_t IWRAMSize = 32 * 1024;
+    static const uint32_t IOSize = 1024;
+    static const uint32_t PaletteSize = 1024;
+    static const uint32_t VRAMSize = 96 * 1024;
+    static const uint32_t OAMSize = 1024;
+    static const uint32_t ROMMaxSize = ROMImage::MaxSize;
+    static const uint32_t SRAMSize = 64 * 1024;
     static const size_t DisplayBufferSize = 240 * 160 * 4;
+
+    // The 28-bit bus is split into 16K pages, each page points straight at host memory or is null
+    // when accesses have to go through the slow path (IO registers, palette, OAM, SRAM, open bus)
+    static const uint32_t PageShift = 14;
+    static const uint32_t PageSize = 1 << PageShift;
+    static const uint32_t PageCount = 1 << (28 - PageShift);
+
+    // EWRAM and IWRAM are split into 256-byte code pages (EWRAM first) so the CPU can cache decoded instructions
+    // from RAM and drop them when the code is overwritten
+    static const uint32_t CodePageShift = 8;
+    static const uint32_t CodePageCount = (EWRAMSize + IWRAMSize) >> CodePageShift;
+    static const uint32_t NoCodePage = UINT32_MAX;
+
     Memory();
     ~Memory();
+    Memory(const Memory&) = delete;
+    Memory& operator=(const Memory&) = delete;
 
     void loadBIOS(const std::vector<uint8_t>& bios);
+    void loadROM(const std::vector<uint8_t>& rom);
+    // Maps the image into the cartridge windows without copying it, the image is kept alive by the memory
+    void loadROM(std::shared_ptr<const ROMImage> image);
+
+    // Switches to the host virtual memory backend, returns false (and keeps the page tables) if it is unavailable
+    bool enableFastMem();
+    bool isFastMemEnabled() const { return fastmem_base != nullptr; }
+
+    static Region getRegion(uint32_t address) { return static_cast<Region>((address >> 24) & 0xF); }
+
+    // Little-endian accesses through the memory map, mirrors are resolved by masking the address.
+    // Halfword and word accesses are forced to the natural alignment like on the real bus.
+    uint8_t read8(uint32_t address) const { return read<uint8_t>(address); }
+    uint16_t read16(uint32_t address) const { return read<uint16_t>(address); }
+    uint32_t read32(uint32_t address) const { return read<uint32_t>(address); }
+    void write8(uint32_t address, uint8_t value) { write<uint8_t>(address, value); }
+    void write16(uint32_t address, uint16_t value) { write<uint16_t>(address, value); }
+    void write32(uint32_t address, uint32_t value) { write<uint32_t>(address, value); }
+
+    // Same as count reads of T from source, each written to destination, both moving forward. Runs that stay in
+    // directly mapped pages on both sides (RAM, VRAM, ROM as the source) are copied with memcpy, or filled, in
+    // one go. The addresses are aligned down to T.
+    template <class T>
+    void copy(uint32_t destination, uint32_t source, uint32_t count);
+    template <class T>
+    void fill(uint32_t destination, T value, uint32_t count);
+    // Writes count units of T from a host buffer, the same way as copy
+    template <class T>
+    void writeBuffer(uint32_t destination, const uint8_t* data, uint32_t count);
+
+    // ARM7TDMI unaligned load semantics (LDR, LDRH, SWP): the aligned value is rotated right by the misalignment
+    uint32_t read16Rotated(uint32_t address) const;
+    uint32_t read32Rotated(uint32_t address) const;
 
     std::pair<std::vector<uint8_t>::const_iterator, std::vector<uint8_t>::const_iterator> getDisplayBuffer() const;
 
-    std::vector<uint8_t> memory;
+    // Code page of a RAM address, NoCodePage outside of EWRAM and IWRAM
+    static uint32_t getCodePage(uint32_t address) {
+        switch (getRegion(address)) {
+        case Region::EWRAM:
+            return (address & (EWRAMSize - 1)) >> CodePageShift;
+        case Region::IWRAM:
+            return (EWRAMSize + (address & (IWRAMSize - 1))) >> CodePageShift;
+        default:
+            return NoCodePage;
+        }
+    }
+    // Instructions can be cached from read-only regions and from RAM, where writes to code pages are tracked
+    static bool isCodeCacheable(uint32_t address) {
+        Region region = getRegion(address);
+        return region == Region::BIOS || region == Region::EWRAM || region == Region::IWRAM ||
+               (region >= Region::ROMWaitState0 && region <= Region::ROMWaitState2Mirror);
+    }
+    // Marks the code page of address as holding cached instructions, the next write to it is recorded
+    void markCode(uint32_t address);
+    // Code pages written since the last clearCodeWrites, each page is recorded once until it is marked again
+    bool hasCodeWrites() const { return !code_writes.empty(); }
+    const std::vector<uint32_t>& getCodeWrites() const { return code_writes; }
+    void clearCodeWrites() { code_writes.clear(); }
+
+    // LCD control, the BIOS leaves the display in forced blank
+    static const uint32_t DISPCNTAddress = 0x04000000;
+    // LCD status and the scanline being drawn, updated by the emulator on scanline events
+    static const uint32_t DISPSTATAddress = 0x04000004;
+    static const uint32_t VCOUNTAddress = 0x04000006;
+    // Waitstate control register, sets the cartridge and SRAM access times
+    static const uint32_t WAITCNTAddress = 0x04000204;
+    // Sound PWM bias, serial mode and the flag the BIOS sets after its first boot
+    static const uint32_t SOUNDBIASAddress = 0x04000088;
+    static const uint32_t RCNTAddress = 0x04000134;
+    static const uint32_t POSTFLGAddress = 0x04000300;
+    // Interrupt enable, request and master enable, and the power down control written by the BIOS Halt and Stop
+    static const uint32_t IEAddress = 0x04000200;
+    static const uint32_t IFAddress = 0x04000202;
+    static const uint32_t IMEAddress = 0x04000208;
+    static const uint32_t HALTCNTAddress = 0x04000301;
+
+    // Interrupt sources, the bits of IE and IF
+    enum Interrupt : uint16_t {
+        VBlankInterrupt = 1 << 0,
+        HBlankInterrupt = 1 << 1,
+        VCountInterrupt = 1 << 2,
+        TimerInterrupt = 1 << 3,  // timer 0, the others follow
+        SerialInterrupt = 1 << 7,
+        DMAInterrupt = 1 << 8,  // DMA 0, the others follow
+        KeypadInterrupt = 1 << 12,
+        GamePakInterrupt = 1 << 13,
+    };
+    // Sets bits in IF, like an interrupt source firing
+    void requestInterrupt(uint16_t interrupts);
+    // Requested interrupts that are enabled in IE, regardless of IME
+    uint16_t getPendingInterrupts() const;
+    // Whether the CPU has to take the IRQ exception: an enabled interrupt is requested, IME is set and the CPSR I bit
+    // is clear. Kept up to date on writes to IE, IF and IME, on requestInterrupt and when the CPU passes its I bit on
+    // with setIRQDisabled, so checking for an interrupt is a single flag test.
+    bool isIRQPending() const { return irq_pending; }
+    void setIRQDisabled(bool disabled);
+
+    // Writing HALTCNT puts the CPU to sleep until an interrupt is pending, with bit 7 set it enters the deeper
+    // stop mode which only keypad, serial and cartridge interrupts end
+    enum class PowerState {
+        Running,
+        Halted,
+        Stopped,
+    };
+    PowerState getPowerState() const { return power_state; }
+    bool isSleeping() const { return power_state != PowerState::Running; }
+    void wakeUp() { power_state = PowerState::Running; }
+
+    // Cycles of a data access, sequential accesses follow the previous one at the next address. Regions on a
+    // 16-bit bus take two accesses for a word.
+    template <class T>
+    uint32_t getAccessCycles(uint32_t address, bool sequential) const {
+        return access_cycles[getTimingIndex(address, sizeof(T) == 4, sequential)];
+    }
+    // Cycles of an opcode fetch, same as a data access except that sequential cartridge fetches are served by the
+    // GamePak prefetch buffer when it is enabled
+    template <class T>
+    uint32_t getFetchCycles(uint32_t address, bool sequential) const {
+        return fetch_cycles[getTimingIndex(address, sizeof(T) == 4, sequential)];
+    }
 
   private:
+    friend class FastMem;
+    friend class JIT;
+
+    template <class T>
+    T read(uint32_t address) const;
+    template <class T>
+    void write(uint32_t address, T value);
+
+    // Region decoding for pages that are not directly mapped
+    template <class T>
+    T readSlow(uint32_t address) const;
+    template <class T>
+    void writeSlow(uint32_t address, T value);
+
+    // Rebuilds the page tables, must be called whenever a region buffer is (re)allocated
+    void mapPages();
+
+    void recordCodeWrite(uint32_t address) {
+        if (marked_code_pages == 0)
+            return;
+        uint32_t code_page = getCodePage(address);
+        if (code_page != NoCodePage && code_pages.test(code_page)) {
+            code_pages.reset(code_page);
+            marked_code_pages--;
+            code_writes.push_back(code_page);
+        }
+    }
+
+    // Recomputes irq_pending
+    void updateInterrupts();
+
+    void recordCodeWrites(uint32_t address, uint32_t size) {
+        if (marked_code_pages == 0)
+            return;
+        for (uint32_t offset = 0; offset < size; offset += 1 << CodePageShift)
+            recordCodeWrite(address + offset);
+        recordCodeWrite(address + size - 1);
+    }
+
+    // Rebuilds the timing tables from WAITCNT
+    void updateWaitStates();
+    static uint32_t getTimingIndex(uint32_t address, bool word, bool sequential) {
+        return ((address >> 24) & 0xF) | (word << 4) | (sequential << 5);
+    }
+
+    // Offset of the address inside the 96K VRAM buffer, the upper 32K of each 128K mirror maps to 0x10000-0x17FFF
+    static uint32_t getVRAMOffset(uint32_t address);
+
+    // BIOS, EWRAM, IWRAM and VRAM are laid out in this order in one buffer, either ram_storage or the backing
+    // file of the fastmem arena
+    static const uint32_t BIOSOffset = 0;
+    static const uint32_t EWRAMOffset = BIOSOffset + BIOSSize;
+    static const uint32_t IWRAMOffset = EWRAMOffset + EWRAMSize;
+    static const uint32_t VRAMOffset = IWRAMOffset + IWRAMSize;
+    static const uint32_t RAMSize = VRAMOffset + VRAMSize;
+    void setRAM(uint8_t* ram);
+
+    std::vector<uint8_t> ram_storage;
+    uint8_t* bios;
+    uint8_t* ewram;
+    uint8_t* iwram;
+    uint8_t* vram;
+    std::shared_ptr<const ROMImage> rom_image;
+    const uint8_t* rom;
+    uint32_t rom_size;
+    std::vector<uint8_t> io;
+    std::vector<uint8_t> palette;
+    std::vector<uint8_t> oam;
+    std::vector<uint8_t> sram;
+    std::vector<uint8_t> display_buffer;
+
+    std::array<const uint8_t*, PageCount> read_pages;
+    std::array<uint8_t*, PageCount> write_pages;
+
+    std::unique_ptr<FastMem> fastmem;
+    uint8_t* fastmem_base;
+
+    // Access cycles indexed by getTimingIndex
+    std::array<uint8_t, 64> access_cycles;
+    std::array<uint8_t, 64> fetch_cycles;
+
+    std::bitset<CodePageCount> code_pages;
+    uint32_t marked_code_pages;
+    std::vector<uint32_t> code_writes;
+
+    PowerState power_state;
+    bool irq_disabled;
+    bool irq_pending;
 };
 
+template <class T>
+inline T Memory::read(uint32_t address) const {
+    address &= ~static_cast<uint32_t>(sizeof(T) - 1);
+    if (fastmem_base != nullptr)
+        return fastMemRead<T>(fastmem_base, address);
+    uint32_t page = address >> PageShift;
+    if (page < PageCount && read_pages[page] != nullptr)
+        return loadLittleEndian<T>(read_pages[page] + (address & (PageSize - 1)));
+    return readSlow<T>(address);
+}
+
+template <class T>
+inline void Memory::write(uint32_t address, T value) {
+    recordCodeWrite(address);
+    // byte writes to VRAM are duplicated to the whole halfword, let the slow path handle them
+    bool byte_to_vram = sizeof(T) == 1 && getRegion(address) == Region::VRAM;
+    // SRAM needs the unaligned address to select the byte, the arena only ever sees aligned ones
+    bool wide_to_sram = sizeof(T) != 1 && getRegion(address) >= Region::SRAM;
+    if (fastmem_base != nullptr && !byte_to_vram && !wide_to_sram) {
+        fastMemWrite<T>(fastmem_base, address & ~static_cast<uint32_t>(sizeof(T) - 1), value);
+        return;
+    }
+    uint32_t page = address >> PageShift;
+    if (page < PageCount && write_pages[page] != nullptr && !byte_to_vram) {
+        address &= ~static_cast<uint32_t>(sizeof(T) - 1);
+        storeLittleEndian<T>(write_pages[page] + (address & (PageSize - 1)), value);
+        return;
+    }
+    writeSlow<T>(address, value);
+}
+
 }
 
 #endif
@@ -0,0 +1,83 @@
+#include "rom_image.h"
+#include <algorithm>
+#include <cerrno>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define GBA_ROM_IMAGE_MMAP 1
+#else
+#define GBA_ROM_IMAGE_MMAP 0
+#endif
+
+GBA::ROMImage::ROMImage() : storage{}, data{}, size{}, fd{-1}, mapping{} {
+}
+
+GBA::ROMImage::~ROMImage() {
+#if GBA_ROM_IMAGE_MMAP
+    if (mapping != nullptr)
+        munmap(mapping, size);
+    if (fd >= 0)
+        close(fd);
+#endif
+}
+
+std::shared_ptr<const GBA::ROMImage> GBA::ROMImage::fromBuffer(const std::vector<uint8_t>& buffer) {
+    std::shared_ptr<ROMImage> image(new ROMImage());
+    image->storage.assign(buffer.begin(), buffer.begin() + std::min<size_t>(buffer.size(), MaxSize));
+    image->data = image->storage.data();
+    image->size = image->storage.size();
+    return image;
+}
+
+#if GBA_ROM_IMAGE_MMAP
+
+std::shared_ptr<const GBA::ROMImage> GBA::ROMImage::map(const char* path, bool populate) {
+    std::shared_ptr<ROMImage> image(new ROMImage());
+    image->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (image->fd < 0)
+        return nullptr;
+    struct stat status;
+    if (fstat(image->fd, &status) != 0)
+        return nullptr;
+    if (!S_ISREG(status.st_mode)) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    image->size = static_cast<uint32_t>(std::min<uint64_t>(status.st_size, MaxSize));
+    if (image->size == 0)
+        return image;
+
+    int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+    if (populate)
+        flags |= MAP_POPULATE;
+#endif
+    void* mapping = mmap(nullptr, image->size, PROT_READ, flags, image->fd, 0);
+    if (mapping == MAP_FAILED)
+        return nullptr;
+    image->mapping = mapping;
+    image->data = static_cast<const uint8_t*>(mapping);
+    // the CPU fetches ROM mostly sequentially, let the kernel read ahead aggressively
+    madvise(mapping, image->size, populate ? MADV_WILLNEED : MADV_SEQUENTIAL);
+    return image;
+}
+
+#else
+
+std::shared_ptr<const GBA::ROMImage> GBA::ROMImage::map(const char* path, bool) {
+    FILE* file = std::fopen(path, "rb");
+    if (file == NULL)
+        return nullptr;
+    std::vector<uint8_t> buffer(MaxSize);
+    buffer.resize(std::fread(buffer.data(), sizeof(uint8_t), buffer.size(), file));
+    bool failed = std::ferror(file);
+    std::fclose(file);
+    if (failed)
+        return nullptr;
+    return fromBuffer(buffer);
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef GBA_ROM_IMAGE_H
+#define GBA_ROM_IMAGE_H
+
+#include "common.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace GBA {
+
+// Read-only cartridge image. Files are mapped straight from the page cache so several emulator instances
+// running the same ROM share one copy, images built from a buffer own a private copy instead.
+class ROMImage
+{
+  public:
+    // Largest cartridge the bus can address, anything past it is ignored
+    static const uint32_t MaxSize = 32 * 1024 * 1024;
+
+    // Maps the file read-only, populate prefaults every page up front instead of on first access.
+    // Returns null and leaves errno set if the file could not be opened or mapped.
+    static std::shared_ptr<const ROMImage> map(const char* path, bool populate = false);
+    static std::shared_ptr<const ROMImage> fromBuffer(const std::vector<uint8_t>& buffer);
+
+    ~ROMImage();
+    ROMImage(const ROMImage&) = delete;
+    ROMImage& operator=(const ROMImage&) = delete;
+
+    const uint8_t* getData() const { return data; }
+    uint32_t getSize() const { return size; }
+    // Descriptor of the mapped file or -1 for buffer images, the fastmem arena maps it directly
+    int getFd() const { return fd; }
+
+  private:
+    ROMImage();
+
+    std::vector<uint8_t> storage;
+    const uint8_t* data;
+    uint32_t size;
+    int fd;
+    void* mapping;
+};
+
+}
+
+#endif
@@ -0,0 +1,84 @@
+#include "scheduler.h"
+
+GBA::Scheduler::Scheduler() : heap{}, positions{}, size{0} {
+    positions.fill(NotScheduled);
+}
+
+void GBA::Scheduler::schedule(Event event, uint64_t timestamp) {
+    uint32_t position = positions[static_cast<uint32_t>(event)];
+    if (position == NotScheduled) {
+        position = size++;
+        place(position, Entry{timestamp, event});
+        siftUp(position);
+        return;
+    }
+    uint64_t previous = heap[position].timestamp;
+    heap[position].timestamp = timestamp;
+    if (timestamp < previous)
+        siftUp(position);
+    else
+        siftDown(position);
+}
+
+void GBA::Scheduler::cancel(Event event) {
+    uint32_t position = positions[static_cast<uint32_t>(event)];
+    if (position != NotScheduled)
+        remove(position);
+}
+
+bool GBA::Scheduler::popDue(uint64_t now, Event& event, uint64_t& timestamp) {
+    if (size == 0 || heap[0].timestamp > now)
+        return false;
+    event = heap[0].event;
+    timestamp = heap[0].timestamp;
+    remove(0);
+    return true;
+}
+
+void GBA::Scheduler::place(uint32_t position, const Entry& entry) {
+    heap[position] = entry;
+    positions[static_cast<uint32_t>(entry.event)] = position;
+}
+
+void GBA::Scheduler::siftUp(uint32_t position) {
+    Entry entry = heap[position];
+    while (position > 0) {
+        uint32_t parent = (position - 1) / 2;
+        if (!isBefore(entry, heap[parent]))
+            break;
+        place(position, heap[parent]);
+        position = parent;
+    }
+    place(position, entry);
+}
+
+void GBA::Scheduler::siftDown(uint32_t position) {
+    Entry entry = heap[position];
+    while (true) {
+        uint32_t child = 2 * position + 1;
+        if (child >= size)
+            break;
+        if (child + 1 < size && isBefore(heap[child + 1], heap[child]))
+            child++;
+        if (!isBefore(heap[child], entry))
+            break;
+        place(position, heap[child]);
+        position = child;
+    }
+    place(position, entry);
+}
+
+void GBA::Scheduler::remove(uint32_t position) {
+    positions[static_cast<uint32_t>(heap[position].event)] = NotScheduled;
+    size--;
+    if (position == size)
+        return;
+    // the last entry fills the hole and moves whichever way restores the heap
+    Entry last = heap[size];
+    bool before_parent = position > 0 && isBefore(last, heap[(position - 1) / 2]);
+    place(position, last);
+    if (before_parent)
+        siftUp(position);
+    else
+        siftDown(position);
+}
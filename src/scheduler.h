@@ -0,0 +1,64 @@
+#ifndef GBA_SCHEDULER_H
+#define GBA_SCHEDULER_H
+
+#include "common.h"
+#include <array>
+#include <cstdint>
+
+namespace GBA {
+
+// Timed hardware events keyed by the absolute cycle count (CPU::getTotalCycles) they are due at. Every kind of
+// event is pending at most once, so the events live in a fixed-size indexed min-heap: schedule and cancel are
+// O(log n) and nothing is allocated after construction.
+class Scheduler
+{
+  public:
+    enum class Event : uint32_t {
+        // the end of the visible part of a scanline
+        HBlank,
+        // the start of the next scanline, VBlank begins and ends on scanline boundaries
+        Scanline,
+        Count,
+    };
+    static constexpr uint32_t EventCount = static_cast<uint32_t>(Event::Count);
+    static constexpr uint64_t Never = UINT64_MAX;
+
+    Scheduler();
+
+    // Schedules event at timestamp, replacing its pending timestamp if it is already scheduled
+    void schedule(Event event, uint64_t timestamp);
+    void cancel(Event event);
+    bool isScheduled(Event event) const { return positions[static_cast<uint32_t>(event)] != NotScheduled; }
+
+    // Timestamp of the earliest pending event, Never if there is none
+    uint64_t getNextTimestamp() const { return size == 0 ? Never : heap[0].timestamp; }
+
+    // Removes the earliest pending event if it is due at now, events due at the same time come out in the
+    // order of the Event enum. Returns false if no event is due.
+    bool popDue(uint64_t now, Event& event, uint64_t& timestamp);
+
+  private:
+    struct Entry
+    {
+        uint64_t timestamp;
+        Event event;
+    };
+    static constexpr uint32_t NotScheduled = UINT32_MAX;
+
+    static bool isBefore(const Entry& a, const Entry& b) {
+        return a.timestamp < b.timestamp || (a.timestamp == b.timestamp && a.event < b.event);
+    }
+    void place(uint32_t position, const Entry& entry);
+    void siftUp(uint32_t position);
+    void siftDown(uint32_t position);
+    void remove(uint32_t position);
+
+    std::array<Entry, EventCount> heap;
+    // Heap position of every event, NotScheduled when it is not pending
+    std::array<uint32_t, EventCount> positions;
+    uint32_t size;
+};
+
+}
+
+#endif
@@ -1,3 +1,6 @@
+#ifndef GBA_SHIFT_TYPES_H
+#define GBA_SHIFT_TYPES_H
+
 namespace GBA {
     enum class ShiftType {
         LogicalLeft = 0b00,
@@ -5,4 +8,6 @@ namespace GBA {
         ArithmeticRight = 0b10,
         RotateRight = 0b11,
     };
-}
\ No newline at end of file
+}
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef GBA_SHIFTER_H
+#define GBA_SHIFTER_H
+
+#include "shift_types.h"
+#include <cstdint>
+
+namespace GBA {
+
+// ARM7TDMI barrel shifter. Every shift takes the carry flag in and returns the shifter carry out through carry,
+// amounts that leave the carry unchanged leave it as it was passed in.
+// https://developer.arm.com/documentation/ddi0029/g/arm-instruction-set/data-processing/shifts
+
+// The shifts work on a 64-bit copy with the amount clamped, so amounts of 32 and more need no special cases:
+// the bits shifted out of the 32-bit value land next to it and the carry is the bit closest to it.
+
+inline uint32_t rotateRight(uint32_t value, uint32_t amount) {
+    amount &= 0x1F;
+    return (value >> amount) | (value << ((32 - amount) & 0x1F));
+}
+
+// Shift by the bottom byte of a register, an amount of 0 returns value and carry unchanged
+template <ShiftType shift_type>
+inline uint32_t shiftByRegister(uint32_t value, uint32_t amount, bool& carry) {
+    uint32_t result;
+    bool carry_out;
+    if constexpr (shift_type == ShiftType::LogicalLeft) {
+        uint64_t wide = static_cast<uint64_t>(value) << (amount < 33 ? amount : 33);
+        result = static_cast<uint32_t>(wide);
+        carry_out = (wide >> 32) & 0x1;
+    }
+    else if constexpr (shift_type == ShiftType::LogicalRight) {
+        uint64_t wide = (static_cast<uint64_t>(value) << 32) >> (amount < 33 ? amount : 33);
+        result = static_cast<uint32_t>(wide >> 32);
+        carry_out = (wide >> 31) & 0x1;
+    }
+    else if constexpr (shift_type == ShiftType::ArithmeticRight) {
+        int64_t wide = static_cast<int64_t>(static_cast<uint64_t>(value) << 32) >> (amount < 32 ? amount : 32);
+        result = static_cast<uint32_t>(static_cast<uint64_t>(wide) >> 32);
+        carry_out = (wide >> 31) & 0x1;
+    }
+    else {
+        // the last bit rotated out is bit 31 of the result, a multiple of 32 leaves value as it is
+        result = rotateRight(value, amount);
+        carry_out = result >> 31;
+    }
+    carry = amount == 0 ? carry : carry_out;
+    return amount == 0 ? value : result;
+}
+
+// Shift by a 5-bit immediate, 0 encodes LSL #0 (no shift), LSR #32, ASR #32 and RRX
+template <ShiftType shift_type>
+inline uint32_t shiftByImmediate(uint32_t value, uint32_t amount, bool& carry) {
+    if constexpr (shift_type == ShiftType::LogicalLeft) {
+        return shiftByRegister<shift_type>(value, amount, carry);
+    }
+    else if constexpr (shift_type == ShiftType::LogicalRight || shift_type == ShiftType::ArithmeticRight) {
+        return shiftByRegister<shift_type>(value, amount == 0 ? 32 : amount, carry);
+    }
+    else {
+        uint32_t rrx = (static_cast<uint32_t>(carry) << 31) | (value >> 1);
+        bool rrx_carry = value & 0x1;
+        uint32_t result = shiftByRegister<shift_type>(value, amount, carry);
+        carry = amount == 0 ? rrx_carry : carry;
+        return amount == 0 ? rrx : result;
+    }
+}
+
+// Shift with the type only known at run time
+inline uint32_t shift(ShiftType shift_type, uint32_t value, uint32_t amount, bool register_shift, bool& carry) {
+    switch (shift_type) {
+    case ShiftType::LogicalLeft:
+        return register_shift ? shiftByRegister<ShiftType::LogicalLeft>(value, amount, carry)
+                              : shiftByImmediate<ShiftType::LogicalLeft>(value, amount, carry);
+    case ShiftType::LogicalRight:
+        return register_shift ? shiftByRegister<ShiftType::LogicalRight>(value, amount, carry)
+                              : shiftByImmediate<ShiftType::LogicalRight>(value, amount, carry);
+    case ShiftType::ArithmeticRight:
+        return register_shift ? shiftByRegister<ShiftType::ArithmeticRight>(value, amount, carry)
+                              : shiftByImmediate<ShiftType::ArithmeticRight>(value, amount, carry);
+    default:
+        return register_shift ? shiftByRegister<ShiftType::RotateRight>(value, amount, carry)
+                              : shiftByImmediate<ShiftType::RotateRight>(value, amount, carry);
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,45 @@
+#include "../cpu.h"
+#include "arm_decode_vectors.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using namespace GBA;
+
+// Decode throughput of the decodeArm predicate chain (plus the switch step() used to do on its result)
+// against the pre-decoded table, over the vectors of test_data_processing
+template <class Decode>
+double measure(const std::vector<uint32_t>& instructions, size_t rounds, Decode decode, size_t& defined) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t round = 0; round < rounds; round++) {
+        for (uint32_t instruction : instructions) {
+            if (decode(instruction) != &CPU::callUndefinedInstruction)
+                defined++;
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return rounds * instructions.size() / elapsed.count() / 1e6;
+}
+
+int main(int argc, char** argv) {
+    size_t rounds = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+    std::vector<uint32_t> instructions;
+    for (const auto& [instruction, instruction_type] : arm_decode_vectors)
+        instructions.push_back(instruction);
+
+    CPU cpu;
+    size_t chain_count = 0;
+    size_t table_count = 0;
+    double chain = measure(
+        instructions, rounds,
+        [&cpu](uint32_t instruction) { return CPU::getArmInstructionHandler(cpu.decodeArm(instruction), instruction); },
+        chain_count);
+    double table = measure(
+        instructions, rounds, [](uint32_t instruction) { return CPU::lookupArm(instruction); }, table_count);
+
+    std::cout << "decodeArm chain: " << chain << " Minstr/s\n";
+    std::cout << "decode table:    " << table << " Minstr/s (" << table / chain << "x)\n";
+    // keeps both loops from being optimized away
+    return chain_count == 0 || table_count == 0;
+}
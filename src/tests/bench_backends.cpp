@@ -0,0 +1,97 @@
+#include "../cpu.h"
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+using namespace GBA;
+
+namespace {
+
+const uint32_t ProgramAddress = 0x03000000;
+const uint32_t DataAddress = 0x03000100;
+const uint64_t Cycles = 50000000;
+
+// Counts r5 down, mixing the data processing forms the recompiler translates
+const std::vector<uint32_t> arm_program = {
+    0xE0811000,  // 0x00: add r1, r1, r0
+    0xE0222001,  // 0x04: eor r2, r2, r1
+    0xE0433002,  // 0x08: sub r3, r3, r2
+    0xE1844003,  // 0x0C: orr r4, r4, r3
+    0xE2800001,  // 0x10: add r0, r0, #1
+    0xE2555001,  // 0x14: subs r5, r5, #1
+    0x1AFFFFF8,  // 0x18: bne 0x00
+};
+
+// The same kind of loop in Thumb code, with a load and a store like most game loops
+const std::vector<uint16_t> thumb_program = {
+    0x1809,  // 0x00: add r1, r1, r0
+    0x6832,  // 0x02: ldr r2, [r6]
+    0x6071,  // 0x04: str r1, [r6, #4]
+    0x008B,  // 0x06: lsl r3, r1, #2
+    0x405A,  // 0x08: eor r2, r3
+    0x3D01,  // 0x0A: sub r5, #1
+    0xD1F8,  // 0x0C: bne 0x00
+};
+
+void load(CPU& cpu, bool thumb) {
+    cpu.reset();
+    Memory& memory = cpu.getMemory();
+    if (thumb) {
+        for (size_t i = 0; i < thumb_program.size(); i++)
+            memory.write16(ProgramAddress + 2 * i, thumb_program[i]);
+        cpu.writeCPSR(cpu.getCPSR() | 0x20);
+    }
+    else {
+        for (size_t i = 0; i < arm_program.size(); i++)
+            memory.write32(ProgramAddress + 4 * i, arm_program[i]);
+    }
+    cpu.PC() = ProgramAddress;
+    cpu.R(0) = 1;
+    cpu.R(5) = 0x7FFFFFFF;
+    cpu.R(6) = DataAddress;
+}
+
+// Runs the loop for Cycles emulated cycles, returns the host milliseconds or a negative value if the backend is
+// not supported
+double measure(CPU::Backend backend, bool thumb) {
+    CPU cpu;
+    if (!cpu.setBackend(backend))
+        return -1.0;
+    load(cpu, thumb);
+    auto start = std::chrono::steady_clock::now();
+    cpu.runFor(Cycles);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+}
+
+// Compares the runFor backends on an ARM loop and a Thumb loop in IWRAM. The recompiler only translates ARM
+// blocks, on Thumb code it calls the handlers like the block cache does.
+int main() {
+    struct Backend {
+        const char* name;
+        CPU::Backend backend;
+    };
+    const Backend backends[] = {
+        {"interpreter", CPU::Backend::Interpreter},
+        {"block cache", CPU::Backend::BlockCache},
+        {"recompiler ", CPU::Backend::Recompiler},
+    };
+
+    for (bool thumb : {false, true}) {
+        std::cout << (thumb ? "Thumb" : "ARM") << " loop, " << Cycles << " cycles\n";
+        double interpreter_time = 0.0;
+        for (const Backend& backend : backends) {
+            double time = measure(backend.backend, thumb);
+            if (time < 0.0) {
+                std::cout << "  " << backend.name << ": not supported on this host\n";
+                continue;
+            }
+            if (backend.backend == CPU::Backend::Interpreter)
+                interpreter_time = time;
+            std::cout << "  " << backend.name << ": " << time << " ms (" << interpreter_time / time << "x)\n";
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,205 @@
+#include "../cpu.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+using namespace GBA;
+
+namespace {
+
+const uint32_t ProgramAddress = 0x03000000;
+const uint32_t PayloadAddress = 0x02000000;
+const uint32_t OutputAddress = 0x06000000;
+const uint32_t DataSize = 0x8000;
+
+// 4bpp tile-like data: rows of a few colors repeated with variations, compressible by both formats
+std::vector<uint8_t> makeData() {
+    std::vector<uint8_t> data(DataSize);
+    for (uint32_t i = 0; i < DataSize; i++) {
+        uint32_t tile = i / 32;
+        uint32_t row = (i / 4) & 0x7;
+        data[i] = (row < 2 || row > 5) ? 0x00 : static_cast<uint8_t>(0x11 * (tile % 5 + 1) + (i & 1) * (row & 1));
+    }
+    return data;
+}
+
+std::vector<uint8_t> makeHeader(uint32_t type, uint32_t size) {
+    return {static_cast<uint8_t>(type), static_cast<uint8_t>(size), static_cast<uint8_t>(size >> 8),
+            static_cast<uint8_t>(size >> 16)};
+}
+
+// Greedy LZ77, copies are at least 2 bytes back so the Vram variant of the BIOS can use the data
+std::vector<uint8_t> compressLZ77(const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> output = makeHeader(0x10, data.size());
+    size_t position = 0;
+    while (position < data.size()) {
+        size_t flags_index = output.size();
+        output.push_back(0);
+        for (int i = 0; i < 8 && position < data.size(); i++) {
+            size_t best_length = 0;
+            size_t best_distance = 0;
+            for (size_t distance = 2; distance <= 4096 && distance <= position; distance++) {
+                size_t length = 0;
+                while (length < 18 && position + length < data.size() &&
+                       data[position + length] == data[position - distance + length])
+                    length++;
+                if (length > best_length) {
+                    best_length = length;
+                    best_distance = distance;
+                    if (length == 18)
+                        break;
+                }
+            }
+            if (best_length >= 3) {
+                output[flags_index] |= 0x80 >> i;
+                output.push_back(static_cast<uint8_t>((best_length - 3) << 4 | (best_distance - 1) >> 8));
+                output.push_back(static_cast<uint8_t>(best_distance - 1));
+                position += best_length;
+            }
+            else {
+                output.push_back(data[position++]);
+            }
+        }
+    }
+    while (output.size() % 4 != 0)
+        output.push_back(0);
+    return output;
+}
+
+std::vector<uint8_t> compressRL(const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> output = makeHeader(0x30, data.size());
+    size_t position = 0;
+    std::vector<uint8_t> literals;
+    auto flushLiterals = [&]() {
+        if (literals.empty())
+            return;
+        output.push_back(static_cast<uint8_t>(literals.size() - 1));
+        output.insert(output.end(), literals.begin(), literals.end());
+        literals.clear();
+    };
+    while (position < data.size()) {
+        size_t length = 1;
+        while (length < 130 && position + length < data.size() && data[position + length] == data[position])
+            length++;
+        if (length >= 3) {
+            flushLiterals();
+            output.push_back(static_cast<uint8_t>(0x80 | (length - 3)));
+            output.push_back(data[position]);
+            position += length;
+            continue;
+        }
+        literals.push_back(data[position++]);
+        if (literals.size() == 128)
+            flushLiterals();
+    }
+    flushLiterals();
+    while (output.size() % 4 != 0)
+        output.push_back(0);
+    return output;
+}
+
+void setUp(CPU& cpu, const std::vector<uint8_t>& payload, uint32_t function) {
+    Memory& memory = cpu.getMemory();
+    for (size_t i = 0; i < payload.size(); i++)
+        memory.write8(PayloadAddress + i, payload[i]);
+    memory.fill<uint32_t>(OutputAddress, 0, DataSize / 4);
+    memory.write32(ProgramAddress, 0xEF000000 | function << 16);  // swi function
+    memory.write32(ProgramAddress + 4, 0xEAFFFFFE);                // b .
+    cpu.PC() = ProgramAddress;
+    cpu.R(0) = PayloadAddress;
+    cpu.R(1) = OutputAddress;
+}
+
+bool matches(CPU& cpu, const std::vector<uint8_t>& data) {
+    for (uint32_t i = 0; i < data.size(); i++) {
+        if (cpu.getMemory().read8(OutputAddress + i) != data[i])
+            return false;
+    }
+    return true;
+}
+
+// Runs the swi until it returns, with the BIOS image or natively. Returns host microseconds and emulated cycles
+// per call.
+bool measure(CPU& cpu, const std::vector<uint8_t>& payload, uint32_t function, const std::vector<uint8_t>& data,
+             int rounds, double& microseconds, double& cycles) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t start_cycles = cpu.getTotalCycles();
+    for (int round = 0; round < rounds; round++) {
+        setUp(cpu, payload, function);
+        for (uint64_t steps = 0; cpu.PC() != ProgramAddress + 4; steps++) {
+            if (steps > 100000000)
+                return false;
+            cpu.step();
+        }
+    }
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    microseconds = elapsed.count() / rounds;
+    cycles = static_cast<double>(cpu.getTotalCycles() - start_cycles) / rounds;
+    return matches(cpu, data);
+}
+
+}
+
+// Compares the native decompressors against running the BIOS code in the interpreter on synthetic payloads.
+// Takes a BIOS image as the only argument, without it only the native timings are shown.
+int main(int argc, char** argv) {
+    std::vector<uint8_t> data = makeData();
+    struct Case {
+        const char* name;
+        uint32_t function;
+        std::vector<uint8_t> payload;
+    };
+    std::vector<uint8_t> lz77 = compressLZ77(data);
+    std::vector<uint8_t> rl = compressRL(data);
+    const Case cases[] = {
+        {"LZ77UnCompVram", 0x12, lz77},
+        {"RLUnCompVram", 0x15, rl},
+    };
+
+    CPU cpu;
+    std::vector<uint8_t> bios;
+    if (argc > 1) {
+        std::ifstream file(argv[1], std::ios::binary);
+        bios.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    if (!bios.empty())
+        cpu.loadBIOS(bios);
+    cpu.reset();
+    // the stacks the BIOS leaves after booting, its SWI handler pushes to both
+    cpu.R(13) = 0x03007FE0;
+    cpu.writeCPSR(0xDF);
+    cpu.R(13) = 0x03007F00;
+    cpu.writeCPSR(0xD3);
+
+    bool failed = false;
+    for (const Case& test : cases) {
+        double native_time;
+        double native_cycles;
+        cpu.setHLEBIOS(true);
+        if (!measure(cpu, test.payload, test.function, data, 100, native_time, native_cycles)) {
+            std::cerr << test.name << ": native output is wrong\n";
+            failed = true;
+            continue;
+        }
+        std::cout << test.name << " (" << test.payload.size() << " -> " << data.size() << " bytes)\n";
+        std::cout << "  native:      " << native_time << " us, " << native_cycles << " cycles\n";
+        if (bios.empty())
+            continue;
+
+        double bios_time;
+        double bios_cycles;
+        cpu.setHLEBIOS(false);
+        if (!measure(cpu, test.payload, test.function, data, 5, bios_time, bios_cycles)) {
+            std::cerr << test.name << ": BIOS output is wrong\n";
+            failed = true;
+            continue;
+        }
+        std::cout << "  interpreted: " << bios_time << " us, " << bios_cycles << " cycles ("
+                  << bios_time / native_time << "x slower)\n";
+    }
+    if (bios.empty())
+        std::cout << "no BIOS image given, interpreted timings skipped\n";
+    return failed ? 1 : 0;
+}
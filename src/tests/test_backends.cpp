@@ -0,0 +1,105 @@
+#include "../cpu.h"
+#include <iostream>
+#include <vector>
+
+using namespace GBA;
+
+namespace {
+
+// A loop in IWRAM mixing data processing forms that rewrites its first instruction after every pass: the first
+// pass adds 1 to r1 until it reaches 10, every later pass adds 2. Blocks cached from the first pass must not
+// survive the rewrite.
+const std::vector<uint32_t> program = {
+    0xE2811001,  // 0x00: add r1, r1, #1
+    0xE0855001,  // 0x04: add r5, r5, r1
+    0xE2616064,  // 0x08: rsb r6, r1, #100
+    0xE3C57003,  // 0x0C: bic r7, r5, #3
+    0xE1E08001,  // 0x10: mvn r8, r1
+    0xE0299005,  // 0x14: eor r9, r9, r5
+    0xE186A007,  // 0x18: orr r10, r6, r7
+    0xE04AB008,  // 0x1C: sub r11, r10, r8
+    0xE00BC009,  // 0x20: and r12, r11, r9
+    0xE1A0000C,  // 0x24: mov r0, r12
+    0xE351000A,  // 0x28: cmp r1, #10
+    0x1AFFFFF3,  // 0x2C: bne 0x00
+    0xE3A03403,  // 0x30: mov r3, #0x03000000
+    0xE5932080,  // 0x34: ldr r2, [r3, #0x80]
+    0xE5832000,  // 0x38: str r2, [r3]
+    0xE3A01000,  // 0x3C: mov r1, #0
+    0xE2844001,  // 0x40: add r4, r4, #1
+    0xEAFFFFED,  // 0x44: b 0x00
+};
+const uint32_t ProgramAddress = 0x03000000;
+const uint32_t Replacement = 0xE2811002;  // add r1, r1, #2
+
+void load(CPU& cpu) {
+    std::vector<uint8_t> bios(Memory::BIOSSize);
+    // mov pc, #0x03000000
+    bios[0] = 0x03;
+    bios[1] = 0xF4;
+    bios[2] = 0xA0;
+    bios[3] = 0xE3;
+    cpu.loadBIOS(bios);
+    cpu.reset();
+    for (size_t i = 0; i < program.size(); i++)
+        cpu.getMemory().write32(ProgramAddress + 4 * i, program[i]);
+    cpu.getMemory().write32(ProgramAddress + 0x80, Replacement);
+}
+
+// Runs the program on the interpreter and on backend, both have to stop at the same instruction boundaries
+// with the same registers
+bool compareWithInterpreter(CPU::Backend backend, const char* name) {
+    CPU interpreter;
+    load(interpreter);
+    CPU cpu;
+    load(cpu);
+    if (!cpu.setBackend(backend)) {
+        std::cerr << name << " is not supported on this host, skipped\n";
+        return true;
+    }
+
+    for (int i = 0; i < 50; i++) {
+        interpreter.runFor(97);
+        cpu.runFor(97);
+        bool same = interpreter.getTotalCycles() == cpu.getTotalCycles();
+        for (uint32_t r = 0; r < 16; r++)
+            same = same && interpreter.R(r) == cpu.R(r);
+        if (!same) {
+            std::cerr << name << ", run " << i << ": " << cpu.getTotalCycles() << " cycles instead of "
+                      << interpreter.getTotalCycles() << std::hex << '\n';
+            for (uint32_t r = 0; r < 16; r++)
+                std::cerr << "  r" << std::dec << r << std::hex << ": 0x" << cpu.R(r) << " instead of 0x"
+                          << interpreter.R(r) << '\n';
+            std::cerr << std::dec;
+            return false;
+        }
+    }
+    if (cpu.R(4) < 2) {
+        std::cerr << name << ": the loop was only rewritten " << cpu.R(4) << " times\n";
+        return false;
+    }
+    BlockCache::Stats stats = cpu.getBlockCacheStats();
+    if (stats.block_count == 0 || stats.memory_used == 0) {
+        std::cerr << name << ": " << stats.block_count << " blocks cached in " << stats.memory_used << " bytes\n";
+        return false;
+    }
+    if (backend == CPU::Backend::BlockCache && stats.getHitRate() <= 0.5) {
+        std::cerr << name << ": hit rate " << stats.getHitRate() << " with " << stats.hits << " hits and "
+                  << stats.misses << " misses\n";
+        return false;
+    }
+    return true;
+}
+
+}
+
+int main() {
+    bool failed = false;
+
+    if (!compareWithInterpreter(CPU::Backend::BlockCache, "Block cache"))
+        failed = true;
+    if (!compareWithInterpreter(CPU::Backend::Recompiler, "Recompiler"))
+        failed = true;
+
+    return failed ? 1 : 0;
+}
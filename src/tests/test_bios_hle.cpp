@@ -0,0 +1,146 @@
+#include "../cpu.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace GBA;
+
+namespace {
+
+const uint32_t ProgramAddress = 0x03000000;
+
+// Runs a single ARM swi with the given number and arguments
+void callARM(CPU& cpu, uint32_t function, uint32_t r0, uint32_t r1, uint32_t r2) {
+    cpu.getMemory().write32(ProgramAddress, 0xEF000000 | function << 16);
+    cpu.PC() = ProgramAddress;
+    cpu.R(0) = r0;
+    cpu.R(1) = r1;
+    cpu.R(2) = r2;
+    cpu.step();
+}
+
+void writeBytes(Memory& memory, uint32_t address, const std::vector<uint8_t>& bytes) {
+    for (size_t i = 0; i < bytes.size(); i++)
+        memory.write8(address + i, bytes[i]);
+}
+
+std::string readString(const Memory& memory, uint32_t address, uint32_t size) {
+    std::string result;
+    for (uint32_t i = 0; i < size; i++)
+        result += static_cast<char>(memory.read8(address + i));
+    return result;
+}
+
+bool check(const char* name, const std::string& value, const std::string& expected) {
+    if (value == expected)
+        return true;
+    std::cerr << name << ": \"" << value << "\" instead of \"" << expected << "\"\n";
+    return false;
+}
+
+bool check(const char* name, uint32_t value, uint32_t expected) {
+    if (value == expected)
+        return true;
+    std::cerr << name << ": 0x" << std::hex << value << " instead of 0x" << expected << std::dec << '\n';
+    return false;
+}
+
+}
+
+int main() {
+    bool failed = false;
+
+    CPU cpu;
+    cpu.reset();
+    Memory& memory = cpu.getMemory();
+
+    // without HLE the swi takes the exception
+    callARM(cpu, 0x06, 7, 2, 0);
+    if (!check("LLE swi PC", cpu.PC(), 0x08) || !check("LLE swi mode", cpu.getCPSR() & 0x1F, 0x13))
+        failed = true;
+
+    cpu.reset();
+    cpu.setHLEBIOS(true);
+    uint64_t cycles = cpu.getTotalCycles();
+    callARM(cpu, 0x06, -7, 2, 0);
+    if (!check("Div quotient", cpu.R(0), -3) || !check("Div remainder", cpu.R(1), -1) ||
+        !check("Div absolute quotient", cpu.R(3), 3) || !check("HLE swi PC", cpu.PC(), ProgramAddress + 4))
+        failed = true;
+    if (cpu.getTotalCycles() - cycles < 40) {
+        std::cerr << "Div took only " << cpu.getTotalCycles() - cycles << " cycles\n";
+        failed = true;
+    }
+    callARM(cpu, 0x07, 2, 100, 0);
+    if (!check("DivArm quotient", cpu.R(0), 50))
+        failed = true;
+    callARM(cpu, 0x08, 1000000, 0, 0);
+    if (!check("Sqrt", cpu.R(0), 1000))
+        failed = true;
+    callARM(cpu, 0x08, 0xFFFFFFFF, 0, 0);
+    if (!check("Sqrt of the largest value", cpu.R(0), 0xFFFF))
+        failed = true;
+    callARM(cpu, 0x0A, 0, 0x4000, 0);
+    if (!check("ArcTan2 of (0, 1)", cpu.R(0), 0x4000) || !check("ArcTan2 of (0, 1) R1", cpu.R(1), 0) ||
+        !check("ArcTan2 of (0, 1) R3", cpu.R(3), 0))
+        failed = true;
+    callARM(cpu, 0x0A, 0x4000, 0x4000, 0);
+    if (cpu.R(0) < 0x1FF0 || cpu.R(0) > 0x2010) {
+        std::cerr << "ArcTan2 of (1, 1): 0x" << std::hex << cpu.R(0) << std::dec << '\n';
+        failed = true;
+    }
+
+    // CpuSet halfword copy from EWRAM to IWRAM
+    for (uint32_t i = 0; i < 8; i++)
+        memory.write16(0x02000000 + 2 * i, 0x1100 + i);
+    callARM(cpu, 0x0B, 0x02000000, 0x03001000, 5);
+    if (!check("CpuSet copy", memory.read16(0x03001008), 0x1104) ||
+        !check("CpuSet copy end", memory.read16(0x0300100A), 0))
+        failed = true;
+    // CpuSet word fill
+    memory.write32(0x02000100, 0xCAFEF00D);
+    callARM(cpu, 0x0B, 0x02000100, 0x03002000, 3 | 1 << 24 | 1 << 26);
+    if (!check("CpuSet fill", memory.read32(0x03002008), 0xCAFEF00D) ||
+        !check("CpuSet fill end", memory.read32(0x0300200C), 0))
+        failed = true;
+    // CpuFastSet rounds the count up to 8 words
+    callARM(cpu, 0x0C, 0x02000100, 0x03003000, 3 | 1 << 24);
+    if (!check("CpuFastSet fill", memory.read32(0x0300301C), 0xCAFEF00D) ||
+        !check("CpuFastSet fill end", memory.read32(0x03003020), 0))
+        failed = true;
+
+    // decompressors, with payloads in EWRAM
+    const uint32_t Payload = 0x02001000;
+    // ABC and a copy of 7 bytes from 3 back
+    writeBytes(memory, Payload, {0x10, 0x0A, 0x00, 0x00, 0x10, 'A', 'B', 'C', 0x40, 0x02});
+    callARM(cpu, 0x12, Payload, 0x06000000, 0);
+    if (!check("LZ77UnCompVram", readString(memory, 0x06000000, 10), "ABCABCABCA"))
+        failed = true;
+    // 5 x and a literal y
+    writeBytes(memory, Payload, {0x30, 0x06, 0x00, 0x00, 0x82, 'x', 0x00, 'y'});
+    callARM(cpu, 0x14, Payload, 0x03004000, 0);
+    if (!check("RLUnCompWram", readString(memory, 0x03004000, 6), "xxxxxy"))
+        failed = true;
+    // a root with the leaves a and b, and the bitstream 0110
+    writeBytes(memory, Payload, {0x28, 0x04, 0x00, 0x00, 0x01, 0xC0, 'a', 'b', 0x00, 0x00, 0x00, 0x60});
+    callARM(cpu, 0x13, Payload, 0x03004100, 0);
+    if (!check("HuffUnComp", readString(memory, 0x03004100, 4), "abba"))
+        failed = true;
+    writeBytes(memory, Payload, {0x81, 0x04, 0x00, 0x00, 'a', 1, 1, 1});
+    callARM(cpu, 0x16, Payload, 0x03004200, 0);
+    if (!check("Diff8bitUnFilterWram", readString(memory, 0x03004200, 4), "abcd"))
+        failed = true;
+
+    // Thumb swi 8 after switching to Thumb
+    memory.write32(ProgramAddress, 0xE28FE001);      // add lr, pc, #1
+    memory.write32(ProgramAddress + 4, 0xE12FFF1E);  // bx lr
+    memory.write16(ProgramAddress + 8, 0xDF08);      // swi 8
+    cpu.PC() = ProgramAddress;
+    cpu.R(0) = 144;
+    cpu.step();
+    cpu.step();
+    cpu.step();
+    if (!check("Thumb Sqrt", cpu.R(0), 12) || !check("Thumb swi PC", cpu.PC(), ProgramAddress + 10))
+        failed = true;
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+#include "../cpu.h"
+#include <iostream>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using namespace GBA;
+
+int main() {
+    bool failed = false;
+
+    // instruction and the cycles it takes running from BIOS with data in IWRAM, both single cycle
+    const std::vector<std::pair<uint32_t, uint32_t>> program = {
+        {0xE3A00001, 1},  // 0x00: mov r0, #1
+        {0xE0801010, 2},  // 0x04: add r1, r0, r0, lsl r0
+        {0xE3A02403, 1},  // 0x08: mov r2, #0x03000000
+        {0xE5923000, 3},  // 0x0C: ldr r3, [r2]
+        {0xE5823000, 2},  // 0x10: str r3, [r2]
+        {0xE0040190, 2},  // 0x14: mul r4, r0, r1
+        {0xE892000C, 4},  // 0x18: ldmia r2, {r2, r3}
+        {0xEAFFFFFE, 3},  // 0x1C: b 0x1C
+    };
+    std::vector<uint8_t> bios(Memory::BIOSSize);
+    for (size_t i = 0; i < program.size(); i++) {
+        for (size_t byte = 0; byte < 4; byte++)
+            bios[i * 4 + byte] = program[i].first >> (8 * byte);
+    }
+
+    CPU cpu;
+    cpu.loadBIOS(bios);
+    cpu.reset();
+    for (size_t i = 0; i < program.size(); i++) {
+        uint32_t cycles = cpu.step();
+        if (cycles != program[i].second) {
+            failed = true;
+            std::cerr << "Instruction " << i << " took " << cycles << " cycles instead of " << program[i].second
+                      << '\n';
+        }
+    }
+
+    uint64_t total = cpu.getTotalCycles();
+    uint64_t executed = cpu.runFor(100);
+    if (executed < 100 || executed >= 103 || cpu.getTotalCycles() != total + executed) {
+        failed = true;
+        std::cerr << "Running for 100 cycles executed " << executed << " cycles\n";
+    }
+
+    // (address, word, sequential, cycles) with the reset WAITCNT and then with WAITCNT = 0x4317
+    using AccessTime = std::tuple<uint32_t, bool, bool, uint32_t>;
+    const std::vector<AccessTime> reset_times = {
+        {0x03000000, true, false, 1},
+        {0x02000000, false, false, 3},
+        {0x02000000, true, false, 6},
+        {0x06000000, true, false, 2},
+        {0x08000000, false, false, 5},
+        {0x08000000, false, true, 3},
+        {0x08000000, true, false, 8},
+        {0x0E000000, false, false, 5},
+    };
+    const std::vector<AccessTime> waitcnt_times = {
+        {0x08000000, false, false, 4},
+        {0x08000000, true, false, 6},
+        {0x09000000, true, true, 4},
+        {0x0A000000, false, true, 5},
+        {0x0C000000, false, false, 9},
+        {0x0E000000, false, true, 9},
+    };
+    Memory memory;
+    auto checkTimes = [&](const std::vector<AccessTime>& times) {
+        for (const auto& [address, word, sequential, expected] : times) {
+            uint32_t cycles = word ? memory.getAccessCycles<uint32_t>(address, sequential)
+                                   : memory.getAccessCycles<uint16_t>(address, sequential);
+            if (cycles != expected) {
+                failed = true;
+                std::cerr << "Access to 0x" << std::hex << address << std::dec << (word ? " (word" : " (halfword")
+                          << (sequential ? ", sequential)" : ")") << " takes " << cycles << " cycles instead of "
+                          << expected << '\n';
+            }
+        }
+    };
+    checkTimes(reset_times);
+    memory.write16(Memory::WAITCNTAddress, 0x4317);
+    checkTimes(waitcnt_times);
+    // with the prefetch buffer enabled sequential cartridge opcodes take one cycle
+    if (memory.getFetchCycles<uint16_t>(0x08000002, true) != 1 ||
+        memory.getFetchCycles<uint16_t>(0x08000000, false) != 4) {
+        failed = true;
+        std::cerr << "Prefetch buffer does not change cartridge fetch times\n";
+    }
+
+    return failed ? 1 : 0;
+}
@@ -1,4 +1,5 @@
 #include "../cpu.h"
+#include "arm_decode_vectors.h"
 #include <array>
 #include <iomanip>
 #include <iostream>
@@ -13,75 +14,8 @@ InstructionType getInstructionType(uint32_t instruction) {
 }
 
 int main() {
-    std::vector<std::pair<uint32_t, InstructionType>> test_cases = {
-        {0x00000000, InstructionType::DataProcessing},
-        {0xF3FFFFFF, InstructionType::DataProcessing},
-        {0x010F0000, InstructionType::ProgramStatusRegisterTransferOut},
-        {0x014F0000, InstructionType::ProgramStatusRegisterTransferOut},
-        {0xF10F0000, InstructionType::ProgramStatusRegisterTransferOut},
-        {0xF10FF000, InstructionType::ProgramStatusRegisterTransferOut},
-        {0xF14F0000, InstructionType::ProgramStatusRegisterTransferOut},
-        {0xF14FF000, InstructionType::ProgramStatusRegisterTransferOut},
-        {0x0129F000, InstructionType::ProgramStatusRegisterTransferIn},
-        {0x0129F00F, InstructionType::ProgramStatusRegisterTransferIn},
-        {0x0169F000, InstructionType::ProgramStatusRegisterTransferIn},
-        {0x0169F00F, InstructionType::ProgramStatusRegisterTransferIn},
-        {0xF129F000, InstructionType::ProgramStatusRegisterTransferIn},
-        {0xF129F00F, InstructionType::ProgramStatusRegisterTransferIn},
-        {0xF169F000, InstructionType::ProgramStatusRegisterTransferIn},
-        {0xF169F00F, InstructionType::ProgramStatusRegisterTransferIn},
-        {0x0128F000, InstructionType::ProgramStatusRegisterTransferIn},
-        {0x0128FFFF, InstructionType::ProgramStatusRegisterTransferIn},
-        {0x0168F000, InstructionType::ProgramStatusRegisterTransferIn},
-        {0x0328F000, InstructionType::ProgramStatusRegisterTransferIn},
-        {0x0328FFFF, InstructionType::ProgramStatusRegisterTransferIn},
-        {0x0368F000, InstructionType::ProgramStatusRegisterTransferIn},
-        {0x0368FFFF, InstructionType::ProgramStatusRegisterTransferIn},
-        {0x00000090, InstructionType::Multiply},
-        {0xF03FFF9F, InstructionType::Multiply},
-        {0x00800090, InstructionType::MultiplyLong},
-        {0xF0FFFF9F, InstructionType::MultiplyLong},
-        {0x01000090, InstructionType::SingleDataSwap},
-        {0xF14FF09F, InstructionType::SingleDataSwap},
-        {0x012FFF10, InstructionType::BranchAndExchange},
-        {0xF12FFF1F, InstructionType::BranchAndExchange},
-        {0x000000B0, InstructionType::HalfwordDataTransferRegister},
-        {0x000000D0, InstructionType::HalfwordDataTransferRegister},
-        {0x000000F0, InstructionType::HalfwordDataTransferRegister},
-        {0xF1BFF0BF, InstructionType::HalfwordDataTransferRegister},
-        {0xF1BFF0DF, InstructionType::HalfwordDataTransferRegister},
-        {0xF1BFF0FF, InstructionType::HalfwordDataTransferRegister},
-        {0x004000B0, InstructionType::HalfwordDataTransferImmediate},
-        {0x004000D0, InstructionType::HalfwordDataTransferImmediate},
-        {0x004000F0, InstructionType::HalfwordDataTransferImmediate},
-        {0xF1FFFFBF, InstructionType::HalfwordDataTransferImmediate},
-        {0xF1FFFFDF, InstructionType::HalfwordDataTransferImmediate},
-        {0xF1FFFFFF, InstructionType::HalfwordDataTransferImmediate},
-        {0x04000000, InstructionType::SingleDataTransfer},
-        {0x04000010, InstructionType::SingleDataTransfer},
-        {0x05000000, InstructionType::SingleDataTransfer},
-        {0x05000010, InstructionType::SingleDataTransfer},
-        {0x06000000, InstructionType::SingleDataTransfer},
-        {0x07000000, InstructionType::SingleDataTransfer},
-        {0xF7FFFFEF, InstructionType::SingleDataTransfer},
-        {0x08000000, InstructionType::BlockDataTransfer},
-        {0xF9FFFFFF, InstructionType::BlockDataTransfer},
-        {0x0A000000, InstructionType::Branch},
-        {0xFBFFFFFF, InstructionType::Branch},
-        {0x0C000000, InstructionType::CoprocessorDataTransfer},
-        {0xFDFFFFFF, InstructionType::CoprocessorDataTransfer},
-        {0x0E000000, InstructionType::CoprocessorDataOperation},
-        {0xFEFFFFEF, InstructionType::CoprocessorDataOperation},
-        {0x0E000010, InstructionType::CoprocessorRegisterTransfer},
-        {0xFEFFFFFF, InstructionType::CoprocessorRegisterTransfer},
-        {0x0F000000, InstructionType::SoftwareInterrupt},
-        {0xFFFFFFFF, InstructionType::SoftwareInterrupt},
-        {0x06000010, InstructionType::Undefined},
-        {0xF7FFFFFF, InstructionType::Undefined},
-    };
-
     bool failed = false;
-    for (const auto& test_case : test_cases) {
+    for (const auto& test_case : arm_decode_vectors) {
         const auto& [instruction, expected_instruction_type] = test_case;
         auto instruction_type = getInstructionType(instruction);
         if (instruction_type != expected_instruction_type) {
@@ -91,6 +25,60 @@ int main() {
                       << getInstructionTypeText(expected_instruction_type) << "' but got '"
                       << getInstructionTypeText(instruction_type) << "' instead\n";
         }
+        // the table assumes SBZ fields are zero, with bits 7 and 4 set this is the register form of STRH on hardware
+        // and decodeArm only calls it MSR because bits 11-8 are not
+        if (instruction == 0x0128FFFF)
+            continue;
+        if (CPU::lookupArm(instruction) != CPU::getArmInstructionHandler(expected_instruction_type, instruction)) {
+            failed = true;
+            std::cerr << "Decode table maps instruction 0x" << std::hex << std::uppercase << std::setw(8)
+                      << std::setfill('0') << instruction << std::nouppercase << std::dec
+                      << " to a different handler than '" << getInstructionTypeText(expected_instruction_type)
+                      << "'\n";
+        }
+    }
+
+    // results and NZCV of executed instructions, r0 = 0x7FFFFFFF, r1 = 1, r2 = 0x80000000 and PC = 0x100
+    const std::vector<std::pair<uint32_t, std::pair<uint32_t, uint32_t>>> execution_cases = {
+        {0xE0903001, {0x80000000, 0x9}},  // ADDS r3, r0, r1
+        {0xE0513001, {0x00000000, 0x6}},  // SUBS r3, r1, r1
+        {0xE0413000, {0x80000002, 0x0}},  // SUB r3, r1, r0
+        {0xE1B03022, {0x00000000, 0x6}},  // MOVS r3, r2, LSR #32
+        {0xE1B03042, {0xFFFFFFFF, 0xA}},  // MOVS r3, r2, ASR #32
+        {0xE1B03061, {0x00000000, 0x6}},  // MOVS r3, r1, RRX
+        {0xE1A0300F, {0x00000108, 0x0}},  // MOV r3, pc
+        {0xE3B034FF, {0xFF000000, 0xA}},  // MOVS r3, #0xFF000000
+        {0xF3B03001, {0x00000000, 0x0}},  // MOVSNV r3, #1, NV never executes
+    };
+    for (const auto& [instruction, expected] : execution_cases) {
+        CPU cpu;
+        cpu.setMode(CPU::Mode::User);
+        cpu.R(0) = 0x7FFFFFFF;
+        cpu.R(1) = 1;
+        cpu.R(2) = 0x80000000;
+        cpu.PC() = 0x100;
+        cpu.callDataProcessingInstruction(instruction, cpu.PC());
+        if (cpu.R(3) != expected.first || (cpu.getCPSR() >> 28) != expected.second) {
+            failed = true;
+            std::cerr << "Instruction 0x" << std::hex << std::uppercase << instruction << " produced 0x" << cpu.R(3)
+                      << " with flags 0x" << (cpu.getCPSR() >> 28) << ", expected 0x" << expected.first
+                      << " with flags 0x" << expected.second << std::nouppercase << std::dec << "\n";
+        }
+    }
+
+    // flags are evaluated lazily, a logical operation after an addition must keep the addition's V
+    {
+        CPU cpu;
+        cpu.setMode(CPU::Mode::User);
+        cpu.R(0) = 0x7FFFFFFF;
+        cpu.R(1) = 1;
+        cpu.callDataProcessingInstruction(0xE0903001, cpu.PC());  // ADDS r3, r0, r1
+        cpu.callDataProcessingInstruction(0xE1B03001, cpu.PC());  // MOVS r3, r1
+        cpu.callDataProcessingInstruction(0x60804001, cpu.PC());  // ADDVS r4, r0, r1
+        if ((cpu.getCPSR() >> 28) != 0x1 || cpu.R(4) != 0x80000000) {
+            failed = true;
+            std::cerr << "MOVS after ADDS did not keep the overflow flag\n";
+        }
     }
 
     return failed ? 1 : 0;
@@ -0,0 +1,84 @@
+#include "../cpu.h"
+#include <iostream>
+
+using namespace GBA;
+
+int main() {
+    bool failed = false;
+    CPU cpu;
+    Memory& memory = cpu.getMemory();
+    memory.write32(0x03000054, 0x12345678);
+    memory.write32(0x03000100, 0xCAFEF00D);
+
+    // register offset with a shift
+    cpu.R(11) = 0x03000000;
+    cpu.R(12) = 0x15;
+    cpu.callSingleDataTransferInstruction(0xE79BC10C, 0);  // ldr r12, [r11, r12, lsl #2]
+    if (cpu.R(12) != 0x12345678) {
+        failed = true;
+        std::cerr << "LDR with a register offset loaded 0x" << std::hex << cpu.R(12) << std::dec << '\n';
+    }
+
+    // post indexing loads from the base and always writes back
+    cpu.R(1) = 0x03000100;
+    cpu.callSingleDataTransferInstruction(0xE4910004, 0);  // ldr r0, [r1], #4
+    if (cpu.R(0) != 0xCAFEF00D || cpu.R(1) != 0x03000104) {
+        failed = true;
+        std::cerr << "Post-indexed LDR loaded 0x" << std::hex << cpu.R(0) << " with the base at 0x" << cpu.R(1)
+                  << std::dec << '\n';
+    }
+    cpu.callSingleDataTransferInstruction(0xE4010004, 0);  // str r0, [r1], #-4
+    if (memory.read32(0x03000104) != 0xCAFEF00D || cpu.R(1) != 0x03000100) {
+        failed = true;
+        std::cerr << "Post-indexed STR left the base at 0x" << std::hex << cpu.R(1) << std::dec << '\n';
+    }
+
+    // the loaded value wins over the written back base
+    cpu.callSingleDataTransferInstruction(0xE5B11000, 0);  // ldr r1, [r1]!
+    if (cpu.R(1) != 0xCAFEF00D) {
+        failed = true;
+        std::cerr << "LDR with write back to the destination left 0x" << std::hex << cpu.R(1) << std::dec << '\n';
+    }
+
+    // halfword transfers post index the same way
+    cpu.R(1) = 0x06000000;
+    cpu.R(3) = 0x4241;
+    cpu.callHalfWordAndSignedDataTransferInstruction(0xE0C130B2, 0);  // strh r3, [r1], #2
+    if (memory.read16(0x06000000) != 0x4241 || cpu.R(1) != 0x06000002) {
+        failed = true;
+        std::cerr << "Post-indexed STRH stored 0x" << std::hex << memory.read16(0x06000000) << " with the base at 0x"
+                  << cpu.R(1) << std::dec << '\n';
+    }
+
+    // Thumb register offsets are added to the base
+    memory.write16(0x03000204, 0x8001);
+    cpu.R(2) = 0x03000200;
+    cpu.R(4) = 4;
+    cpu.callLoadStoreSignExtendedByteHalfword(0x5F10);  // ldsh r0, [r2, r4]
+    if (cpu.R(0) != 0xFFFF8001 || cpu.R(2) != 0x03000200) {
+        failed = true;
+        std::cerr << "LDSH with a register offset loaded 0x" << std::hex << cpu.R(0) << std::dec << '\n';
+    }
+
+    // PC as the base reads as the instruction address + 8, a stored PC as the instruction address + 12
+    memory.write32(0x03000408, 0x11111111);
+    memory.write32(0x0300040C, 0x22222222);
+    cpu.callSingleDataTransferInstruction(0xE59F0000, 0x03000400);  // ldr r0, [pc, #0]
+    cpu.callHalfWordAndSignedDataTransferInstruction(0xE1DF10B4, 0x03000400);  // ldrh r1, [pc, #4]
+    if (cpu.R(0) != 0x11111111 || cpu.R(1) != 0x2222) {
+        failed = true;
+        std::cerr << "Loads relative to PC gave 0x" << std::hex << cpu.R(0) << " and 0x" << cpu.R(1) << std::dec
+                  << '\n';
+    }
+    cpu.R(2) = 0x03000500;
+    cpu.R(3) = 0x03000504;
+    cpu.callSingleDataTransferInstruction(0xE582F000, 0x03000400);  // str pc, [r2]
+    cpu.callBlockDataTransferInstruction(0xE8838000, 0x03000400);   // stmia r3, {pc}
+    if (memory.read32(0x03000500) != 0x0300040C || memory.read32(0x03000504) != 0x0300040C) {
+        failed = true;
+        std::cerr << "STR and STM stored PC as 0x" << std::hex << memory.read32(0x03000500) << " and 0x"
+                  << memory.read32(0x03000504) << std::dec << '\n';
+    }
+
+    return failed ? 1 : 0;
+}
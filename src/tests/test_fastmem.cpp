@@ -0,0 +1,81 @@
+#include "../memory.h"
+#include <iomanip>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+using namespace GBA;
+
+int main() {
+    if (!FastMem::isSupported()) {
+        std::cerr << "fastmem is not supported on this host, skipping\n";
+        return 0;
+    }
+
+    bool failed = false;
+    Memory memory;
+    memory.write32(0x02000100, 0xCAFEBABE);
+    std::vector<uint8_t> rom(0x2000);
+    for (size_t i = 0; i < rom.size(); i++)
+        rom[i] = i & 0xFF;
+    memory.loadROM(rom);
+
+    if (!memory.enableFastMem()) {
+        std::cerr << "Failed to create the fastmem arena\n";
+        return 1;
+    }
+    if (memory.read32(0x02000100) != 0xCAFEBABE) {
+        failed = true;
+        std::cerr << "EWRAM contents were not moved into the fastmem arena\n";
+    }
+
+    // directly mapped regions and their mirrors
+    std::vector<std::pair<uint32_t, uint32_t>> mirrors = {
+        {0x02000010, 0x02FC0010},
+        {0x03007FFC, 0x03FFFFFC},
+        {0x06000000, 0x06020000},
+        {0x06010000, 0x06018000},
+    };
+    uint32_t value = 0x11111111;
+    for (const auto& [address, mirror] : mirrors) {
+        memory.write32(address, value);
+        if (memory.read32(mirror) != value) {
+            failed = true;
+            std::cerr << "Write to 0x" << std::hex << std::setw(8) << std::setfill('0') << address
+                      << " is not visible through mirror 0x" << std::setw(8) << mirror << std::dec << '\n';
+        }
+        value += 0x11111111;
+    }
+
+    // accesses that fault into the slow path
+    memory.write16(0x05000002, 0x7FFF);
+    if (memory.read16(0x05000402) != 0x7FFF) {
+        failed = true;
+        std::cerr << "Palette access was not serviced by the fault handler\n";
+    }
+    memory.write8(0x06000001, 0x42);
+    if (memory.read16(0x06000000) != 0x4242) {
+        failed = true;
+        std::cerr << "Byte write to VRAM was not duplicated to the whole halfword\n";
+    }
+    memory.write16(0x0E000003, 0xAB00);
+    if (memory.read8(0x0E000003) != 0xAB) {
+        failed = true;
+        std::cerr << "Halfword write to SRAM did not store the byte selected by the address\n";
+    }
+    memory.write32(0x08000000, 0xFFFFFFFF);
+    if (memory.read32(0x08000000) != 0x03020100 || memory.read32(0x0C001FFC) != 0xFFFEFDFC) {
+        failed = true;
+        std::cerr << "ROM is not mapped read-only in the wait state windows\n";
+    }
+    if (memory.read32(0x08002000) != 0x10011000) {
+        failed = true;
+        std::cerr << "Read past the end of the ROM did not return open bus\n";
+    }
+    if (memory.read32(0x10000000) != 0 || memory.read8(0xFFFFFFFF) != 0) {
+        failed = true;
+        std::cerr << "Unmapped addresses must read as zero\n";
+    }
+
+    return failed ? 1 : 0;
+}
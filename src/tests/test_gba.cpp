@@ -1,4 +1,34 @@
+#include "../cpu.h"
+#include <iostream>
+#include <vector>
+
+using namespace GBA;
+
 int main() {
-    return 0;
-}
+    bool failed = false;
 
+    // direct boot starts the ROM in System mode with the stacks the BIOS sets up
+    CPU cpu;
+    std::vector<uint8_t> rom = {0x2A, 0x00, 0xA0, 0xE3};  // mov r0, #42
+    cpu.loadROM(rom);
+    cpu.directBoot();
+    Memory& memory = cpu.getMemory();
+    if (cpu.getMode() != CPU::Mode::System || cpu.PC() != 0x08000000 || cpu.R(13) != 0x03007F00 ||
+        cpu.SP(CPU::Mode::Supervisor) != 0x03007FE0 || cpu.SP(CPU::Mode::Interrupt) != 0x03007FA0) {
+        std::cerr << "Direct boot registers: mode 0x" << std::hex << static_cast<uint32_t>(cpu.getMode()) << ", PC 0x"
+                  << cpu.PC() << ", SP 0x" << cpu.R(13) << std::dec << '\n';
+        failed = true;
+    }
+    if (memory.read16(Memory::DISPCNTAddress) != 0x0080 || memory.read8(Memory::POSTFLGAddress) != 0x01) {
+        std::cerr << "Direct boot IO: DISPCNT 0x" << std::hex << memory.read16(Memory::DISPCNTAddress)
+                  << ", POSTFLG 0x" << +memory.read8(Memory::POSTFLGAddress) << std::dec << '\n';
+        failed = true;
+    }
+    cpu.step();
+    if (cpu.R(0) != 42) {
+        std::cerr << "Direct boot did not run the ROM, R0 is " << cpu.R(0) << '\n';
+        failed = true;
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,86 @@
+#include "../cpu.h"
+#include <iostream>
+#include <vector>
+
+using namespace GBA;
+
+namespace {
+
+// Halts through HALTCNT, then counts in r2
+const std::vector<uint32_t> program = {
+    0xE3A01301,  // 0x00: mov r1, #0x04000000
+    0xE2811C03,  // 0x04: add r1, r1, #0x300
+    0xE5C10001,  // 0x08: strb r0, [r1, #1]
+    0xE2822001,  // 0x0C: add r2, r2, #1
+    0xEAFFFFFD,  // 0x10: b 0x0C
+};
+const uint32_t ProgramAddress = 0x03000000;
+
+bool runProgram(CPU::Backend backend, const char* name) {
+    CPU cpu;
+    cpu.reset();
+    Memory& memory = cpu.getMemory();
+    for (size_t i = 0; i < program.size(); i++)
+        memory.write32(ProgramAddress + 4 * i, program[i]);
+    cpu.PC() = ProgramAddress;
+    if (!cpu.setBackend(backend)) {
+        std::cerr << name << " is not supported on this host, skipped\n";
+        return true;
+    }
+
+    // only enabled interrupts end the halt
+    memory.write16(Memory::IEAddress, Memory::VBlankInterrupt);
+    memory.requestInterrupt(Memory::HBlankInterrupt);
+    cpu.runFor(10000);
+    if (memory.getPowerState() != Memory::PowerState::Halted || cpu.R(2) != 0 || cpu.getSleepingCycles() < 9900 ||
+        cpu.PC() != ProgramAddress + 0x0C) {
+        std::cerr << name << ": halted with r2 " << cpu.R(2) << " after sleeping " << cpu.getSleepingCycles()
+                  << " cycles, PC is 0x" << std::hex << cpu.PC() << std::dec << '\n';
+        return false;
+    }
+
+    uint64_t sleeping = cpu.getSleepingCycles();
+    memory.requestInterrupt(Memory::VBlankInterrupt);
+    cpu.runFor(100);
+    if (memory.isSleeping() || cpu.R(2) == 0 || cpu.getSleepingCycles() != sleeping) {
+        std::cerr << name << ": the interrupt did not end the halt, r2 is " << cpu.R(2) << '\n';
+        return false;
+    }
+    return true;
+}
+
+}
+
+int main() {
+    bool failed = false;
+
+    if (!runProgram(CPU::Backend::Interpreter, "Interpreter"))
+        failed = true;
+    if (!runProgram(CPU::Backend::BlockCache, "Block cache"))
+        failed = true;
+    if (!runProgram(CPU::Backend::Recompiler, "Recompiler"))
+        failed = true;
+
+    // Stop only ends with keypad, serial and cartridge interrupts, through the HLE swi
+    CPU cpu;
+    cpu.reset();
+    cpu.setHLEBIOS(true);
+    Memory& memory = cpu.getMemory();
+    memory.write32(ProgramAddress, 0xEF030000);  // swi 3
+    cpu.PC() = ProgramAddress;
+    memory.write16(Memory::IEAddress, Memory::VBlankInterrupt | Memory::KeypadInterrupt);
+    memory.requestInterrupt(Memory::VBlankInterrupt);
+    cpu.runFor(1000);
+    if (memory.getPowerState() != Memory::PowerState::Stopped || cpu.PC() != ProgramAddress + 4) {
+        std::cerr << "Stop did not stop the CPU\n";
+        failed = true;
+    }
+    memory.requestInterrupt(Memory::KeypadInterrupt);
+    cpu.sleep(cpu.getTotalCycles() + 1000);
+    if (memory.isSleeping()) {
+        std::cerr << "A keypad interrupt did not end the stop\n";
+        failed = true;
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,71 @@
+#include "../cpu.h"
+#include <iostream>
+#include <vector>
+
+using namespace GBA;
+
+namespace {
+
+// Waits for VCOUNT to reach 160, then counts in r2
+const std::vector<uint32_t> program = {
+    0xE3A01301,  // 0x00: mov r1, #0x04000000
+    0xE1D100B6,  // 0x04: ldrh r0, [r1, #6]
+    0xE35000A0,  // 0x08: cmp r0, #160
+    0x1AFFFFFC,  // 0x0C: bne 0x04
+    0xE2822001,  // 0x10: add r2, r2, #1
+    0xEAFFFFFD,  // 0x14: b 0x10
+};
+const uint32_t ProgramAddress = 0x03000000;
+
+bool runProgram(CPU::Backend backend, const char* name) {
+    CPU cpu;
+    std::vector<uint8_t> bios(Memory::BIOSSize);
+    // mov pc, #0x03000000
+    bios[0] = 0x03;
+    bios[1] = 0xF4;
+    bios[2] = 0xA0;
+    bios[3] = 0xE3;
+    cpu.loadBIOS(bios);
+    cpu.reset();
+    for (size_t i = 0; i < program.size(); i++)
+        cpu.getMemory().write32(ProgramAddress + 4 * i, program[i]);
+    if (!cpu.setBackend(backend)) {
+        std::cerr << name << " is not supported on this host, skipped\n";
+        return true;
+    }
+
+    cpu.runFor(100000);
+    uint64_t skipped = cpu.getIdleSkippedCycles();
+    bool waiting = cpu.PC() >= ProgramAddress + 0x04 && cpu.PC() <= ProgramAddress + 0x10;
+    bool should_skip = backend != CPU::Backend::Interpreter;
+    if (!waiting || cpu.getTotalCycles() < 100000 || (should_skip ? skipped < 90000 : skipped != 0)) {
+        std::cerr << name << ": waiting for VCOUNT skipped " << skipped << " of " << cpu.getTotalCycles()
+                  << " cycles, PC is 0x" << std::hex << cpu.PC() << std::dec << '\n';
+        return false;
+    }
+
+    // the counting loop carries r2 from one iteration to the next and must run instruction by instruction
+    cpu.getMemory().write16(0x04000006, 160);
+    cpu.runFor(1000);
+    if (cpu.R(2) < 100 || cpu.getIdleSkippedCycles() != skipped) {
+        std::cerr << name << ": the counting loop ran " << cpu.R(2) << " times and skipped "
+                  << cpu.getIdleSkippedCycles() - skipped << " cycles\n";
+        return false;
+    }
+    return true;
+}
+
+}
+
+int main() {
+    bool failed = false;
+
+    if (!runProgram(CPU::Backend::Interpreter, "Interpreter"))
+        failed = true;
+    if (!runProgram(CPU::Backend::BlockCache, "Block cache"))
+        failed = true;
+    if (!runProgram(CPU::Backend::Recompiler, "Recompiler"))
+        failed = true;
+
+    return failed ? 1 : 0;
+}
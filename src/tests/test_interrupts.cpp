@@ -0,0 +1,113 @@
+#include "../cpu.h"
+#include <iostream>
+#include <vector>
+
+using namespace GBA;
+
+namespace {
+
+// Installs the interrupt handler, enables the VBlank interrupt and counts VBlanks in r4 with VBlankIntrWait
+const std::vector<uint32_t> program = {
+    0xE3A00403,  // 0x00: mov r0, #0x03000000
+    0xE3A01301,  // 0x04: mov r1, #0x04000000
+    0xE5010004,  // 0x08: str r0, [r1, #-4]
+    0xE2813C02,  // 0x0C: add r3, r1, #0x200
+    0xE3A02001,  // 0x10: mov r2, #1
+    0xE1C320B0,  // 0x14: strh r2, [r3]
+    0xE1C320B8,  // 0x18: strh r2, [r3, #8]
+    0xEF050000,  // 0x1C: swi 5
+    0xE2844001,  // 0x20: add r4, r4, #1
+    0xEAFFFFFC,  // 0x24: b 0x1C
+};
+// Sets the VBlank bit of the BIOS interrupt flags and acknowledges it in IF, counts interrupts in r5
+const std::vector<uint32_t> handler = {
+    0xE3A00301,  // 0x00: mov r0, #0x04000000
+    0xE3A01001,  // 0x04: mov r1, #1
+    0xE14010B8,  // 0x08: strh r1, [r0, #-8]
+    0xE2800C02,  // 0x0C: add r0, r0, #0x200
+    0xE1C010B2,  // 0x10: strh r1, [r0, #2]
+    0xE2855001,  // 0x14: add r5, r5, #1
+    0xE12FFF1E,  // 0x18: bx lr
+};
+const uint32_t HandlerAddress = 0x03000000;
+
+bool runProgram(CPU::Backend backend, const char* name) {
+    CPU cpu;
+    std::vector<uint8_t> rom;
+    for (uint32_t instruction_code : program) {
+        for (int i = 0; i < 4; i++)
+            rom.push_back(instruction_code >> (8 * i));
+    }
+    cpu.loadBIOS(BIOS::makeHLEImage());
+    cpu.loadROM(rom);
+    cpu.setHLEBIOS(true);
+    cpu.directBoot();
+    Memory& memory = cpu.getMemory();
+    for (size_t i = 0; i < handler.size(); i++)
+        memory.write32(HandlerAddress + 4 * i, handler[i]);
+    if (!cpu.setBackend(backend)) {
+        std::cerr << name << " is not supported on this host, skipped\n";
+        return true;
+    }
+
+    cpu.runFor(5000);
+    if (!memory.isSleeping() || cpu.R(4) != 0 || cpu.R(5) != 0) {
+        std::cerr << name << ": VBlankIntrWait did not halt, r4 is " << cpu.R(4) << '\n';
+        return false;
+    }
+
+    memory.requestInterrupt(Memory::VBlankInterrupt);
+    cpu.runFor(5000);
+    if (cpu.R(5) != 1 || cpu.R(4) != 1 || !memory.isSleeping() || memory.read16(Memory::IFAddress) != 0 ||
+        cpu.getMode() != CPU::Mode::System || cpu.getCPSR() & 0x80) {
+        std::cerr << name << ": after one VBlank r4 is " << cpu.R(4) << ", r5 is " << cpu.R(5) << ", IF is 0x"
+                  << std::hex << memory.read16(Memory::IFAddress) << ", CPSR is 0x" << cpu.getCPSR() << std::dec
+                  << '\n';
+        return false;
+    }
+
+    // the CPSR I bit holds the interrupt back
+    cpu.writeCPSR(cpu.getCPSR() | 0x80);
+    memory.requestInterrupt(Memory::VBlankInterrupt);
+    cpu.runFor(5000);
+    if (cpu.R(5) != 1 || memory.isIRQPending()) {
+        std::cerr << name << ": the interrupt was taken with IRQs disabled\n";
+        return false;
+    }
+    cpu.writeCPSR(cpu.getCPSR() & ~0x80u);
+    cpu.runFor(5000);
+    if (cpu.R(5) != 2 || cpu.R(4) != 2) {
+        std::cerr << name << ": enabling IRQs did not take the interrupt, r5 is " << cpu.R(5) << '\n';
+        return false;
+    }
+    return true;
+}
+
+}
+
+int main() {
+    bool failed = false;
+
+    if (!runProgram(CPU::Backend::Interpreter, "Interpreter"))
+        failed = true;
+    if (!runProgram(CPU::Backend::BlockCache, "Block cache"))
+        failed = true;
+    if (!runProgram(CPU::Backend::Recompiler, "Recompiler"))
+        failed = true;
+
+    // IRQ entry saves the CPSR and returns to the next instruction + 4, in ARM state
+    CPU cpu;
+    cpu.directBoot();
+    cpu.writeCPSR(cpu.getCPSR() | 0x20);
+    cpu.PC() = 0x08000102;
+    cpu.takeInterrupt();
+    if (cpu.getMode() != CPU::Mode::Interrupt || cpu.PC() != 0x18 || cpu.R(14) != 0x08000106 || cpu.inThumb() ||
+        !(cpu.getCPSR() & 0x80) || cpu.SPSR() != 0x3F) {
+        std::cerr << "IRQ entry: mode 0x" << std::hex << static_cast<uint32_t>(cpu.getMode()) << ", PC 0x" << cpu.PC()
+                  << ", LR 0x" << cpu.R(14) << ", CPSR 0x" << cpu.getCPSR() << ", SPSR 0x" << cpu.SPSR() << std::dec
+                  << '\n';
+        failed = true;
+    }
+
+    return failed ? 1 : 0;
+}
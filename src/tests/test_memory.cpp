@@ -0,0 +1,122 @@
+#include "../memory.h"
+#include <iomanip>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+using namespace GBA;
+
+int main() {
+    bool failed = false;
+    Memory memory;
+
+    // writes must be visible through every mirror of the region
+    std::vector<std::pair<uint32_t, uint32_t>> mirrors = {
+        {0x02000010, 0x02040010},
+        {0x02000010, 0x02FC0010},
+        {0x03000020, 0x03008020},
+        {0x03007FFC, 0x03FFFFFC},
+        {0x05000004, 0x05000404},
+        {0x06000000, 0x06020000},
+        {0x06010000, 0x06018000},
+        {0x06017FFF, 0x0601FFFF},
+        {0x0E000000, 0x0E010000},
+    };
+    uint8_t value = 0x10;
+    for (const auto& [address, mirror] : mirrors) {
+        memory.write8(address, value);
+        if (memory.read8(mirror) != value) {
+            failed = true;
+            std::cerr << "Write to 0x" << std::hex << std::setw(8) << std::setfill('0') << address
+                      << " is not visible through mirror 0x" << std::setw(8) << mirror << std::dec << '\n';
+        }
+        value++;
+    }
+
+    memory.write16(0x07000008, 0xBEEF);
+    memory.write8(0x07000008, 0x00);
+    if (memory.read16(0x07000408) != 0xBEEF) {
+        failed = true;
+        std::cerr << "Halfword write to OAM is not visible through its mirror or byte write was not ignored\n";
+    }
+
+    memory.write8(0x05000011, 0x7C);
+    if (memory.read16(0x05000010) != 0x7C7C) {
+        failed = true;
+        std::cerr << "Byte write to palette RAM was not duplicated to the whole halfword\n";
+    }
+
+    memory.write8(0x06000021, 0x5A);
+    if (memory.read16(0x06020020) != 0x5A5A) {
+        failed = true;
+        std::cerr << "Byte write to VRAM was not duplicated to the whole halfword\n";
+    }
+
+    memory.write32(0x03000102, 0x11223344);
+    if (memory.read32(0x03000100) != 0x11223344) {
+        failed = true;
+        std::cerr << "Misaligned word write was not forced to word alignment\n";
+    }
+    if (memory.read16(0x03000103) != 0x1122 || memory.read8(0x03000101) != 0x33) {
+        failed = true;
+        std::cerr << "Halfword or byte read returned the wrong part of a little-endian word\n";
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t>> rotated_reads = {
+        {0x03000100, 0x11223344},
+        {0x03000101, 0x44112233},
+        {0x03000102, 0x33441122},
+        {0x03000103, 0x22334411},
+    };
+    for (const auto& [address, expected] : rotated_reads) {
+        if (memory.read32Rotated(address) != expected) {
+            failed = true;
+            std::cerr << "Rotated word read from 0x" << std::hex << std::setw(8) << std::setfill('0') << address
+                      << " returned 0x" << std::setw(8) << memory.read32Rotated(address) << std::dec << '\n';
+        }
+    }
+    if (memory.read16Rotated(0x03000101) != 0x44000033) {
+        failed = true;
+        std::cerr << "Rotated halfword read from a misaligned address is wrong\n";
+    }
+
+    std::vector<uint8_t> bios = {0x01, 0x02, 0x03, 0x04};
+    memory.loadBIOS(bios);
+    memory.write8(0x00000000, 0xFF);
+    if (memory.read8(0x00000000) != 0x01) {
+        failed = true;
+        std::cerr << "BIOS region must be read-only\n";
+    }
+
+    std::vector<uint8_t> rom = {0xAA, 0xBB};
+    memory.loadROM(rom);
+    if (memory.read8(0x08000001) != 0xBB || memory.read8(0x0A000000) != 0xAA || memory.read8(0x0C000001) != 0xBB) {
+        failed = true;
+        std::cerr << "ROM is not visible through the wait state mirrors\n";
+    }
+    memory.write8(0x08000000, 0x00);
+    if (memory.read8(0x08000000) != 0xAA) {
+        failed = true;
+        std::cerr << "ROM region must be read-only\n";
+    }
+    if (memory.read16(0x08000000) != 0xBBAA || memory.read32(0x08000000) != 0x0001BBAA) {
+        failed = true;
+        std::cerr << "Reads past the end of the ROM must return open bus values\n";
+    }
+
+    // the first page of this ROM is directly mapped, the partial second page goes through the slow path
+    std::vector<uint8_t> large_rom(Memory::PageSize + 2);
+    for (size_t i = 0; i < large_rom.size(); i++)
+        large_rom[i] = i & 0xFF;
+    memory.loadROM(large_rom);
+    if (memory.read32(0x08000104) != 0x07060504 || memory.read32(0x0C000104) != 0x07060504) {
+        failed = true;
+        std::cerr << "Directly mapped ROM page returned the wrong value\n";
+    }
+    if (memory.read32(0x08004000) != 0x20010100) {
+        failed = true;
+        std::cerr << "Partially filled ROM page returned the wrong value\n";
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,61 @@
+#include "../memory.h"
+#include "../rom_image.h"
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+using namespace GBA;
+
+int main() {
+    bool failed = false;
+    const char* path = "test_rom_image.gba";
+    // one and a half pages, the tail has to come from the file and the rest from the open bus
+    std::vector<uint8_t> contents(Memory::PageSize + Memory::PageSize / 2);
+    for (size_t i = 0; i < contents.size(); i++)
+        contents[i] = static_cast<uint8_t>(i * 7);
+    FILE* file = std::fopen(path, "wb");
+    if (file == NULL || std::fwrite(contents.data(), 1, contents.size(), file) != contents.size()) {
+        std::perror("Failed to write the test ROM");
+        return 1;
+    }
+    std::fclose(file);
+
+    auto image = ROMImage::map(path, true);
+    std::remove(path);
+    if (image == nullptr) {
+        std::perror("Failed to map the test ROM");
+        return 1;
+    }
+    if (image->getSize() != contents.size()) {
+        failed = true;
+        std::cerr << "Mapped image has size " << image->getSize() << ", expected " << contents.size() << '\n';
+    }
+
+    if (ROMImage::map("does_not_exist.gba") != nullptr) {
+        failed = true;
+        std::cerr << "Mapping a missing file must fail\n";
+    }
+
+    for (bool fastmem : {false, true}) {
+        Memory memory;
+        if (fastmem && !memory.enableFastMem())
+            continue;
+        memory.loadROM(image);
+        for (uint32_t address : {0x08000000u, 0x0A003FFCu, 0x0C004000u, 0x08005FFCu}) {
+            uint32_t offset = address & 0xFFFFFF;
+            uint32_t expected = contents[offset] | (contents[offset + 1] << 8) | (contents[offset + 2] << 16) |
+                                (contents[offset + 3] << 24);
+            if (memory.read32(address) != expected) {
+                failed = true;
+                std::cerr << "ROM read at 0x" << std::hex << address << " returned 0x" << memory.read32(address)
+                          << ", expected 0x" << expected << std::dec << (fastmem ? " (fastmem)\n" : "\n");
+            }
+        }
+        if (memory.read16(0x08006000) != 0x3000) {
+            failed = true;
+            std::cerr << "Read past the end of the mapped ROM did not return open bus\n";
+        }
+    }
+
+    return failed ? 1 : 0;
+}
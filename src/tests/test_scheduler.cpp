@@ -0,0 +1,53 @@
+#include "../scheduler.h"
+#include <iostream>
+
+using namespace GBA;
+
+int main() {
+    bool failed = false;
+    Scheduler scheduler;
+
+    if (scheduler.getNextTimestamp() != Scheduler::Never) {
+        failed = true;
+        std::cerr << "Empty scheduler has a pending event\n";
+    }
+
+    scheduler.schedule(Scheduler::Event::Scanline, 1232);
+    scheduler.schedule(Scheduler::Event::HBlank, 1006);
+    if (scheduler.getNextTimestamp() != 1006) {
+        failed = true;
+        std::cerr << "Next event is at " << scheduler.getNextTimestamp() << " instead of 1006\n";
+    }
+
+    Scheduler::Event event;
+    uint64_t timestamp;
+    if (scheduler.popDue(1005, event, timestamp)) {
+        failed = true;
+        std::cerr << "Event popped before it was due\n";
+    }
+
+    // rescheduling moves the pending event instead of adding another one
+    scheduler.schedule(Scheduler::Event::HBlank, 2000);
+    if (!scheduler.popDue(3000, event, timestamp) || event != Scheduler::Event::Scanline || timestamp != 1232 ||
+        !scheduler.popDue(3000, event, timestamp) || event != Scheduler::Event::HBlank || timestamp != 2000 ||
+        scheduler.popDue(3000, event, timestamp)) {
+        failed = true;
+        std::cerr << "Events did not come out in timestamp order\n";
+    }
+
+    // events due at the same time come out in enum order
+    scheduler.schedule(Scheduler::Event::Scanline, 100);
+    scheduler.schedule(Scheduler::Event::HBlank, 100);
+    if (!scheduler.popDue(100, event, timestamp) || event != Scheduler::Event::HBlank) {
+        failed = true;
+        std::cerr << "Simultaneous events did not come out in enum order\n";
+    }
+
+    scheduler.cancel(Scheduler::Event::Scanline);
+    if (scheduler.isScheduled(Scheduler::Event::Scanline) || scheduler.getNextTimestamp() != Scheduler::Never) {
+        failed = true;
+        std::cerr << "Cancelled event is still pending\n";
+    }
+
+    return failed ? 1 : 0;
+}
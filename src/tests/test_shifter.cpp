@@ -0,0 +1,113 @@
+#include "../shifter.h"
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+using namespace GBA;
+
+// Reference model written straight from the ARM7TDMI data sheet, one case at a time
+uint32_t referenceShift(ShiftType shift_type, uint32_t value, uint32_t amount, bool register_shift, bool& carry) {
+    if (!register_shift && amount == 0) {
+        switch (shift_type) {
+        case ShiftType::LogicalLeft:
+            return value;
+        case ShiftType::LogicalRight:
+        case ShiftType::ArithmeticRight:
+            amount = 32;
+            break;
+        case ShiftType::RotateRight: {
+            uint32_t result = (value >> 1) | (carry ? 0x80000000 : 0);
+            carry = value & 0x1;
+            return result;
+        }
+        }
+    }
+    if (amount == 0)
+        return value;
+
+    switch (shift_type) {
+    case ShiftType::LogicalLeft:
+        if (amount < 32) {
+            carry = (value >> (32 - amount)) & 0x1;
+            return value << amount;
+        }
+        carry = amount == 32 ? value & 0x1 : false;
+        return 0;
+    case ShiftType::LogicalRight:
+        if (amount < 32) {
+            carry = (value >> (amount - 1)) & 0x1;
+            return value >> amount;
+        }
+        carry = amount == 32 ? value >> 31 : false;
+        return 0;
+    case ShiftType::ArithmeticRight: {
+        if (amount >= 32) {
+            carry = value >> 31;
+            return carry ? 0xFFFFFFFF : 0;
+        }
+        carry = (value >> (amount - 1)) & 0x1;
+        uint32_t result = value >> amount;
+        if (value >> 31)
+            result |= ~(0xFFFFFFFF >> amount);
+        return result;
+    }
+    default: {
+        amount %= 32;
+        if (amount == 0) {
+            carry = value >> 31;
+            return value;
+        }
+        carry = (value >> (amount - 1)) & 0x1;
+        return (value >> amount) | (value << (32 - amount));
+    }
+    }
+}
+
+int main() {
+    bool failed = false;
+    std::mt19937 random(0x47424100);
+    const ShiftType shift_types[] = {
+        ShiftType::LogicalLeft, ShiftType::LogicalRight, ShiftType::ArithmeticRight, ShiftType::RotateRight};
+
+    for (int i = 0; i < 20000 && !failed; i++) {
+        // make the edge values (0, all ones, single sign bit) as common as random ones
+        uint32_t value = random();
+        switch (random() % 4) {
+        case 0:
+            value = 0;
+            break;
+        case 1:
+            value = 0xFFFFFFFF;
+            break;
+        case 2:
+            value &= 0x80000001;
+            break;
+        }
+        for (ShiftType shift_type : shift_types) {
+            for (uint32_t amount = 0; amount < 256; amount++) {
+                for (bool register_shift : {false, true}) {
+                    if (!register_shift && amount >= 32)
+                        continue;
+                    for (bool carry_in : {false, true}) {
+                        bool carry = carry_in;
+                        bool expected_carry = carry_in;
+                        uint32_t result = shift(shift_type, value, amount, register_shift, carry);
+                        uint32_t expected = referenceShift(shift_type, value, amount, register_shift, expected_carry);
+                        if (result != expected || carry != expected_carry) {
+                            failed = true;
+                            std::cerr << "Shift type " << static_cast<int>(shift_type) << " of 0x" << std::hex
+                                      << value << " by " << std::dec << amount
+                                      << (register_shift ? " (register)" : " (immediate)") << " with carry "
+                                      << carry_in << " gave 0x" << std::hex << result << " carry " << carry
+                                      << ", expected 0x" << expected << " carry " << expected_carry << std::dec
+                                      << '\n';
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return failed ? 1 : 0;
+}
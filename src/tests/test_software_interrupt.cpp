@@ -12,6 +12,8 @@ int main() {
     CPU cpu;
     cpu.setMode(CPU::Mode::User);
     cpu.PC() = 0;
+    cpu.R(13) = 0x03007F00;
+    cpu.R(14) = 0x08000100;
     auto cpsr = cpu.getCPSR();
 
     cpu.callSoftwareInterruptInstruction(0xEF000000, cpu.PC());
@@ -27,6 +29,10 @@ int main() {
         failed = true;
         std::cerr << "Software Interrupt instruction did not set LR_SVC to the next instruction address\n";
     }
+    if (cpu.R(14) != 0x4 || cpu.R(13) != cpu.SP(CPU::Mode::Supervisor) || cpu.R_USRSYS(13) != 0x03007F00) {
+        failed = true;
+        std::cerr << "Entering Supervisor mode did not swap in the Supervisor bank of R13 and R14\n";
+    }
 
     cpu.callDataProcessingInstruction(0xE1B0F00E, cpu.PC());
     if (cpu.PC() != 0x4) {
@@ -41,6 +47,57 @@ int main() {
         failed = true;
         std::cerr << "Returning from Supervisor mode did not restore the CPSR\n";
     }
+    if (cpu.R(13) != 0x03007F00 || cpu.R(14) != 0x08000100) {
+        failed = true;
+        std::cerr << "Returning from Supervisor mode did not swap the User bank of R13 and R14 back in\n";
+    }
+
+    // FIQ banks R8 to R14, the other registers are shared
+    cpu.R(0) = 1;
+    cpu.R(8) = 2;
+    cpu.setMode(CPU::Mode::FastInterrupt);
+    cpu.R(0) = 3;
+    cpu.R(8) = 4;
+    cpu.setMode(CPU::Mode::System);
+    if (cpu.R(0) != 3 || cpu.R(8) != 2 || cpu.R_FIQ(8) != 4) {
+        failed = true;
+        std::cerr << "Fast Interrupt mode did not bank R8 but keep R0 shared\n";
+    }
+
+    // undefined, coprocessor and halfword loads with S and H clear take the undefined instruction exception
+    for (uint32_t instruction_code : {0xE7F000F0u, 0xEE000000u, 0xE1100090u}) {
+        cpu.setMode(CPU::Mode::System);
+        cpu.getMemory().write32(0x03000000, instruction_code);
+        cpu.PC() = 0x03000000;
+        cpu.step();
+        if (cpu.getMode() != CPU::Mode::Undefined || cpu.PC() != 0x04 || cpu.LR(CPU::Mode::Undefined) != 0x03000004 ||
+            !(cpu.getCPSR() & 0x80)) {
+            failed = true;
+            std::cerr << "0x" << std::hex << instruction_code
+                      << " did not take the undefined instruction exception, PC is 0x" << cpu.PC() << std::dec << '\n';
+        }
+    }
+
+    // reserved mode bits keep the current bank instead of stopping the emulator
+    cpu.setMode(CPU::Mode::Supervisor);
+    cpu.R(13) = 0x03007FE0;
+    cpu.getMemory().write32(0x03000000, 0xE321F000);  // msr cpsr_c, #0
+    cpu.PC() = 0x03000000;
+    cpu.step();
+    if ((cpu.getCPSR() & 0x1F) != 0 || cpu.getMode() != CPU::Mode::Supervisor || cpu.R(13) != 0x03007FE0) {
+        failed = true;
+        std::cerr << "Writing reserved mode bits switched the bank, R13 is 0x" << std::hex << cpu.R(13) << std::dec
+                  << '\n';
+    }
+    cpu.setMode(CPU::Mode::Interrupt);
+    cpu.SPSR() = 0x0000000F;
+    cpu.R(13) = 0x03007FA0;
+    cpu.R(14) = 0x03000000;
+    cpu.callDataProcessingInstruction(0xE1B0F00E, cpu.PC());  // movs pc, lr
+    if ((cpu.getCPSR() & 0x1F) != 0x0F || cpu.getMode() != CPU::Mode::Interrupt || cpu.R(13) != 0x03007FA0) {
+        failed = true;
+        std::cerr << "Restoring reserved mode bits from the SPSR switched the bank\n";
+    }
 
     return failed ? 1 : 0;
 }
@@ -0,0 +1,154 @@
+#include "../cpu.h"
+#include <iomanip>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+using namespace GBA;
+
+void writeProgram(std::vector<uint8_t>& bios, uint32_t address, const std::vector<uint16_t>& program) {
+    for (uint16_t instruction_code : program) {
+        bios[address++] = instruction_code & 0xFF;
+        bios[address++] = instruction_code >> 8;
+    }
+}
+
+int main() {
+    bool failed = false;
+
+    std::vector<uint8_t> bios(Memory::BIOSSize);
+    writeProgram(bios, 0x00, {0xFF10, 0xE12F});  // bx r0
+    writeProgram(
+        bios, 0x20,
+        {
+            0x2105,          // 0x20: mov r1, #5
+            0x3103,          // 0x22: add r1, #3
+            0xB502,          // 0x24: push {r1, lr}
+            0xBC0C,          // 0x26: pop {r2, r3}
+            0x4C01,          // 0x28: ldr r4, [pc, #4]
+            0xE003,          // 0x2A: b 0x34
+            0x21FF, 0x21FF,  // 0x2C: mov r1, #0xFF
+            0x5678, 0x1234,  // 0x30: .word 0x12345678
+            0xF000, 0xF804,  // 0x34: bl 0x40
+            0x2808,          // 0x38: cmp r0, #8
+            0xD005,          // 0x3A: beq 0x48
+            0x21FF, 0x21FF,  // 0x3C: mov r1, #0xFF
+            0xC512,          // 0x40: stmia r5!, {r1, r4}
+            0xCE81,          // 0x42: ldmia r6!, {r0, r7}
+            0x4770,          // 0x44: bx lr
+            0x21FF,          // 0x46: mov r1, #0xFF
+            0xDF05,          // 0x48: swi 5
+        });
+
+    CPU cpu;
+    cpu.loadBIOS(bios);
+    cpu.reset();
+    cpu.setMode(CPU::Mode::System);
+    cpu.R(0) = 0x21;
+    cpu.R(5) = 0x03000100;
+    cpu.R(6) = 0x03000100;
+    cpu.R(13) = 0x03007F00;
+    cpu.R(14) = 0xCAFE0000;
+
+    cpu.step();
+    if (!cpu.inThumb() || cpu.PC() != 0x20) {
+        failed = true;
+        std::cerr << "BX to an odd address did not switch to Thumb state at 0x20\n";
+    }
+    for (size_t i = 0; i < 14 && cpu.inThumb(); i++)
+        cpu.step();
+
+    std::vector<std::pair<uint32_t, uint32_t>> expected_registers = {
+        {0, 8},
+        {1, 8},
+        {2, 8},
+        {3, 0xCAFE0000},
+        {4, 0x12345678},
+        {5, 0x03000108},
+        {6, 0x03000108},
+        {7, 0x12345678},
+    };
+    for (const auto& [index, expected] : expected_registers) {
+        if (cpu.R(index) != expected) {
+            failed = true;
+            std::cerr << "r" << index << " is 0x" << std::hex << cpu.R(index) << ", expected 0x" << expected
+                      << std::dec << '\n';
+        }
+    }
+    if (cpu.SP(CPU::Mode::System) != 0x03007F00) {
+        failed = true;
+        std::cerr << "PUSH and POP did not leave SP where it started\n";
+    }
+    if (cpu.LR(CPU::Mode::System) != 0x39) {
+        failed = true;
+        std::cerr << "BL did not leave the return address with bit 0 set in LR\n";
+    }
+    if (cpu.getMode() != CPU::Mode::Supervisor || cpu.inThumb() || cpu.PC() != 0x08) {
+        failed = true;
+        std::cerr << "Thumb SWI did not enter Supervisor mode in ARM state at 0x08\n";
+    }
+    if (cpu.LR(CPU::Mode::Supervisor) != 0x4A) {
+        failed = true;
+        std::cerr << "Thumb SWI did not set LR_SVC to the next instruction address\n";
+    }
+
+    // bit 9 selects SUB in the three operand ADD and SUB
+    cpu.R(1) = 5;
+    cpu.callAddSubtractThumbInstruction(0x1CCA);  // add r2, r1, #3
+    cpu.callAddSubtractThumbInstruction(0x1E4B);  // sub r3, r1, #1
+    if (cpu.R(2) != 8 || cpu.R(3) != 4) {
+        failed = true;
+        std::cerr << "ADD and SUB with an immediate gave " << cpu.R(2) << " and " << cpu.R(3) << '\n';
+    }
+
+    // R15 reads as the instruction address + 4 in the hi register operations, only BX aligns it
+    Memory& memory = cpu.getMemory();
+    memory.write16(0x03000000, 0x4479);      // 0x00: add r1, pc
+    memory.write16(0x03000002, 0x4678);      // 0x02: mov r0, pc
+    memory.write16(0x03000004, 0x4778);      // 0x04: bx pc
+    memory.write16(0x03000006, 0x46C0);      // 0x06: nop
+    memory.write32(0x03000008, 0xE3A0202A);  // 0x08: mov r2, #42
+    memory.write16(0x03000010, 0x46F7);      // 0x10: mov pc, lr
+    cpu.writeCPSR(cpu.getCPSR() | 0x20);
+    cpu.PC() = 0x03000000;
+    cpu.R(1) = 0x10;
+    cpu.R(2) = 0;
+    for (int i = 0; i < 4; i++)
+        cpu.step();
+    if (cpu.R(0) != 0x03000006 || cpu.R(1) != 0x03000014 || cpu.R(2) != 42 || cpu.inThumb() ||
+        cpu.PC() != 0x0300000C) {
+        failed = true;
+        std::cerr << "Hi register operations on PC gave r0 0x" << std::hex << cpu.R(0) << ", r1 0x" << cpu.R(1)
+                  << " and ended at 0x" << cpu.PC() << std::dec << " with r2 " << cpu.R(2) << '\n';
+    }
+    cpu.writeCPSR(cpu.getCPSR() | 0x20);
+    cpu.PC() = 0x03000010;
+    cpu.R(14) = 0x03000021;
+    cpu.step();
+    if (cpu.PC() != 0x03000020 || !cpu.inThumb()) {
+        failed = true;
+        std::cerr << "MOV PC, LR with an odd LR went to 0x" << std::hex << cpu.PC() << std::dec << '\n';
+    }
+
+    // undefined encodings take the undefined instruction exception with LR at the next instruction
+    memory.write16(0x03000020, 0xE800);
+    cpu.PC() = 0x03000020;
+    cpu.step();
+    if (cpu.getMode() != CPU::Mode::Undefined || cpu.inThumb() || cpu.PC() != 0x04 ||
+        cpu.LR(CPU::Mode::Undefined) != 0x03000022) {
+        failed = true;
+        std::cerr << "An undefined Thumb instruction did not enter Undefined mode at 0x04\n";
+    }
+
+    // the table has to agree with the decodeThumb chain for every encoding
+    for (uint32_t instruction_code = 0; instruction_code <= 0xFFFF; instruction_code++) {
+        if (CPU::lookupThumb(instruction_code) != CPU::getThumbInstructionHandler(cpu.decodeThumb(instruction_code))) {
+            failed = true;
+            std::cerr << "Decode table disagrees with decodeThumb for 0x" << std::hex << instruction_code << std::dec
+                      << '\n';
+            break;
+        }
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,47 @@
+#include "../trace.h"
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+using namespace GBA;
+
+int main() {
+    bool failed = false;
+    Trace::RingBuffer<8> buffer;
+    for (uint32_t i = 0; i < 5; i++)
+        buffer.record(i * 4, 0xE0000000 | i, 0x1F);
+    if (buffer.size() != 5 || buffer.get(0).pc != 0 || buffer.get(4).pc != 16) {
+        failed = true;
+        std::cerr << "Partially filled trace does not hold the records in order\n";
+    }
+
+    for (uint32_t i = 5; i < 13; i++)
+        buffer.record(i * 4, 0xE0000000 | i, 0x1F);
+    if (buffer.getCount() != 13 || buffer.size() != 8 || buffer.get(0).instruction_code != 0xE0000005 ||
+        buffer.get(7).instruction_code != 0xE000000C) {
+        failed = true;
+        std::cerr << "Wrapped trace does not keep the newest records oldest first\n";
+    }
+
+    FILE* file = std::tmpfile();
+    if (file == NULL || !buffer.dump(fileno(file))) {
+        std::cerr << "Failed to dump the trace\n";
+        return 1;
+    }
+    std::rewind(file);
+    std::vector<Trace::Record> records(16);
+    records.resize(std::fread(records.data(), sizeof(Trace::Record), records.size(), file));
+    std::fclose(file);
+    if (records.size() != 8) {
+        failed = true;
+        std::cerr << "Dump holds " << records.size() << " records instead of 8\n";
+    }
+    for (size_t i = 0; i < records.size(); i++) {
+        if (records[i].pc != (i + 5) * 4 || records[i].cpsr != 0x1F) {
+            failed = true;
+            std::cerr << "Dumped record " << i << " is out of order\n";
+        }
+    }
+
+    return failed ? 1 : 0;
+}
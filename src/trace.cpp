@@ -0,0 +1,40 @@
+#include "trace.h"
+#include <csignal>
+#include <cstring>
+#include <unistd.h>
+
+namespace {
+
+int crash_fd = -1;
+
+void dumpAndDie(int signal) {
+    GBA::Trace::instructions().dump(crash_fd);
+    std::signal(signal, SIG_DFL);
+    std::raise(signal);
+}
+
+}
+
+bool GBA::Trace::writeRecords(int fd, const Record* records, size_t count) {
+    auto data = reinterpret_cast<const char*>(records);
+    size_t remaining = count * sizeof(Record);
+    while (remaining > 0) {
+        ssize_t written = write(fd, data, remaining);
+        if (written <= 0)
+            return false;
+        data += written;
+        remaining -= written;
+    }
+    return true;
+}
+
+GBA::Trace::RingBuffer<GBA::Trace::InstructionCapacity>& GBA::Trace::instructions() {
+    static RingBuffer<InstructionCapacity> buffer;
+    return buffer;
+}
+
+void GBA::Trace::dumpOnCrash(int fd) {
+    crash_fd = fd;
+    for (int signal : {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT})
+        std::signal(signal, dumpAndDie);
+}
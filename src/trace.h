@@ -0,0 +1,106 @@
+#ifndef GBA_TRACE_H
+#define GBA_TRACE_H
+
+#include "common.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Compile-time trace level, set through the GBA_TRACE_LEVEL cache variable:
+// 0 compiles tracing out completely, 1 records every executed instruction
+#ifndef GBA_TRACE_LEVEL
+#define GBA_TRACE_LEVEL 0
+#endif
+
+namespace GBA {
+
+namespace Trace {
+
+enum Level : int {
+    Off = 0,
+    Instructions = 1,
+};
+
+constexpr int level = GBA_TRACE_LEVEL;
+
+// One executed instruction, dumped as raw little-endian records (no header) so a dump is cheap enough to
+// write from a crash handler
+struct Record
+{
+    uint32_t pc;
+    uint32_t instruction_code;
+    uint32_t cpsr;
+};
+
+// Writes count records to fd with write(2), retrying short writes
+bool writeRecords(int fd, const Record* records, size_t count);
+
+// Fixed-size ring of the last Capacity records. There is one writer (the emulation thread), which never
+// blocks or allocates; readers only load the write position, so a dump taken while the writer is running
+// may contain a few torn records at the oldest end.
+template <size_t Capacity>
+class RingBuffer
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+  public:
+    RingBuffer() : records{}, head{0} {}
+
+    void record(uint32_t pc, uint32_t instruction_code, uint32_t cpsr) {
+        uint64_t position = head.load(std::memory_order_relaxed);
+        records[position & (Capacity - 1)] = Record{pc, instruction_code, cpsr};
+        head.store(position + 1, std::memory_order_release);
+    }
+
+    // Number of records written since construction, including the ones already overwritten
+    uint64_t getCount() const { return head.load(std::memory_order_acquire); }
+
+    // i-th oldest record still in the buffer
+    const Record& get(size_t i) const {
+        uint64_t count = getCount();
+        uint64_t first = count > Capacity ? count - Capacity : 0;
+        return records[(first + i) & (Capacity - 1)];
+    }
+
+    size_t size() const {
+        uint64_t count = getCount();
+        return count > Capacity ? Capacity : static_cast<size_t>(count);
+    }
+
+    // Writes the records oldest first to a file descriptor, only uses write(2) so it is async-signal-safe.
+    // Returns false if a write failed.
+    bool dump(int fd) const {
+        uint64_t count = getCount();
+        size_t first = count > Capacity ? static_cast<size_t>(count & (Capacity - 1)) : 0;
+        size_t stored = count > Capacity ? Capacity : static_cast<size_t>(count);
+        size_t until_end = std::min(stored, Capacity - first);
+        return writeRecords(fd, &records[first], until_end) && writeRecords(fd, &records[0], stored - until_end);
+    }
+
+  private:
+    std::array<Record, Capacity> records;
+    std::atomic<uint64_t> head;
+};
+
+// Records kept by the global instruction trace
+constexpr size_t InstructionCapacity = 1 << 16;
+
+RingBuffer<InstructionCapacity>& instructions();
+
+// Appends an executed instruction to the global trace, compiles to nothing when tracing is off
+inline void instruction(uint32_t pc, uint32_t instruction_code, uint32_t cpsr) {
+    if constexpr (level >= Instructions)
+        instructions().record(pc, instruction_code, cpsr);
+}
+
+// Dumps the global trace to fd when the process dies of SIGSEGV, SIGBUS, SIGILL, SIGFPE or SIGABRT, then
+// lets the signal take its default action. Install it before enabling fastmem, whose fault handler passes
+// faults it does not own on to the handler that was installed before it.
+void dumpOnCrash(int fd);
+
+}
+
+}
+
+#endif